@@ -32,7 +32,7 @@ int main(int argc, char** argv) {
 
     std::vector<std::string> regexes;
     std::vector<std::string> test_regexes;
-    std::vector<std::string> lines;
+    Dataset lines;
 #ifdef NDEBUG
     status = readWorkload(expr_info, regexes, test_regexes, lines);
 #else
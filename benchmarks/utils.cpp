@@ -6,6 +6,9 @@
 #include <string.h>
 #include <filesystem>
 #include <climits>
+#include <functional>
+#include <thread>
+#include <atomic>
 
 #include "../src/BEST/Index/parallelizable.hpp"
 
@@ -19,6 +22,8 @@
 
 #include "utils.hpp"
 #include "../src/utils/reg_utils.hpp"
+#include "../src/utils/mapped_file.hpp"
+#include "../src/utils/line_reader.hpp"
 
 inline constexpr const int kNumIndexBuilding = 1;
 
@@ -163,6 +168,7 @@ int parseArgs(int argc, char ** argv,
     if (!selec_string.empty()) {
         selec = std::stod(selec_string);
     }
+    auto index_file = getCmdOption(argv, argv + argc, "--index");
     switch (expr_info.stype) {
         case selection_type::kNone:
             expr_info.num_repeat = rep;
@@ -171,6 +177,7 @@ int parseArgs(int argc, char ** argv,
             free_info.num_repeat = rep;
             free_info.key_upper_bound = max_key;
             free_info.num_threads = thread_count;
+            free_info.index_file = index_file;
             if (n == 0) {
                 return error_return("Missing/Invalid upper bound on n of n-gram.");
             }
@@ -185,6 +192,7 @@ int parseArgs(int argc, char ** argv,
             best_info.num_repeat = rep;
             best_info.key_upper_bound = max_key;
             best_info.num_threads = thread_count;
+            best_info.index_file = index_file;
             if (selec > 0 && selec <= 1) {
                 best_info.sel_threshold = selec;
             } 
@@ -214,12 +222,21 @@ int parseArgs(int argc, char ** argv,
                         return error_return("Invalid distance type.");
                 }
             }
+            auto seed_string = getCmdOption(argv, argv + argc, "--seed");
+            if (!seed_string.empty()) {
+                best_info.seed = std::stol(seed_string);
+            }
+            auto sample_string = getCmdOption(argv, argv + argc, "--cluster_sample");
+            if (!sample_string.empty()) {
+                best_info.cluster_sample_size = std::stoul(sample_string);
+            }
             break;
         }
         case selection_type::kFast: {
             lpms_info.num_repeat = rep;
             lpms_info.key_upper_bound = max_key;
             lpms_info.num_threads = thread_count;
+            lpms_info.index_file = index_file;
             auto relax_string = getCmdOption(argv, argv + argc, "--relax");
             lpms_info.rtype_str = relax_string;
             if (relax_string.empty()) {
@@ -237,12 +254,14 @@ int parseArgs(int argc, char ** argv,
             trigram_info.num_repeat = rep;
             trigram_info.key_upper_bound = max_key;
             trigram_info.num_threads = thread_count;
+            trigram_info.index_file = index_file;
             break;
         }
         case selection_type::kVGGraph: {
             vggraph_info.num_repeat = rep;
             vggraph_info.key_upper_bound = max_key;
             vggraph_info.num_threads = thread_count;
+            vggraph_info.index_file = index_file;
             if (n == 0) {
                 return error_return("Missing/Invalid upper bound on n of n-gram.");
             }
@@ -260,189 +279,175 @@ int parseArgs(int argc, char ** argv,
     return EXIT_SUCCESS;
 }
 
-std::vector<std::string> read_traffic(int max_lines=-1) {
-    std::string line;
-    std::vector<std::string> lines;
-    std::string traffic_file = "data/US_Accidents_Dec21_updated.csv";
+// Map the file at path and call f(std::string_view content); an empty file
+//   has nothing to map and is passed as an empty view. False if it cannot be read.
+template<class F>
+bool with_mapped_file(const std::string & path, F && f) {
+    MappedFile file;
+    if (file.open(path)) {
+        f(std::string_view(file.data(), file.size()));
+        return true;
+    }
+    std::error_code ec;
+    if (std::filesystem::is_regular_file(path, ec) && std::filesystem::file_size(path, ec) == 0) {
+        f(std::string_view());
+        return true;
+    }
+    return false;
+}
 
-    std::ifstream data_in(traffic_file);
-    if (!data_in.is_open()) {
-        std::cerr << "Could not open data file '" << traffic_file << "'" << std::endl;
-        return lines;
-    }
-
-    size_t i = 0;
-    while (getline(data_in, line)){
-        line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
-        std::stringstream streamData(line);
-        std::string s; 
-        int i = 0;
-        while (getline(streamData, s, ',')) {
-            if (i++ == 9){
-                lines.push_back(s);
-                break;
+// Load the files in parallel with load_one(path, Dataset & part), appending
+//   the parts to lines in the order of files. Files go in waves of one per
+//   thread, so that loading stops soon after lines holds more than max_lines.
+template<class F>
+void load_files_parallel(const std::vector<std::string> & files, Dataset & lines,
+                         int max_lines, F && load_one) {
+    size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<Dataset> parts(std::min(num_threads, files.size()));
+    for (size_t first = 0; first < files.size(); first += parts.size()) {
+        size_t wave = std::min(parts.size(), files.size() - first);
+        std::atomic<size_t> next{0};
+        auto worker = [&]() {
+            for (size_t i = next++; i < wave; i = next++) {
+                parts[i].clear();
+                load_one(files[first + i], parts[i]);
             }
+        };
+        std::vector<std::thread> threads;
+        for (size_t t = 1; t < wave; t++) {
+            threads.emplace_back(worker);
         }
-        if (max_lines > 0 && lines.size() > max_lines) {
-            break;
+        worker();
+        for (auto & th : threads) {
+            th.join();
+        }
+        for (size_t i = 0; i < wave; i++) {
+            for (auto record : parts[i]) {
+                lines.push_back(record);
+                if (max_lines > 0 && lines.size() > max_lines) {
+                    return;
+                }
+            }
         }
     }
-    data_in.close();
-    return lines;
-}
-
-auto read_file_to_string(const std::string & path) -> std::string {
-    constexpr auto read_size = std::size_t(4096);
-    auto stream = std::ifstream(path);
-    stream.exceptions(std::ios_base::badbit);
-
-    if (not stream) {
-        throw std::ios_base::failure("file does not exist");
-    }
-    
-    auto out = std::string();
-    auto buf = std::string(read_size, '\0');
-
-    while (stream.read(& buf[0], read_size)) {
-        out.append(buf, 0, stream.gcount());
-    }
-    out.append(buf, 0, stream.gcount());
-    stream.close();
-    return out;
 }
 
-std::vector<std::string> read_webpages(int max_lines=-1) {
-    std::string line;
-
-    std::vector<std::string> lines;
-    std::string path = "data/webpages/processed";
-    for (const auto & entry : std::filesystem::directory_iterator(path)) {
-        std::string data_file = entry.path();
-        lines.push_back(read_file_to_string(data_file));
-        if (max_lines > 0 && lines.size() > max_lines) {
-            return lines;
-        }
+void read_traffic(Dataset & lines, int max_lines=-1) {
+    std::string traffic_file = "data/US_Accidents_Dec21_updated.csv";
+    std::string scratch;
+    bool read = with_mapped_file(traffic_file, [&](std::string_view content) {
+        for_each_line(content, [&](std::string_view line) {
+            // only the 10th column (Description) is kept
+            std::string_view field;
+            if (nth_field(strip_cr(line, scratch), 9, ',', field)) {
+                lines.push_back(field);
+            }
+            return !(max_lines > 0 && lines.size() > max_lines);
+        });
+    });
+    if (!read) {
+        std::cerr << "Could not open data file '" << traffic_file << "'" << std::endl;
     }
-    return lines;
 }
 
 void read_file(const std::string & file_type, const std::string & infile_name,
-               std::vector<std::string> & in_strings, int max_lines=-1) {
-    std::ifstream data_in(infile_name);
-    if (!data_in.is_open()) {
+               Dataset & in_strings, int max_lines=-1) {
+    std::string scratch;
+    bool read = with_mapped_file(infile_name, [&](std::string_view content) {
+        for_each_line(content, [&](std::string_view line) {
+            in_strings.push_back(strip_cr(line, scratch));
+            return !(max_lines > 0 && in_strings.size() > max_lines);
+        });
+    });
+    if (!read) {
         std::cerr << "Could not open " << file_type << " file '";
         std::cerr << infile_name << "'" << std::endl;
-    } else {
-        std::string line;
-        while (getline(data_in, line)){
-            line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
-            in_strings.push_back(line);
-            if (max_lines > 0 && in_strings.size() > max_lines) {
-                break;
-            }
-        }
-        data_in.close();
     }
 }
 
 std::vector<std::string> read_file(const std::string & file_type, 
                                    const std::string & infile_name,
                                    int max_lines=-1) {
-    std::vector<std::string> in_strings;
-    std::ifstream data_in(infile_name);
-    if (!data_in.is_open()) {
-        std::cerr << "Could not open " << file_type << " file '";
-        std::cerr << infile_name << "'" << std::endl;
-    } else {
-        std::string line;
-        while (getline(data_in, line)){
-            line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
-            in_strings.push_back(line);
-            if (max_lines > 0 && in_strings.size() > max_lines) {
-                break;
-            }
-        }
-        data_in.close();
-    }
-    return in_strings;
+    Dataset lines;
+    read_file(file_type, infile_name, lines, max_lines);
+    return std::vector<std::string>(lines.begin(), lines.end());
 }
 
-std::vector<std::string> read_directory(const std::string & file_type, 
-                                        const std::string & path, int max_lines=-1) {
-    std::string line;
+void read_webpages(Dataset & lines, int max_lines=-1) {
+    // one record per page
+    std::vector<std::string> files;
+    for (const auto & entry : std::filesystem::directory_iterator("data/webpages/processed")) {
+        files.push_back(entry.path());
+    }
+    load_files_parallel(files, lines, max_lines, [](const std::string & path, Dataset & part) {
+        if (!with_mapped_file(path, [&](std::string_view content) { part.push_back(content); })) {
+            std::cerr << "Could not open webpage file '" << path << "'" << std::endl;
+        }
+    });
+}
 
-    std::vector<std::string> lines;
+void read_directory(const std::string & file_type, const std::string & path,
+                    Dataset & lines, int max_lines=-1) {
+    std::vector<std::string> files;
     for (const auto & entry : std::filesystem::recursive_directory_iterator(path)) {
-        std::string data_file = entry.path();
-        read_file(file_type, data_file, lines, max_lines);
+        if (entry.is_regular_file()) {
+            files.push_back(entry.path());
+        }
     }
-    return lines;
+    load_files_parallel(files, lines, max_lines, 
+        [&](const std::string & data_file, Dataset & part) {
+            read_file(file_type, data_file, part, max_lines);
+        });
 }
 
-std::vector<std::string> read_enron(int max_files) {
-    std::vector<std::string> data_strings;
-    
+void read_enron(Dataset & data_strings, int max_files) {
+    std::vector<std::string> files;
     try {
         for (const auto & entry : std::filesystem::recursive_directory_iterator("data/enron/maildir")) {
             // Only process regular files, skip directories
             if (!entry.is_regular_file()) {
                 continue;
             }
-            
-            std::string file_path = entry.path();
-            std::ifstream file_in(file_path);
-            
-            if (!file_in.is_open()) {
-                std::cerr << "Could not open Enron file: " << file_path << std::endl;
-                continue;
-            }
-            
-            // Read entire file content as one string, preserving newlines
-            std::string file_content;
-            std::string line;
-            bool first_line = true;
-            
-            while (std::getline(file_in, line)) {
-                if (!first_line) {
-                    file_content += "\n";
-                }
-                // Remove carriage returns but keep the content
-                line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
-                file_content += line;
-                first_line = false;
-            }
-            
-            file_in.close();
-            
-            // Add the complete file content as one data string
-            data_strings.push_back(file_content);
-            
-            // Check if we've reached the maximum number of files
-            if (max_files > 0 && data_strings.size() >= max_files) {
+            files.push_back(entry.path());
+            if (max_files > 0 && files.size() >= max_files) {
                 break;
             }
         }
     } catch (const std::filesystem::filesystem_error& ex) {
         std::cerr << "Filesystem error while reading Enron directory: " << ex.what() << std::endl;
     }
-    
-    return data_strings;
+
+    load_files_parallel(files, data_strings, -1, [](const std::string & path, Dataset & part) {
+        std::string scratch;
+        bool read = with_mapped_file(path, [&](std::string_view content) {
+            // the whole file is one data string: its lines joined by '\n'
+            //   with carriage returns removed, i.e. without a final '\n'
+            auto mail = strip_cr(content, scratch);
+            if (!content.empty() && content.back() == '\n') {
+                mail.remove_suffix(1);
+            }
+            part.push_back(mail);
+        });
+        if (!read) {
+            std::cerr << "Could not open Enron file: " << path << std::endl;
+        }
+    });
 }
 
 int readWorkload(const expr_info & expr_info, 
                  std::vector<std::string> & regexes, 
                  std::vector<std::string> & test_regexes, 
-                 std::vector<std::string> & lines,
+                 Dataset & lines,
                  int max_lines) {
     switch (expr_info.wl) {
         case 1: 
             regexes = read_file("regex", kTrafficRegex);
-            lines = read_traffic(max_lines);
+            read_traffic(lines, max_lines);
             break;
         case 2:
             regexes = read_file("regex", kDbxRegex);
             // lines = read_dbx(max_lines);
-            lines = read_directory("data", "data/extracted", max_lines);
+            read_directory("data", "data/extracted", lines, max_lines);
             break;
         case 3:
             if (expr_info.stype == selection_type::kFree) {
@@ -450,24 +455,26 @@ int readWorkload(const expr_info & expr_info,
             } else {
                 regexes = read_file("regex", kWebRegex);
             }
-            lines = read_webpages(std::min(max_lines, 7000000));
+            read_webpages(lines, std::min(max_lines, 7000000));
             break;
         case 4:
             regexes = read_file("regex", kPrositeRegex);
-            lines = read_directory("data", "data/protein/sequences", max_lines);
+            read_directory("data", "data/protein/sequences", lines, max_lines);
             break;
         case 5:
             regexes = read_file("regex", kSysyRegex);
-            lines = read_file("data", "data/tagged_data.csv", max_lines);
+            read_file("data", "data/tagged_data.csv", lines, max_lines);
             break;
         case 6:
             regexes = read_file("regex", kEnronRegex);
-            lines = read_enron(max_lines);
+            read_enron(lines, max_lines);
             break;
         default:
             regexes = read_file("regex", expr_info.reg_file);
-            lines = read_file("data", expr_info.data_file, max_lines);
+            read_file("data", expr_info.data_file, lines, max_lines);
     }
+    // drop the slack left by growing the arena while reading
+    lines.shrink_to_fit();
 
     std::cout << "read workload end." << std::endl;
     std::cout << "Number of regexes: " << regexes.size() << "."<< std::endl;
@@ -514,10 +521,36 @@ std::ofstream open_summary(const std::filesystem::path & dir_path) {
     return std::move(outfile);
 }
 
+// Load the index from index_file if it holds one built over the same data;
+//   otherwise build it, and save it to index_file if one is given
+void build_or_load_index(NGramInvertedIndex * pi, const std::string & index_file,
+                         const std::function<void()> & build) {
+    if (!index_file.empty() && std::filesystem::exists(index_file)) {
+        auto start = std::chrono::high_resolution_clock::now();
+        if (pi->load_index(index_file)) {
+            auto load_time = std::chrono::duration_cast<std::chrono::duration<double>>(
+                std::chrono::high_resolution_clock::now() - start).count();
+            std::cout << "Index Loading End in " << load_time << " s" << std::endl;
+            // same fields as logged by build_index; loading counts as build time
+            std::ostringstream log;
+            log << "Loaded,,,,," << pi->get_queries().size() << ",0,";
+            log << load_time << "," << load_time << ",";
+            log << pi->get_num_keys() << "," << pi->get_bytes_used() << ",";
+            pi->write_to_file(log.str());
+            return;
+        }
+        std::cerr << "Rebuilding the index instead" << std::endl;
+    }
+    build();
+    if (!index_file.empty()) {
+        pi->save_index(index_file);
+    }
+}
+
 void benchmarkFree(const std::filesystem::path dir_path, 
                    const std::vector<std::string> & regexes, 
                    const std::vector<std::string> & test_regexes, 
-                   const std::vector<std::string> & lines,
+                   const Dataset & lines,
                    const free_info & free_info) {
     std::ofstream outfile = open_summary(dir_path);
 
@@ -539,7 +572,8 @@ void benchmarkFree(const std::filesystem::path dir_path,
     }
     pi->set_key_upper_bound(free_info.key_upper_bound);
     pi->set_outfile(outfile);
-    pi->build_index(free_info.upper_n);
+    build_or_load_index(pi, free_info.index_file,
+                        [&]() { pi->build_index(free_info.upper_n); });
 
     auto tr = regexes;
     if (!test_regexes.empty()) {
@@ -554,6 +588,7 @@ void benchmarkFree(const std::filesystem::path dir_path,
         }
         // matching; add match time to the overall file
         auto matcher = SimpleQueryMatcher(*pi, tr);
+        matcher.set_thread_count(free_info.num_threads);
         matcher.match_all();
     }
 
@@ -584,7 +619,7 @@ void benchmarkFree(const std::filesystem::path dir_path,
 void benchmarkBest(const std::filesystem::path dir_path, 
                    const std::vector<std::string> & regexes, 
                    const std::vector<std::string> & test_regexes, 
-                   const std::vector<std::string> & lines,
+                   const Dataset & lines,
                    const best_info & best_info) {
     if (best_info.wl_reduced_size > int(regexes.size())) {
         std::cerr << best_info.wl_reduced_size << " " << regexes.size() << std::endl;
@@ -630,8 +665,10 @@ void benchmarkBest(const std::filesystem::path dir_path,
 
     }
     pi->set_key_upper_bound(best_info.key_upper_bound);
+    pi->set_random_seed(best_info.seed);
+    pi->set_clustering_sample(best_info.cluster_sample_size);
     pi->set_outfile(outfile);
-    pi->build_index();
+    build_or_load_index(pi, best_info.index_file, [&]() { pi->build_index(); });
 
     auto tr = regexes;
     if (!test_regexes.empty()) {
@@ -646,6 +683,7 @@ void benchmarkBest(const std::filesystem::path dir_path,
         }
         // matching; add match time to the overall file
         auto matcher = SimpleQueryMatcher(*pi, tr);
+        matcher.set_thread_count(best_info.num_threads);
         matcher.match_all();
     }
 
@@ -676,7 +714,7 @@ void benchmarkBest(const std::filesystem::path dir_path,
 void benchmarkFast(const std::filesystem::path dir_path,
                    const std::vector<std::string> & regexes, 
                    const std::vector<std::string> & test_regexes, 
-                   const std::vector<std::string> & lines,
+                   const Dataset & lines,
                    const lpms_info & lpms_info) {
 
     std::ofstream outfile = open_summary(dir_path);
@@ -687,7 +725,7 @@ void benchmarkFast(const std::filesystem::path dir_path,
     pi->set_thread_count(lpms_info.num_threads);
     pi->set_key_upper_bound(lpms_info.key_upper_bound);
     pi->set_outfile(outfile);
-    pi->build_index();
+    build_or_load_index(pi, lpms_info.index_file, [&]() { pi->build_index(); });
 
     auto tr = regexes;
     if (!test_regexes.empty()) {
@@ -702,6 +740,7 @@ void benchmarkFast(const std::filesystem::path dir_path,
         }
         // matching; add match time to the overall file
         auto matcher = SimpleQueryMatcher(*pi, tr);
+        matcher.set_thread_count(lpms_info.num_threads);
         matcher.match_all();
     }
 
@@ -732,7 +771,7 @@ void benchmarkFast(const std::filesystem::path dir_path,
 void benchmarkTrigram(const std::filesystem::path dir_path,
                    const std::vector<std::string> & regexes, 
                    const std::vector<std::string> & test_regexes, 
-                   const std::vector<std::string> & lines,
+                   const Dataset & lines,
                    const trigram_info & trigram_info) {
 
     std::ofstream outfile = open_summary(dir_path);
@@ -743,7 +782,7 @@ void benchmarkTrigram(const std::filesystem::path dir_path,
     pi->set_thread_count(trigram_info.num_threads);
     pi->set_key_upper_bound(trigram_info.key_upper_bound);
     pi->set_outfile(outfile);
-    pi->build_index();
+    build_or_load_index(pi, trigram_info.index_file, [&]() { pi->build_index(); });
 
     auto tr = regexes;
     if (!test_regexes.empty()) {
@@ -758,6 +797,7 @@ void benchmarkTrigram(const std::filesystem::path dir_path,
         }
         // matching; add match time to the overall file
         auto matcher = SimpleQueryMatcher(*pi, tr);
+        matcher.set_thread_count(trigram_info.num_threads);
         matcher.match_all();
     }
 
@@ -787,7 +827,7 @@ void benchmarkTrigram(const std::filesystem::path dir_path,
 void benchmarkVGGraph(const std::filesystem::path dir_path,
                       const std::vector<std::string> & regexes, 
                       const std::vector<std::string> & test_regexes, 
-                      const std::vector<std::string> & lines,
+                      const Dataset & lines,
                       const vggraph_info & vggraph_info) {
     std::ofstream outfile = open_summary(dir_path);
 
@@ -801,7 +841,8 @@ void benchmarkVGGraph(const std::filesystem::path dir_path,
                                                  vggraph_info.num_threads);
     pi->set_key_upper_bound(vggraph_info.key_upper_bound);
     pi->set_outfile(outfile);
-    pi->build_index(vggraph_info.upper_n);
+    build_or_load_index(pi, vggraph_info.index_file,
+                        [&]() { pi->build_index(vggraph_info.upper_n); });
 
     auto tr = regexes;
     if (!test_regexes.empty()) {
@@ -816,6 +857,7 @@ void benchmarkVGGraph(const std::filesystem::path dir_path,
         }
         // matching; add match time to the overall file
         auto matcher = SimpleQueryMatcher(*pi, tr);
+        matcher.set_thread_count(vggraph_info.num_threads);
         matcher.match_all();
     }
 
@@ -847,7 +889,7 @@ void benchmarkVGGraph(const std::filesystem::path dir_path,
 void benchmarkBaseline(const std::filesystem::path dir_path,
                         const std::vector<std::string> & regexes, 
                         const std::vector<std::string> & test_regexes, 
-                        const std::vector<std::string> & lines,
+                        const Dataset & lines,
                         const expr_info & expr_info) {
 
     std::ofstream outfile = open_summary(dir_path);
@@ -35,6 +35,8 @@ inline constexpr std::string_view kUsage = "usage:  \n\
     \t -k [int] \t Max number of n-grams selected. The default is LLONG_MAX.\n\
     \t -c [double] \t Selectivity threshold t; prune grams whose occurance is larger than t.\n\
     \t             \t The default is 0.1 for FREE, BEST, and VGGraph, and not applicable to LPMS.\n\
+    \t --index [path] \t Index file; load the index from it if it holds one built over the same data,\n\
+    \t                \t otherwise build the index and save it there. Not applicable to NONE.\n\
       FREE specific options:\n\
     \t -n [int], required \t Upper bound of multi-gram size.\n\
     \t --presuf \t Use presuf shell to generate a gram set that is also suffix-free; default not used.\n\
@@ -45,6 +47,9 @@ inline constexpr std::string_view kUsage = "usage:  \n\
     \t                          \t The value can be a fraction of the whole dataset, or an exact number.\n\
     \t --dist [1|2|3] \t Type of distance measurement used in workload reduction and clustering. \n\
     \t                \t Default to 2. \n\
+    \t --seed [int] \t Seed of the query clustering, for repeatable runs; default random. \n\
+    \t --cluster_sample [int] \t Cluster queries on samples of this many queries (CLARA) \n\
+    \t                        \t instead of the full distance matrix; default 0, full matrix. \n\
       LPMS specific options:\n\
     \t --relax [DETERM|RANDOM], required \t Type of relaxation method.";
 /*-------------------------------------------------------------------------------------------------------------------*/
@@ -65,6 +70,7 @@ struct free_info {
     int num_repeat = 10;
     long long int key_upper_bound;
     int num_threads;
+    std::string index_file = "";
     double sel_threshold = 0.1;
     int upper_n; // k
     bool use_presuf = false;
@@ -74,16 +80,20 @@ struct best_info {
     int num_repeat = 10;
     long long int key_upper_bound;
     int num_threads;
+    std::string index_file = "";
     double sel_threshold = 0.1;
     int wl_reduced_size = -1;
     double wl_reduced_frac = -1;
     best_index::dist_type dtype = best_index::dist_type::kMaxDevDist2;
+    long seed = -1;
+    size_t cluster_sample_size = 0;
 };
 
 struct lpms_info {
     int num_repeat = 10;
     long long int key_upper_bound;
     int num_threads;
+    std::string index_file = "";
     lpms_index::relaxation_type rtype;
     std::string rtype_str;
 };
@@ -92,12 +102,14 @@ struct trigram_info {
     int num_repeat = 10;
     long long int key_upper_bound;
     int num_threads;
+    std::string index_file = "";
 };
 
 struct vggraph_info {
     int num_repeat = 10;
     long long int key_upper_bound;
     int num_threads;
+    std::string index_file = "";
     float selectivity_threshold = 0.1f;
     int upper_n = 4;
 };
@@ -119,44 +131,44 @@ int parseArgs(int argc, char ** argv,
 int readWorkload(const expr_info & expr_info, 
                  std::vector<std::string> & regexes, 
                  std::vector<std::string> & test_regexes, 
-                 std::vector<std::string> & lines,
+                 Dataset & lines,
                  int max_lines=-1);
 
-std::vector<std::string> read_enron(int max_files=-1);
+void read_enron(Dataset & data_strings, int max_files=-1);
 
 void benchmarkFree(const std::filesystem::path dir_path, 
                    const std::vector<std::string> & regexes, 
                    const std::vector<std::string> & test_regexes, 
-                   const std::vector<std::string> & lines,
+                   const Dataset & lines,
                    const free_info & free_info);
 
 void benchmarkBest(const std::filesystem::path dir_path,
                    const std::vector<std::string> & regexes, 
                    const std::vector<std::string> & test_regexes, 
-                   const std::vector<std::string> & lines,
+                   const Dataset & lines,
                    const best_info & best_info);
 
 void benchmarkFast(const std::filesystem::path dir_path,
                    const std::vector<std::string> & regexes, 
                    const std::vector<std::string> & test_regexes, 
-                   const std::vector<std::string> & lines,
+                   const Dataset & lines,
                    const lpms_info & lpms_info);
 
 void benchmarkTrigram(const std::filesystem::path dir_path,
                    const std::vector<std::string> & regexes, 
                    const std::vector<std::string> & test_regexes, 
-                   const std::vector<std::string> & lines,
+                   const Dataset & lines,
                    const trigram_info & trigram_info);
 
 void benchmarkVGGraph(const std::filesystem::path dir_path,
                       const std::vector<std::string> & regexes, 
                       const std::vector<std::string> & test_regexes, 
-                      const std::vector<std::string> & lines,
+                      const Dataset & lines,
                       const vggraph_info & vggraph_info);
 
 void benchmarkBaseline(const std::filesystem::path dir_path,
                        const std::vector<std::string> & regexes, 
                        const std::vector<std::string> & test_regexes, 
-                       const std::vector<std::string> & lines,
+                       const Dataset & lines,
                        const expr_info & expr_info);
 #endif // BENCHMARKS_UTILS
\ No newline at end of file
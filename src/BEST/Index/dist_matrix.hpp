@@ -0,0 +1,104 @@
+#ifndef BEST_INDEX_DIST_MATRIX_HPP_
+#define BEST_INDEX_DIST_MATRIX_HPP_
+
+#include <vector>
+#include <set>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+namespace best_index {
+
+/**
+ * Dense |Q| x |Q| distance matrix in one row-major buffer;
+ *   dist_mtx[i][j] reads as with a vector of rows, without a heap block
+ *   per row, and dist_mtx[i] is a pointer to row i rather than a copy.
+ */
+class DistMatrix {
+ public:
+    DistMatrix() {}
+    explicit DistMatrix(size_t n) : n_(n), dists_(n * n, 0) {}
+
+    size_t size() const { return n_; }
+
+    double * operator[](size_t i) { return dists_.data() + i * n_; }
+    const double * operator[](size_t i) const { return dists_.data() + i * n_; }
+
+ private:
+    size_t n_ = 0;
+    std::vector<double> dists_;
+};
+
+/**
+ * Distance between two queries of a workload on demand: the grams are
+ *   interned to ids with their cardinality looked up once, and each query
+ *   is kept as a sorted id list and its cardinality sum. A measure gets
+ *   |G_1|, |G_2| and |G_d| = |G_1 \intersect G_2| (as cardinality sums), and
+ *   queries are passed to it in increasing idx, so dist(i, j) == dist(j, i).
+ */
+class QueryDistance {
+ public:
+    using measure_type = double (*)(size_t g1_sum, size_t g2_sum, size_t gd_sum);
+
+    QueryDistance(const std::vector<std::set<std::string>> & qg_gram_set,
+                  const std::map<std::string, size_t> & pre_suf_count,
+                  measure_type measure)
+      : measure_(measure),
+        q_ids_(qg_gram_set.size()),
+        q_sums_(qg_gram_set.size(), 0) {
+        std::unordered_map<std::string_view, uint32_t> gram_ids;
+        for (size_t i = 0; i < qg_gram_set.size(); i++) {
+            q_ids_[i].reserve(qg_gram_set[i].size());
+            for (const auto & g : qg_gram_set[i]) {
+                auto [it, inserted] = gram_ids.try_emplace(g, cardinality_.size());
+                if (inserted) {
+                    cardinality_.push_back(pre_suf_count.at(g));
+                }
+                q_ids_[i].push_back(it->second);
+                q_sums_[i] += cardinality_[it->second];
+            }
+            std::sort(q_ids_[i].begin(), q_ids_[i].end());
+        }
+    }
+
+    size_t size() const { return q_ids_.size(); }
+
+    double operator()(size_t i, size_t j) const {
+        if (i > j) std::swap(i, j);
+        return measure_(q_sums_[i], q_sums_[j], shared_cardinality(i, j));
+    }
+
+ private:
+    measure_type measure_;
+    std::vector<size_t> cardinality_;
+    std::vector<std::vector<uint32_t>> q_ids_;
+    std::vector<size_t> q_sums_;
+
+    // sum of the cardinalities of the grams in both queries
+    size_t shared_cardinality(size_t i, size_t j) const {
+        const auto & a = q_ids_[i];
+        const auto & b = q_ids_[j];
+        size_t sum = 0;
+        size_t x = 0, y = 0;
+        while (x < a.size() && y < b.size()) {
+            if (a[x] < b[y]) {
+                x++;
+            } else if (b[y] < a[x]) {
+                y++;
+            } else {
+                sum += cardinality_[a[x]];
+                x++;
+                y++;
+            }
+        }
+        return sum;
+    }
+};
+
+} // namespace best_index
+
+#endif // BEST_INDEX_DIST_MATRIX_HPP_
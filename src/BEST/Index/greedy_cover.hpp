@@ -0,0 +1,162 @@
+#ifndef BEST_INDEX_GREEDY_COVER_HPP_
+#define BEST_INDEX_GREEDY_COVER_HPP_
+
+#include <vector>
+#include <set>
+#include <queue>
+#include <thread>
+#include <cstdint>
+#include <cstddef>
+#include <bit>
+
+#include "single_threaded.hpp"
+#include "../../utils/hybrid_posting.hpp"
+
+namespace best_index {
+
+/**
+ * State of the greedy gram selection over one job, kept up to date as grams
+ *   join the index instead of being recomputed from scratch at every step.
+ *   (q_k, r_j) is covered by g iff g \in Q-G-list[q_k] and g not in r_j;
+ *   benefit[g] counts the pairs g would newly cover.
+ * Everything about records is a bitset over R_c (by position in rc):
+ *   uncovered_ holds, per query, the records not covered yet, and the G-R-list
+ *   is kept as hybrid bitmaps, so covering the pairs of g is an ANDNOT and
+ *   the benefit lost by another gram is an AND + popcount. Adding g to the
+ *   index only touches the queries containing g, and only the benefit of
+ *   the grams of those queries.
+ */
+class GreedyCover {
+ public:
+    GreedyCover(const SingleThreadedIndex::job & job, size_t candidates_size)
+      : k_job_(job),
+        num_words_((job.rc.size() + 63) / 64),
+        gr_bits_(candidates_size),
+        gq_(candidates_size),
+        benefit_(candidates_size, 0),
+        selected_(candidates_size, false) {
+        // G-R-list by position in R_c; gr_list[g] is a sorted subset of rc
+        std::vector<size_t> pos;
+        for (size_t g = 0; g < job.gr_list.size() && g < candidates_size; g++) {
+            pos.clear();
+            size_t p = 0;
+            for (auto r : job.gr_list[g]) {
+                while (job.rc[p] < r) p++;
+                pos.push_back(p);
+            }
+            gr_bits_[g] = HybridPostingList(pos);
+        }
+        for (size_t k = 0; k < job.num_queries(); k++) {
+            for (auto it = job.qg_begin(k); it != job.qg_end(k); ++it) {
+                gq_[*it].push_back(k);
+                // every pair (q_k, r) is uncovered so far
+                benefit_[*it] += job.rc.size() - gr_bits_[*it].size();
+            }
+        }
+        uncovered_.assign(job.num_queries() * num_words_, ~uint64_t(0));
+        if (job.rc.size() % 64) {
+            uint64_t last = (uint64_t(1) << (job.rc.size() % 64)) - 1;
+            for (size_t k = 0; k < job.num_queries(); k++) {
+                uncovered_[(k + 1) * num_words_ - 1] = last;
+            }
+        }
+    }
+
+    uint64_t benefit(size_t g) const { return benefit_[g]; }
+
+    // I = I union {g}: mark the pairs g covers and take them off the benefit
+    //   of the other grams of the same queries
+    void select(size_t g) {
+        selected_[g] = true;
+        benefit_[g] = 0;
+        if (gq_[g].empty()) return;
+
+        in_g_.assign(num_words_, 0);
+        gr_bits_[g].set_bits(in_g_.data(), num_words_);
+
+        newly_.resize(num_words_);
+        for (auto k : gq_[g]) {
+            // newly covered: uncovered records of q_k that do not contain g
+            uint64_t * uncovered = &uncovered_[k * num_words_];
+            uint64_t num_newly = 0;
+            for (size_t w = 0; w < num_words_; w++) {
+                newly_[w] = uncovered[w] & ~in_g_[w];
+                uncovered[w] &= in_g_[w];
+                num_newly += std::popcount(newly_[w]);
+            }
+            if (!num_newly) continue;
+
+            for (auto it = k_job_.qg_begin(k); it != k_job_.qg_end(k); ++it) {
+                if (selected_[*it]) continue;
+                // other had benefit on the newly covered records it is not in
+                benefit_[*it] -= num_newly - gr_bits_[*it].count_in(newly_.data(), num_words_);
+            }
+        }
+    }
+
+ private:
+    const SingleThreadedIndex::job & k_job_;
+    const size_t num_words_;
+    std::vector<HybridPostingList> gr_bits_;
+    std::vector<std::vector<size_t>> gq_;   // queries whose Q-G-list has g
+    std::vector<uint64_t> benefit_;
+    std::vector<bool> selected_;
+    std::vector<uint64_t> uncovered_;       // query k: words [k*num_words_, (k+1)*num_words_)
+    std::vector<uint64_t> in_g_, newly_;    // scratch bitsets over R_c
+};
+
+/**
+ * Greedy loop of Algorithm 3 (one job) and Algorithm 4 (benefit summed over
+ *   jobs): add the gram of max benefit, the lowest idx on ties, until no gram
+ *   has benefit or max_keys are selected. Benefits only decrease, so a lazy
+ *   max-heap re-checks the top entry against its current benefit instead of
+ *   scanning all candidates at every step.
+ */
+inline std::set<size_t> greedy_select(std::vector<GreedyCover> & covers,
+        size_t candidates_size, size_t max_keys) {
+    auto global_benefit = [&](size_t g) {
+        uint64_t b = 0;
+        for (const auto & c : covers) b += c.benefit(g);
+        return b;
+    };
+
+    // (benefit, g), largest benefit first and then smallest g
+    using entry = std::pair<uint64_t, size_t>;
+    auto cmp = [](const entry & l, const entry & r) {
+        return l.first != r.first ? l.first < r.first : l.second > r.second;
+    };
+    std::priority_queue<entry, std::vector<entry>, decltype(cmp)> heap(cmp);
+    for (size_t g = 0; g < candidates_size; g++) {
+        auto b = global_benefit(g);
+        if (b > 0) heap.push({b, g});
+    }
+
+    std::set<size_t> index;
+    while (index.size() < max_keys && !heap.empty()) {
+        auto [b, g] = heap.top();
+        heap.pop();
+        auto curr = global_benefit(g);
+        if (curr != b) {
+            // stale entry; curr < b
+            if (curr > 0) heap.push({curr, g});
+            continue;
+        }
+        index.insert(g);
+        if (covers.size() == 1) {
+            covers[0].select(g);
+        } else {
+            std::vector<std::thread> threads;
+            for (auto & c : covers) {
+                threads.push_back(std::thread([&c, g]() { c.select(g); }));
+            }
+            for (auto & th : threads) {
+                th.join();
+            }
+        }
+    }
+    return index;
+}
+
+} // namespace best_index
+
+#endif // BEST_INDEX_GREEDY_COVER_HPP_
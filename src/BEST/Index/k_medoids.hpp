@@ -0,0 +1,209 @@
+#ifndef BEST_INDEX_K_MEDOIDS_HPP_
+#define BEST_INDEX_K_MEDOIDS_HPP_
+
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <random>
+#include <ranges>
+#include <thread>
+#include <atomic>
+#include <limits>
+#include <algorithm>
+#include <numeric>
+#include <cstddef>
+
+#include "dist_matrix.hpp"
+
+/**
+ * k-medoids clustering of queries for workload reduction and job
+ *   partitioning. Points are 0..n-1 and dist(a, b) gives their distance,
+ *   so the full |Q| x |Q| matrix is only needed by callers that choose to
+ *   back dist with one. Assignment and medoid updates run on num_threads
+ *   threads; all randomness comes from the rng passed in, so a seeded rng
+ *   gives the same clusters on every run.
+ */
+namespace best_index {
+
+// call f(i) for i in [0, n) on num_threads threads, handing out one i at a time
+template<class F>
+void parallel_for_each(size_t n, size_t num_threads, F && f) {
+    num_threads = std::min(std::max<size_t>(1, num_threads), std::max<size_t>(1, n));
+    std::atomic<size_t> next{0};
+    auto work = [&]() {
+        for (size_t i = next++; i < n; i = next++) f(i);
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < num_threads; t++) {
+        threads.push_back(std::thread(work));
+    }
+    work();
+    for (auto & th : threads) {
+        th.join();
+    }
+}
+
+// closest[p] = position in medoids of the closest medoid of p (the first
+//   one on ties); returns the sum of the distances to them
+template<class Dist>
+double assign_to_medoids(size_t n, const std::vector<size_t> & medoids, Dist && dist,
+                         std::vector<size_t> & closest, size_t num_threads) {
+    closest.resize(n);
+    std::vector<double> min_dist(n);
+    parallel_for_each(n, num_threads, [&](size_t p) {
+        size_t best = 0;
+        double best_dist = std::numeric_limits<double>::infinity();
+        for (size_t c = 0; c < medoids.size(); c++) {
+            double d = dist(p, medoids[c]);
+            if (d < best_dist) {
+                best_dist = d;
+                best = c;
+            }
+        }
+        closest[p] = best;
+        min_dist[p] = best_dist;
+    });
+    double cost = 0;
+    for (auto d : min_dist) cost += d;
+    return cost;
+}
+
+/**
+ * Voronoi iteration: start from k random medoids, assign every point to its
+ *   closest medoid, move each medoid to the member with the least distance
+ *   sum to its cluster, and repeat until no assignment changes or after
+ *   max_iteration rounds; an emptied cluster restarts from a random point
+ *   that is not a medoid.
+ * Returns medoid -> members, as assigned in the last round.
+ */
+template<class Dist>
+std::unordered_map<size_t, std::vector<size_t>> voronoi_k_medoids(
+        size_t n, size_t k, Dist && dist, std::mt19937 & rng,
+        long max_iteration, size_t num_threads) {
+    std::vector<size_t> points(n);
+    std::iota(points.begin(), points.end(), 0);
+    std::vector<size_t> medoids(k);
+    std::ranges::sample(points, medoids.begin(), k, rng);
+
+    std::vector<size_t> closest;
+    std::vector<size_t> closest_medoid(n, SIZE_MAX);
+    std::vector<std::vector<size_t>> clusters(k);
+    bool converged = false;
+    long curr_it = 0;
+    while (!converged && curr_it++ < std::max(1L, max_iteration)) {
+        // 1. assign points to the nearest medoids
+        assign_to_medoids(n, medoids, dist, closest, num_threads);
+        converged = true;
+        for (auto & members : clusters) members.clear();
+        for (size_t p = 0; p < n; p++) {
+            if (closest_medoid[p] != medoids[closest[p]]) {
+                converged = false;
+                closest_medoid[p] = medoids[closest[p]];
+            }
+            clusters[closest[p]].push_back(p);
+        }
+        if (converged) break;
+
+        // 2. move each medoid to the member closest to the rest of its cluster
+        std::vector<size_t> new_medoids(medoids);
+        parallel_for_each(k, num_threads, [&](size_t c) {
+            const auto & members = clusters[c];
+            if (members.empty()) {
+                new_medoids[c] = SIZE_MAX;
+                return;
+            }
+            double best_sum = std::numeric_limits<double>::infinity();
+            for (auto p : members) {
+                double sum = 0;
+                for (auto o : members) sum += dist(p, o);
+                if (sum < best_sum) {
+                    best_sum = sum;
+                    new_medoids[c] = p;
+                }
+            }
+        });
+
+        // 3. empty cluster, choose a random non-medoid point
+        std::set<size_t> medoid_set(new_medoids.begin(), new_medoids.end());
+        medoid_set.erase(SIZE_MAX);
+        for (auto & m : new_medoids) {
+            if (m != SIZE_MAX) continue;
+            std::uniform_int_distribution<size_t> uni_rand(0, n - 1);
+            size_t p = uni_rand(rng);
+            while (medoid_set.contains(p)) p = (p + 1) % n;
+            m = p;
+            medoid_set.insert(p);
+        }
+        medoids.swap(new_medoids);
+    }
+
+    std::unordered_map<size_t, std::vector<size_t>> cmap;
+    for (size_t p = 0; p < n; p++) {
+        cmap[closest_medoid[p]].push_back(p);
+    }
+    return cmap;
+}
+
+/**
+ * CLARA: run voronoi_k_medoids on num_samples random samples of
+ *   sample_size points, each sample holding the best medoids found so far,
+ *   assign all n points to the medoids of every sample and keep the ones
+ *   with the least total distance. Needs sample_size^2 + n*k distances
+ *   per sample instead of n^2.
+ */
+template<class Dist>
+std::unordered_map<size_t, std::vector<size_t>> clara_k_medoids(
+        size_t n, size_t k, size_t sample_size, size_t num_samples,
+        Dist && dist, std::mt19937 & rng, long max_iteration, size_t num_threads) {
+    sample_size = std::min(n, std::max(sample_size, k));
+    std::vector<size_t> best_medoids;
+    std::vector<size_t> best_closest;
+    double best_cost = std::numeric_limits<double>::infinity();
+
+    std::vector<size_t> closest;
+    for (size_t s = 0; s < std::max<size_t>(1, num_samples); s++) {
+        std::vector<size_t> sample(best_medoids);
+        std::vector<bool> in_sample(n, false);
+        for (auto p : sample) in_sample[p] = true;
+        std::vector<size_t> rest;
+        rest.reserve(n - sample.size());
+        for (size_t p = 0; p < n; p++) {
+            if (!in_sample[p]) rest.push_back(p);
+        }
+        size_t num_drawn = sample_size - sample.size();
+        sample.resize(sample_size);
+        std::ranges::sample(rest, sample.end() - num_drawn, num_drawn, rng);
+
+        DistMatrix sample_mtx(sample_size);
+        parallel_for_each(sample_size, num_threads, [&](size_t i) {
+            for (size_t j = 0; j < sample_size; j++) {
+                sample_mtx[i][j] = dist(sample[i], sample[j]);
+            }
+        });
+        auto sample_cmap = voronoi_k_medoids(sample_size, k,
+            [&](size_t a, size_t b) { return sample_mtx[a][b]; },
+            rng, max_iteration, num_threads);
+
+        std::vector<size_t> medoids;
+        for (const auto & [m, members] : sample_cmap) {
+            medoids.push_back(sample[m]);
+        }
+        std::sort(medoids.begin(), medoids.end());
+        double cost = assign_to_medoids(n, medoids, dist, closest, num_threads);
+        if (cost < best_cost) {
+            best_cost = cost;
+            best_medoids.swap(medoids);
+            best_closest.swap(closest);
+        }
+    }
+
+    std::unordered_map<size_t, std::vector<size_t>> cmap;
+    for (size_t p = 0; p < n; p++) {
+        cmap[best_medoids[best_closest[p]]].push_back(p);
+    }
+    return cmap;
+}
+
+} // namespace best_index
+
+#endif // BEST_INDEX_K_MEDOIDS_HPP_
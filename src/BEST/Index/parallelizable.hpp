@@ -14,7 +14,7 @@ class ParallelizableIndex : public SingleThreadedIndex {
     ParallelizableIndex() = delete;
     ParallelizableIndex(const ParallelizableIndex &&) = delete;
     
-    ParallelizableIndex(const std::vector<std::string> & dataset, 
+    ParallelizableIndex(const Dataset & dataset, 
                const std::vector<std::string> & queries, 
                double sel_threshold, int num_threads)
       : SingleThreadedIndex(dataset, queries, sel_threshold) {
@@ -22,7 +22,7 @@ class ParallelizableIndex : public SingleThreadedIndex {
             thread_count_ = std::max(2, num_threads);
         }
     
-    ParallelizableIndex(const std::vector<std::string> & dataset, 
+    ParallelizableIndex(const Dataset & dataset, 
                const std::vector<std::string> & queries, 
                double sel_threshold, int num_threads, 
                long workload_reduced_size,
@@ -37,7 +37,7 @@ class ParallelizableIndex : public SingleThreadedIndex {
  private:
     void select_grams(int upper_n=-1) override;
 
-    void build_qg_list_local(std::vector<std::set<size_t>> & qg_list,
+    void build_qg_list_local(best_index::SingleThreadedIndex::job & job,
         const std::vector<std::string> & candidates, 
         const std::vector<std::vector<std::string>> & query_literals,
         const std::vector<size_t> & q_list);
@@ -46,9 +46,6 @@ class ParallelizableIndex : public SingleThreadedIndex {
         const std::vector<std::string> & candidates, 
         const std::vector<std::vector<std::string>> & query_literals,
         const std::vector<size_t> q_list);
-
-    bool multi_all_covered(const std::set<size_t> & index, 
-        const std::vector<best_index::SingleThreadedIndex::job> & jobs);
 };
 
 } // namespace best_index
@@ -2,8 +2,11 @@
 #include <random>
 #include <ranges>
 #include <stdexcept>
+#include <thread>
 
 #include "single_threaded.hpp"
+#include "greedy_cover.hpp"
+#include "k_medoids.hpp"
 #include "../../utils/utils.hpp"
 
 // #include "../../utils/trie.hpp"
@@ -36,174 +39,59 @@ std::vector<std::string> generate_path_labels(rax * const gram_tree) {
     return path_labels;
 }
 
-std::set<std::string> diff_union(const std::set<std::string> & q1_grams, 
-                                   const std::set<std::string> & q2_grams) {
-    // Calcuate G_n = (G_1 - G_2) \union (G_2 - G_1)
-    std::set<std::string> result;
-    std::set_difference(q1_grams.begin(), q1_grams.end(), 
-                        q2_grams.begin(), q2_grams.end(),
-                        std::inserter(result, result.end()));
-    std::set_difference(q2_grams.begin(), q2_grams.end(), 
-                        q1_grams.begin(), q1_grams.end(),
-                        std::inserter(result, result.end())); 
-    return result;   
-}   
-
-std::set<std::string> intersect(const std::set<std::string> & q1_grams, 
-                                   const std::set<std::string> & q2_grams) {
-    // Calcuate G_d = G_1 \intersect G_2
-    std::set<std::string> result;
-    std::set_intersection(q1_grams.begin(), q1_grams.end(), 
-                          q2_grams.begin(), q2_grams.end(),
-                          std::inserter(result, result.end()));
-    return result;   
-} 
-
-size_t cardinality_not_in(const std::set<std::string> & g_set, 
-                                const std::map<std::string, size_t> & pre_suf_count) {
-    size_t g_cadinality_sum = 0;
-    for (const auto & g : g_set) {
-        g_cadinality_sum += pre_suf_count.at(g);
-    }
-    return g_cadinality_sum;
-}
-
-double max_dev_dist1(const std::set<std::string> & q1_grams, 
-                     const std::set<std::string> & q2_grams,
-                     const std::map<std::string, size_t> & pre_suf_count) {
-    std::set<std::string> gn_set = diff_union(q1_grams, q2_grams);
-    size_t gn_cadinality_sum = cardinality_not_in(gn_set, pre_suf_count);
-
-    std::set<std::string> gd_set = intersect(q1_grams, q2_grams);
-    size_t gd_cadinality_sum = 1 + cardinality_not_in(gd_set, pre_suf_count);
-
-    return double( ((long double)gn_cadinality_sum)/((long double)gd_cadinality_sum) );
+/**
+ * MaxDevDist between two queries from cardinality sums, where G_1, G_2 are
+ *   their gram sets, G_n = (G_1 - G_2) \union (G_2 - G_1), G_d = G_1 \intersect G_2
+ *   and |X| is the sum of the cardinalities of the grams in X:
+ *   |G_n| = |G_1| + |G_2| - 2|G_d|
+ */
+double max_dev_dist1(size_t g1_sum, size_t g2_sum, size_t gd_sum) {
+    size_t gn_cadinality_sum = g1_sum + g2_sum - 2 * gd_sum;
+    return double( ((long double)gn_cadinality_sum)/((long double)(1 + gd_sum)) );
 }
 
-double max_dev_dist2(const std::set<std::string> & q1_grams, 
-                     const std::set<std::string> & q2_grams,
-                     const std::map<std::string, size_t> & pre_suf_count) {
-    std::set<std::string> gn_set = diff_union(q1_grams, q2_grams);
-    size_t gn_cadinality_sum = cardinality_not_in(gn_set, pre_suf_count);
-    size_t gd_cadinality_sum = 1 + cardinality_not_in(q2_grams, pre_suf_count);
-
-    return double( ((long double)gn_cadinality_sum)/((long double)gd_cadinality_sum) );
+double max_dev_dist2(size_t g1_sum, size_t g2_sum, size_t gd_sum) {
+    size_t gn_cadinality_sum = g1_sum + g2_sum - 2 * gd_sum;
+    return double( ((long double)gn_cadinality_sum)/((long double)(1 + g2_sum)) );
 }
 
-double max_dev_dist3(const std::set<std::string> & q1_grams, 
-                     const std::set<std::string> & q2_grams,
-                     const std::map<std::string, size_t> & pre_suf_count) {
-    std::set<std::string> gn_set = diff_union(q1_grams, q2_grams);
-    return (double)cardinality_not_in(gn_set, pre_suf_count);
+double max_dev_dist3(size_t g1_sum, size_t g2_sum, size_t gd_sum) {
+    return (double)(g1_sum + g2_sum - 2 * gd_sum);
 }
 
-size_t argmin(const std::vector<double> & v) {
-    return std::distance(std::begin(v), 
-                         std::min_element(std::begin(v), std::end(v)));
+std::mt19937 best_index::SingleThreadedIndex::make_rng() const {
+    if (random_seed_ >= 0) {
+        return std::mt19937(random_seed_);
+    }
+    return std::mt19937{std::random_device{}()};
 }
 
+// Voronoi iteration k-medoids over the full distance matrix
 std::unordered_map<size_t, std::vector<size_t>> 
 best_index::SingleThreadedIndex::k_medians(
-        const std::vector<std::vector<double>> & dist_mtx, 
+        const best_index::DistMatrix & dist_mtx, 
         int num_queries, int num_clusters) {
+    auto rng = make_rng();
+    return best_index::voronoi_k_medoids(num_queries, num_clusters, 
+        [&](size_t a, size_t b) { return dist_mtx[a][b]; }, 
+        rng, max_iteration_, thread_count_);
+}
 
-    // 1. randomly pick k queries as centroids
-    std::vector<int> centroids;
-    // Note: random sample function from here: https://stackoverflow.com/a/73133364
-    //       does it perform better than pre-buidling the 0-k_query_size_ array?
-    centroids.resize(num_clusters);
-    std::ranges::sample(std::views::iota(0, num_queries), centroids.begin(), 
-                        num_clusters, std::mt19937{std::random_device{}()}); 
-
-    // c_dists: index [idx of centroid in centroids] 
-    //          value [distance from current node to the centroid]
-    std::vector<double> c_dists(num_clusters);
-    // closest_c_idxs: index [idx of a query] 
-    //                 value [current query idx of closet centroid in centroids]
-    std::vector<int> closest_c_idxs(num_queries, -1);
-    
-    // cmap: key [query idx centroid in centroids] 
-    //       value [list of query idx]
-    std::unordered_map<size_t, std::vector<size_t>> cmap;
-
-    bool centroid_final = false;
-
-    size_t curr_it = 0;
-    while(!centroid_final && curr_it++ < max_iteration_) {
-        centroid_final = true;
-        // 2. assign data points to nearest centroids
-        std::unordered_map<size_t, std::vector<size_t>>().swap(cmap);
-        cmap.reserve(num_clusters);
-        // q_dists: index [idx of a query] 
-        //          value [distance to the current query]
-        for (size_t q_idx = 0; q_idx < num_queries; q_idx++) {
-            auto q_dists = dist_mtx[q_idx];
-            for (size_t i = 0; i < num_clusters; i++) {
-                c_dists[i] = q_dists[centroids[i]];
-            }
-            // curr_closest: [idx of closet centroid in centroids] 
-            auto curr_closest = centroids[argmin(c_dists)];
-            if (closest_c_idxs[q_idx] != curr_closest) {
-                centroid_final = false;
-                closest_c_idxs[q_idx] = curr_closest;
-            }
-            cmap[curr_closest].push_back(q_idx);
-        }
-
-        std::vector<size_t> fillables;
-        // 3. compute the new median as centroids for each cluster
-        for (size_t c_idx = 0; c_idx < num_clusters; c_idx++) {
-            auto q_idxs = cmap[centroids[c_idx]];
-            if (q_idxs.empty()) {
-                fillables.push_back(c_idx);
-                centroids[c_idx] = -1;
-            } else {
-                std::vector<double> dist_sums(q_idxs.size(), 0);
-                for (size_t i = 0; i < q_idxs.size(); i++) {
-                    for (size_t j = 0; j < q_idxs.size(); j++) {
-                        // dist_sums[i] += dist_mtx[i][j];
-                        dist_sums[i] += dist_mtx[q_idxs[i]][q_idxs[j]];
-                    }
-                }
-                auto curr_c = argmin(dist_sums);
-                centroids[c_idx] = q_idxs[curr_c];
-            }
-        }
-        //3.5 empty cluster, choose a random centroid
-        std::set<size_t> centroids_set(centroids.begin(), centroids.end());
-
-        if (centroids_set.size() * 10 > num_queries) {
-            std::vector<size_t> non_centroids;
-            for (size_t i = 0; i < num_queries; i++) {
-                if (!centroids_set.count(i)) non_centroids.push_back(i);
-            }
-
-            for (const auto & c_idx : fillables) {
-                std::uniform_int_distribution<int> uni_rand_int(0, non_centroids.size()-1);
-                auto rng = std::mt19937{std::random_device{}()};
-                int curr_rand = uni_rand_int(rng);
-                if (!non_centroids.empty()) {
-                    curr_rand = non_centroids[curr_rand];
-                    // Remove selected from non_centroids to avoid duplicates
-                    non_centroids.erase(std::remove(non_centroids.begin(), non_centroids.end(), curr_rand), non_centroids.end());
-                }
-                centroids[c_idx] = curr_rand;
-                centroids_set.insert(curr_rand);
-            }
-        } else {
-            for (const auto & c_idx : fillables) {
-                std::uniform_int_distribution<int> uni_rand_int(0, num_queries-1);
-                auto rng = std::mt19937{std::random_device{}()};
-                int curr_rand = uni_rand_int(rng);
-                while(centroids_set.contains(curr_rand)) {
-                    curr_rand = uni_rand_int(rng);
-                }
-                centroids[c_idx] = curr_rand;
-                centroids_set.insert(curr_rand);
-            }
-        }
+// k_medians on the full distance matrix, or CLARA on samples of the
+//   queries if a sample size smaller than the workload is set
+std::unordered_map<size_t, std::vector<size_t>> 
+best_index::SingleThreadedIndex::cluster_queries(
+        const best_index::QueryDistance & dist, size_t num_clusters) {
+    size_t num_queries = dist.size();
+    if (clustering_sample_size_ == 0 || 
+        std::max(clustering_sample_size_, num_clusters) >= num_queries) {
+        auto dist_mtx = calculate_pairwise_dist(dist);
+        return k_medians(dist_mtx, num_queries, num_clusters);
     }
-    return cmap;
+    auto rng = make_rng();
+    return best_index::clara_k_medoids(num_queries, num_clusters, 
+        clustering_sample_size_, clustering_num_samples_, dist, 
+        rng, max_iteration_, thread_count_);
 }
 
 std::vector<std::set<std::string>> 
@@ -224,14 +112,12 @@ best_index::SingleThreadedIndex::get_all_multigrams_per_query(
     return qg_gram_set;
 }
 
-std::vector<std::vector<double>> 
-best_index::SingleThreadedIndex::calculate_pairwise_dist(
+best_index::QueryDistance
+best_index::SingleThreadedIndex::query_distance(
         const std::vector<std::set<std::string>> & qg_gram_set,
         const std::map<std::string, size_t> & pre_suf_count) {
 
-    double (*max_dev_dist)(const std::set<std::string> &, 
-        const std::set<std::string> &,
-        const std::map<std::string, size_t> &){ nullptr };
+    best_index::QueryDistance::measure_type max_dev_dist{ nullptr };
     switch (dist_measure_type_) {
         case dist_type::kMaxDevDist1:
             max_dev_dist = &max_dev_dist1;
@@ -245,20 +131,35 @@ best_index::SingleThreadedIndex::calculate_pairwise_dist(
         default:
             throw std::invalid_argument( "Invalid MaxDevDist function type" );
     }
+    return best_index::QueryDistance(qg_gram_set, pre_suf_count, max_dev_dist);
+}
 
-    // compute pairwise distance in 2d matrix
-    std::vector<std::vector<double>> dist_mtx;
-    auto query_size = qg_gram_set.size();
-    dist_mtx.assign(query_size, std::vector<double>(query_size));
-    for (size_t i = 0; i < query_size; i++) {
-        for (size_t j = 0; j < query_size; j++) {
-            if (i > j) {
-                dist_mtx[i][j] = dist_mtx[j][i];
-            } else {
-                dist_mtx[i][j] = max_dev_dist(qg_gram_set[i], qg_gram_set[j], pre_suf_count);
-            }
+best_index::DistMatrix
+best_index::SingleThreadedIndex::calculate_pairwise_dist(
+        const best_index::QueryDistance & dist) {
+    // compute the upper triangle in tiles of rows x columns, handed out
+    //   to the threads one at a time, and mirror it
+    constexpr size_t kTile = 64;
+    auto query_size = dist.size();
+    size_t num_tiles = (query_size + kTile - 1) / kTile;
+    std::vector<std::pair<size_t, size_t>> tiles;
+    for (size_t ti = 0; ti < num_tiles; ti++) {
+        for (size_t tj = ti; tj < num_tiles; tj++) {
+            tiles.emplace_back(ti, tj);
         }
     }
+
+    best_index::DistMatrix dist_mtx(query_size);
+    best_index::parallel_for_each(tiles.size(), thread_count_, [&](size_t t) {
+        auto [ti, tj] = tiles[t];
+        for (size_t i = ti * kTile; i < std::min((ti + 1) * kTile, query_size); i++) {
+            for (size_t j = std::max(i, tj * kTile); 
+                 j < std::min((tj + 1) * kTile, query_size); j++) {
+                dist_mtx[i][j] = dist(i, j);
+                dist_mtx[j][i] = dist_mtx[i][j];
+            }
+        }
+    });
     return dist_mtx;
 }
 
@@ -273,10 +174,10 @@ void best_index::SingleThreadedIndex::workload_reduction(
         std::map<std::string, size_t> & pre_suf_count) {
     auto qg_gram_set = get_all_multigrams_per_query(query_literals);
     
-    auto dist_mtx = calculate_pairwise_dist(qg_gram_set, pre_suf_count);
+    auto dist = query_distance(qg_gram_set, pre_suf_count);
 
     // use k-median centroids as the representative query subset
-    auto centroids = k_medians(dist_mtx, k_queries_size_, k_reduced_queries_size_);
+    auto centroids = cluster_queries(dist, k_reduced_queries_size_);
 
     std::vector<std::vector<std::string>> new_query_literals(centroids.size());
     std::map<std::string, size_t> new_pre_suf_count;
@@ -322,23 +223,45 @@ best_index::SingleThreadedIndex::get_all_gram_counts(
     }
 
     // 4 iterate once on the dataset and 
-    //   count the number of occurrance of each multigram
-    // Note:
-    // intially I thought of doing: once count > threshold count, then erase the key
-    for (const auto & line : k_dataset_) {
-        for (size_t i = 0; i < line.size(); i++) {
-            auto curr_c = line.at(i);
-            std::string curr_key = line.substr(i,1);
-            auto lower_it = pre_suf_count.lower_bound(curr_key);
-
-            for (auto & it = lower_it; it != pre_suf_count.end() && curr_key.at(0) == curr_c; ++it) {
-                // check if the current key is the same with curren substr
-                curr_key = it->first;
-                if (curr_key == line.substr(i, curr_key.size())) {
-                    pre_suf_count[curr_key]++;
-                }
-            }
+    //   count the number of records containing each multigram
+    // Note: an Aho-Corasick automaton over all multigrams finds them in
+    //       one pass over each record; ranges of records are counted in
+    //       parallel, each thread with its own counts, then summed
+    std::vector<std::string> grams;
+    grams.reserve(pre_suf_count.size());
+    for (const auto & [gram, count] : pre_suf_count) {
+        grams.push_back(gram);
+    }
+    KeyAutomaton automaton;
+    automaton.build(grams.begin(), grams.end());
+
+    size_t num_threads = std::min<size_t>(std::max(1, thread_count_), std::max<size_t>(1, k_dataset_size_));
+    std::vector<std::vector<size_t>> counts(num_threads);
+    auto count_range = [&](size_t t, size_t begin, size_t end) {
+        counts[t].assign(grams.size(), 0);
+        std::vector<size_t> last_seen(grams.size(), SIZE_MAX);
+        for (size_t r_idx = begin; r_idx < end; r_idx++) {
+            automaton.for_each_new_key(k_dataset_[r_idx], last_seen, r_idx,
+                [&](uint32_t g_idx) { counts[t][g_idx]++; });
         }
+    };
+    std::vector<std::thread> threads;
+    size_t range_size = (k_dataset_size_ + num_threads - 1) / num_threads;
+    for (size_t t = 1; t < num_threads; t++) {
+        threads.push_back(std::thread(count_range, t, std::min(t * range_size, k_dataset_size_),
+                                      std::min((t + 1) * range_size, k_dataset_size_)));
+    }
+    count_range(0, 0, std::min(range_size, k_dataset_size_));
+    for (auto & th : threads) {
+        th.join();
+    }
+
+    size_t g_idx = 0;
+    for (auto & [gram, count] : pre_suf_count) {
+        for (const auto & c : counts) {
+            count += c[g_idx];
+        }
+        g_idx++;
     }
 
     return pre_suf_count;
@@ -386,14 +309,14 @@ std::vector<std::string> best_index::SingleThreadedIndex::candidate_gram_set_gen
 }
 
 void best_index::SingleThreadedIndex::indexed_grams_in_string(
-        const std::string & l, 
+        std::string_view l, 
         const std::vector<std::string> & candidates,
         std::vector<std::set<size_t>> & qg_list, 
         size_t q_idx, const std::vector<bool> & candidates_filter) {
 
     for (size_t i = 0; i < l.size(); i++) {
         auto curr_c = l.at(i);
-        std::string curr_key = l.substr(i,1);
+        std::string curr_key(l.substr(i,1));
         auto lower_it = std::lower_bound(candidates.cbegin(), candidates.cend(), curr_key);
         for (auto & it = lower_it; it != candidates.cend() && curr_key.at(0) == curr_c; ++it) {
             // check if the current key is the same with curren substr
@@ -418,96 +341,49 @@ void best_index::SingleThreadedIndex::indexed_grams_in_literals(
     }
 }
 
-bool best_index::SingleThreadedIndex::index_covered(
-        const std::set<size_t> & index, 
-        const best_index::SingleThreadedIndex::job & job,
-        size_t r_j, size_t q_k) {
-    for (auto g_idx : index) {
-        // the pair (q_k, r_j) is covered by current g iff
-        // r_j not in G-R-list[g] AND g in Q-G-list[q_k]
-        if (!sorted_list_contains(job.gr_list[g_idx], r_j) &&
-            job.qg_list[q_k].find(g_idx) != job.qg_list[q_k].cend()) {
-        
-            return true;
-        }
-    }
-    return false;
-}
-
-// TODO: to speed up, it is possible to store all covered pairs
-bool best_index::SingleThreadedIndex::all_covered(
-        const std::set<size_t> & index, 
-        const best_index::SingleThreadedIndex::job & job, 
-        size_t query_size) {
-    for (size_t k = 0; k < query_size; k++) {
-        for (auto j : job.rc) {
-            if (!index_covered(index, job, j, k)) {
-                return false;
-            }
-        }
-    }
-    return true;
-}
-
-void best_index::SingleThreadedIndex::compute_benefit(
-        std::vector<long double> & benefit, 
-        const std::set<size_t> & index, 
-        const best_index::SingleThreadedIndex::job & job, 
-        size_t num_queries) {
-    
-    std::fill(benefit.begin(), benefit.end(), 0);
-
-    // for every query q \in Q
-    for (size_t k = 0; k < num_queries; k++) {
-        // for every record r in R_c
-        for (auto j : job.rc) {
-            // for each gram g \in Q-G-list[q_k]\I
-            for (auto g_idx : job.qg_list[k]) {
-                // ... and if 1. g not in r_j 
-                //        AND 2. (q_k, r_j) not covered by any g \in I
-                if (index.find(g_idx) == index.cend() &&
-                    !sorted_list_contains(job.gr_list[g_idx], j) &&
-                    (!index_covered(index, job, j, k)) ) {
-                    
-                    benefit[g_idx]++;
-                }
-            }
-        }
+void best_index::SingleThreadedIndex::flatten_qg_list(
+        best_index::SingleThreadedIndex::job & job,
+        const std::vector<std::set<size_t>> & qg_list) {
+    job.qg_offsets.assign(1, 0);
+    job.qg_grams.clear();
+    for (const auto & g_list : qg_list) {
+        job.qg_grams.insert(job.qg_grams.end(), g_list.begin(), g_list.end());
+        job.qg_offsets.push_back(job.qg_grams.size());
     }
 }
 
 void best_index::SingleThreadedIndex::build_qg_list(
-        std::vector<std::set<size_t>> & qg_list,
+        best_index::SingleThreadedIndex::job & job,
         const std::vector<std::string> & candidates, 
         const std::vector<std::vector<std::string>> & query_literals) {
     auto num_queries = query_literals.size();
-    qg_list.assign(num_queries, std::set<size_t>());
+    std::vector<std::set<size_t>> qg_list(num_queries);
     for (size_t q_idx = 0; q_idx < num_queries; q_idx++) {
         const auto & literals = query_literals[q_idx];
         indexed_grams_in_literals(literals, candidates, qg_list, q_idx);
     }
+    flatten_qg_list(job, qg_list);
 }
 
-void build_gr_list_rc_helper(best_index::SingleThreadedIndex::job & job, 
-        size_t set_idx, size_t r_idx, 
-        const std::vector<std::set<size_t>> & rg_list) {
-    const std::set<size_t> & set_of_exists_grams = rg_list[set_idx];
-    if (!set_of_exists_grams.empty()) {
-        job.rc.push_back(r_idx);
-    }
-    for (size_t g_idx : set_of_exists_grams) {
-        job.gr_list[g_idx].push_back(r_idx);
-    }
-}
-
+// Scan the dataset once, appending each record to the G-R-list of
+//   the grams it contains as soon as they are found; only the grams
+//   of the current record are held, not an R-G-list of the dataset
 void best_index::SingleThreadedIndex::build_gr_list_rc(
         best_index::SingleThreadedIndex::job & job, 
-        size_t candidates_size,  
-        size_t dataset_size,
-        const std::vector<std::set<size_t>> & rg_list) {
-    job.gr_list.assign(candidates_size, std::vector<size_t>());
-    for (size_t r_idx = 0; r_idx < dataset_size; r_idx++) {
-        build_gr_list_rc_helper(job, r_idx, r_idx, rg_list);
+        const std::vector<std::string> & candidates,
+        const std::vector<bool> & candidates_filter) {
+    job.gr_list.assign(candidates.size(), std::vector<size_t>());
+    job.rc.clear();
+    std::vector<std::set<size_t>> r_grams(1);
+    for (size_t r_idx = 0; r_idx < k_dataset_size_; r_idx++) {
+        r_grams[0].clear();
+        indexed_grams_in_string(k_dataset_[r_idx], candidates, r_grams, 0, candidates_filter);
+        if (!r_grams[0].empty()) {
+            job.rc.push_back(r_idx);
+        }
+        for (size_t g_idx : r_grams[0]) {
+            job.gr_list[g_idx].push_back(r_idx);
+        }
     }
 }
 
@@ -516,12 +392,8 @@ void best_index::SingleThreadedIndex::build_job(
         const std::vector<std::string> & candidates, 
         const std::vector<std::vector<std::string>> & query_literals) {
 
-    build_qg_list(job.qg_list, candidates, query_literals);
-    std::vector<std::set<size_t>> rg_list(k_dataset_size_);
-    for (size_t i = 0; i < k_dataset_size_; i++) {
-        indexed_grams_in_string(k_dataset_[i], candidates, rg_list, i);
-    }
-    build_gr_list_rc(job, candidates.size(), k_dataset_size_, rg_list);
+    build_qg_list(job, candidates, query_literals);
+    build_gr_list_rc(job, candidates);
 }
 
 // Algorithm 3 in Figure 4
@@ -537,7 +409,6 @@ void best_index::SingleThreadedIndex::select_grams(int upper_n) {
         Example 3 and the paragraph above **/
     auto candidates = candidate_gram_set_gen(query_literals, pre_suf_count);
     size_t candidates_size = candidates.size();
-    size_t num_queries = query_literals.size();
 
     best_index::SingleThreadedIndex::job job;
     build_job(job, candidates, query_literals);
@@ -547,37 +418,16 @@ void best_index::SingleThreadedIndex::select_grams(int upper_n) {
      *     the actual string should be stored in k_index_keys_
      *     use intermediate i to reduce hash/storage overhead
      *     of string over int
+     * While some (q,r) uncovered AND space available,
+     *   I = I union {g_max} where g_max has max utility
+     * Utility = benefit/cost;
+     *      use numbre of records containing g as cost
+     *      by referring to footnote 3 and example 6 and 9
+     *      the cost is the same for every g, so g_max has max benefit
      */
-    std::set<size_t> index;
-    std::vector<long double> benefit(candidates_size);
-    // While some (q,r) uncovered AND space available
-    while (index.size() < key_upper_bound_ && !all_covered(index, job, num_queries)) {
-
-        compute_benefit(benefit, index, job, num_queries);
-
-        // if exists some g with benefit g > 0 then
-        if (std::any_of(benefit.cbegin(), benefit.cend(), [](unsigned i) { return i > 0; })) {
-            long double max_util = 0;
-            size_t max_idx = 0;
-            // for every candidate g, calculate utility g
-            for (size_t i = 0; i < candidates_size; i++) {
-                /**
-                 * Utility = benefit/cost;
-                 *      use numbre of records containing g as cost
-                 *      by referring to footnote 3 and example 6 and 9
-                 */
-                long double curr_util = benefit[i]/(candidates_size);
-                if (curr_util > max_util) {
-                    max_util = curr_util;
-                    max_idx = i;
-                }
-            }
-            // I = I union {g_max} where g_max has max utility
-            index.insert(max_idx);
-        } else {
-            break;
-        }
-    }
+    std::vector<best_index::GreedyCover> covers;
+    covers.emplace_back(job, candidates_size);
+    std::set<size_t> index = best_index::greedy_select(covers, candidates_size, key_upper_bound_);
     auto selection_time = std::chrono::duration_cast<std::chrono::duration<double>>(
         std::chrono::high_resolution_clock::now() - start).count();
     std::cout << "Select Grams End in " << selection_time << " s" << std::endl;
@@ -591,8 +441,10 @@ void best_index::SingleThreadedIndex::select_grams(int upper_n) {
     // std::map<std::string, size_t> gram_to_candidate_idx_map;
     for (auto idx : index) {
         k_index_keys_.insert(candidates[idx]);
+        k_keys_dirty_ = true;
         k_index_[candidates[idx]] = job.gr_list[idx];
     }
+    finalize_index();
 
     auto build_time = std::chrono::duration_cast<std::chrono::duration<double>>(
         std::chrono::high_resolution_clock::now() - start).count();
@@ -3,8 +3,10 @@
 
 #include <map>
 #include <unordered_map>
+#include <random>
 
 #include "../../ngram_inverted_index.hpp"
+#include "dist_matrix.hpp"
 
 namespace best_index {
 
@@ -20,30 +22,36 @@ class SingleThreadedIndex  : public NGramInvertedIndex {
  public:
 
     /**
-     * Q-G-list: vector in order of q, where each element is
-     *      set of idx of g \in candidates s.t. g \in q
+     * Q-G-list: flat array in order of q, where the grams of q_k are
+     *      qg_grams[qg_offsets[k], qg_offsets[k+1]), the ascending
+     *      idx of g \in candidates s.t. g \in q
      * G-R-list: vector in order of g, where each element is
-     *      set of idx of r \in candidates s.t. g \in r
-     *   Note: to avoid multiple scans of the dataset, 
-     *        build R-G-list first
+     *      sorted list of idx of r \in dataset s.t. g \in r
+     *   Note: built in a single scan of the dataset, one record
+     *        at a time
      * R_c: set of idx of r s.t. \exists some g \in r
      */
     struct job {
-        std::vector<std::set<size_t>> qg_list;
+        std::vector<size_t> qg_offsets{0};
+        std::vector<size_t> qg_grams;
         std::vector<std::vector<size_t>> gr_list;
         std::vector<size_t> rc;
+
+        size_t num_queries() const { return qg_offsets.size() - 1; }
+        const size_t * qg_begin(size_t k) const { return qg_grams.data() + qg_offsets[k]; }
+        const size_t * qg_end(size_t k) const { return qg_grams.data() + qg_offsets[k+1]; }
     };
 
     SingleThreadedIndex() = delete;
     SingleThreadedIndex(const SingleThreadedIndex &&) = delete;
-    SingleThreadedIndex(const std::vector<std::string> & dataset, 
+    SingleThreadedIndex(const Dataset & dataset, 
                const std::vector<std::string> & queries, 
                double sel_threshold)
       : NGramInvertedIndex(dataset, queries),
         k_threshold_(sel_threshold), 
         k_reduced_queries_size_(queries.size()) {}
     
-    SingleThreadedIndex(const std::vector<std::string> & dataset, 
+    SingleThreadedIndex(const Dataset & dataset, 
                const std::vector<std::string> & queries, 
                double sel_threshold, long workload_reduced_size,
                dist_type dist_measure_type)
@@ -59,6 +67,17 @@ class SingleThreadedIndex  : public NGramInvertedIndex {
 
     void set_max_iteration(long max_iter) { max_iteration_ = max_iter; }
 
+    // seed of query clustering; < 0 (default) seeds from std::random_device
+    void set_random_seed(long seed) { random_seed_ = seed; }
+
+    // cluster queries with CLARA on num_samples samples of sample_size
+    //   queries instead of k_medians on the full |Q| x |Q| matrix;
+    //   0 (default) always uses the full matrix
+    void set_clustering_sample(size_t sample_size, size_t num_samples=5) {
+        clustering_sample_size_ = sample_size;
+        clustering_num_samples_ = num_samples;
+    }
+
  protected:
     dist_type dist_measure_type_ = dist_type::kInvalid;
     long double k_reduced_queries_size_;
@@ -76,26 +95,23 @@ class SingleThreadedIndex  : public NGramInvertedIndex {
         const std::vector<std::vector<std::string>> & query_literals);
     
     std::unordered_map<size_t, std::vector<size_t>> k_medians(
-        const std::vector<std::vector<double>> & dist_mtx, 
+        const best_index::DistMatrix & dist_mtx, 
         int num_queries, int num_clusters);
     
     std::vector<std::set<std::string>> get_all_multigrams_per_query(
         const std::vector<std::vector<std::string>> & query_literals);
     
-    std::vector<std::vector<double>> calculate_pairwise_dist(
+    best_index::QueryDistance query_distance(
         const std::vector<std::set<std::string>> & qg_gram_set,
         const std::map<std::string, size_t> & pre_suf_count);
+
+    best_index::DistMatrix calculate_pairwise_dist(
+        const best_index::QueryDistance & dist);
+
+    std::unordered_map<size_t, std::vector<size_t>> cluster_queries(
+        const best_index::QueryDistance & dist, size_t num_clusters);
     
-    void compute_benefit(std::vector<long double> & benefit, 
-        const std::set<size_t> & index, 
-        const best_index::SingleThreadedIndex::job & job, 
-        size_t num_queries);
-    
-    bool all_covered(const std::set<size_t> & index,
-        const best_index::SingleThreadedIndex::job & job,  
-        size_t query_size);
-    
-    void indexed_grams_in_string(const std::string & l, 
+    void indexed_grams_in_string(std::string_view l, 
         const std::vector<std::string> & candidates,
         std::vector<std::set<size_t>> & g_list, 
         size_t idx,
@@ -107,9 +123,11 @@ class SingleThreadedIndex  : public NGramInvertedIndex {
         size_t idx);
     
     void build_gr_list_rc(best_index::SingleThreadedIndex::job & job, 
-        size_t candidates_size,  
-        size_t dataset_size,
-        const std::vector<std::set<size_t>> & rg_list);
+        const std::vector<std::string> & candidates,
+        const std::vector<bool> & candidates_filter=std::vector<bool>());
+
+    void flatten_qg_list(best_index::SingleThreadedIndex::job & job,
+        const std::vector<std::set<size_t>> & qg_list);
     
     /** Helpers **/
     void workload_reduction(std::vector<std::vector<std::string>> & query_literals,
@@ -117,12 +135,13 @@ class SingleThreadedIndex  : public NGramInvertedIndex {
 
  private:
     long max_iteration_ = 100;
+    long random_seed_ = -1;
+    size_t clustering_sample_size_ = 0;
+    size_t clustering_num_samples_ = 5;
 
-    bool index_covered(const std::set<size_t> & index, 
-        const best_index::SingleThreadedIndex::job & job,
-        size_t r_j, size_t q_k);
+    std::mt19937 make_rng() const;
 
-    void build_qg_list(std::vector<std::set<size_t>> & qg_list,
+    void build_qg_list(best_index::SingleThreadedIndex::job & job,
         const std::vector<std::string> & candidates, 
         const std::vector<std::vector<std::string>> & query_literals);
     
@@ -180,6 +180,7 @@ void best_btree_index::ParallelizableIndex::select_grams(int upper_n) {
     for (auto idx : index) {
         auto curr_gram = candidates[idx];
         k_index_keys_.insert(curr_gram);
+        k_keys_dirty_ = true;
         for (const auto & job : jobs) {
             if (!(k_index_[curr_gram].empty())) continue;
             k_index_[curr_gram].insert(
@@ -189,6 +190,7 @@ void best_btree_index::ParallelizableIndex::select_grams(int upper_n) {
             );
         }
     }
+    build_key_automaton();
     auto build_time = std::chrono::duration_cast<std::chrono::duration<double>>(
         std::chrono::high_resolution_clock::now() - start).count();
     
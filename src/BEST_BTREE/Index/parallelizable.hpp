@@ -14,7 +14,7 @@ class ParallelizableIndex : public SingleThreadedIndex {
     ParallelizableIndex() = delete;
     ParallelizableIndex(const ParallelizableIndex &&) = delete;
 
-    // ParallelizableIndex(const std::vector<std::string> & dataset, 
+    // ParallelizableIndex(const Dataset & dataset, 
     //            const std::vector<std::string> & queries, 
     //            double sel_threshold)
     //   : SingleThreadedIndex(dataset, queries, sel_threshold),
@@ -22,7 +22,7 @@ class ParallelizableIndex : public SingleThreadedIndex {
     //         dist_measure_type_ = dist_type::kMaxDevDist2;
     //     }
     
-    ParallelizableIndex(const std::vector<std::string> & dataset, 
+    ParallelizableIndex(const Dataset & dataset, 
                const std::vector<std::string> & queries, 
                double sel_threshold, int num_threads)
       : SingleThreadedIndex(dataset, queries, sel_threshold) {
@@ -30,7 +30,7 @@ class ParallelizableIndex : public SingleThreadedIndex {
             thread_count_ = std::max(2, num_threads);
         }
     
-    ParallelizableIndex(const std::vector<std::string> & dataset, 
+    ParallelizableIndex(const Dataset & dataset, 
                const std::vector<std::string> & queries, 
                double sel_threshold, int num_threads, 
                long workload_reduced_size,
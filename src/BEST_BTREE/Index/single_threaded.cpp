@@ -328,7 +328,7 @@ best_btree_index::SingleThreadedIndex::get_all_gram_counts(
     for (const auto & line : k_dataset_) {
         for (size_t i = 0; i < line.size(); i++) {
             auto curr_c = line.at(i);
-            std::string curr_key = line.substr(i,1);
+            std::string curr_key(line.substr(i,1));
             auto lower_it = pre_suf_count.lower_bound(curr_key);
 
             for (auto & it = lower_it; it != pre_suf_count.end() && curr_key.at(0) == curr_c; ++it) {
@@ -386,14 +386,14 @@ std::vector<std::string> best_btree_index::SingleThreadedIndex::candidate_gram_s
 }
 
 void best_btree_index::SingleThreadedIndex::indexed_grams_in_string(
-        const std::string & l, 
+        std::string_view l, 
         const std::vector<std::string> & candidates,
         std::vector<std::set<size_t>> & qg_list, 
         size_t q_idx, const std::vector<bool> & candidates_filter) {
 
     for (size_t i = 0; i < l.size(); i++) {
         auto curr_c = l.at(i);
-        std::string curr_key = l.substr(i,1);
+        std::string curr_key(l.substr(i,1));
         auto lower_it = std::lower_bound(candidates.cbegin(), candidates.cend(), curr_key);
         for (auto & it = lower_it; it != candidates.cend() && curr_key.at(0) == curr_c; ++it) {
             // check if the current key is the same with curren substr
@@ -591,8 +591,10 @@ void best_btree_index::SingleThreadedIndex::select_grams(int upper_n) {
     // std::map<std::string, size_t> gram_to_candidate_idx_map;
     for (auto idx : index) {
         k_index_keys_.insert(candidates[idx]);
+        k_keys_dirty_ = true;
         k_index_.insert({candidates[idx], job.gr_list[idx]});
     }
+    build_key_automaton();
 
     auto build_time = std::chrono::duration_cast<std::chrono::duration<double>>(
         std::chrono::high_resolution_clock::now() - start).count();
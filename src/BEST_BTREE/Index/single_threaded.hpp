@@ -36,14 +36,14 @@ class SingleThreadedIndex  : public NGramBtreeIndex {
 
     SingleThreadedIndex() = delete;
     SingleThreadedIndex(const SingleThreadedIndex &&) = delete;
-    SingleThreadedIndex(const std::vector<std::string> & dataset, 
+    SingleThreadedIndex(const Dataset & dataset, 
                const std::vector<std::string> & queries, 
                double sel_threshold)
       : NGramBtreeIndex(dataset, queries),
         k_threshold_(sel_threshold), 
         k_reduced_queries_size_(queries.size()) {}
     
-    SingleThreadedIndex(const std::vector<std::string> & dataset, 
+    SingleThreadedIndex(const Dataset & dataset, 
                const std::vector<std::string> & queries, 
                double sel_threshold, long workload_reduced_size,
                dist_type dist_measure_type)
@@ -95,7 +95,7 @@ class SingleThreadedIndex  : public NGramBtreeIndex {
         const best_btree_index::SingleThreadedIndex::job & job,  
         size_t query_size);
     
-    void indexed_grams_in_string(const std::string & l, 
+    void indexed_grams_in_string(std::string_view l, 
         const std::vector<std::string> & candidates,
         std::vector<std::set<size_t>> & g_list, 
         size_t idx,
@@ -50,7 +50,8 @@ void simple_index() {
         "kane",
     });;
 
-    auto pi = best_btree_index::SingleThreadedIndex(test_dataset, test_query, 1);
+    const Dataset dataset(test_dataset);
+    auto pi = best_btree_index::SingleThreadedIndex(dataset, test_query, 1);
 
     pi.build_index();
     pi.print_index();
@@ -86,19 +87,20 @@ void simple_wl_red_index() {
         "ka" //12
     });;
 
-    auto pi1 = best_btree_index::SingleThreadedIndex(test_dataset, test_query, 
+    const Dataset dataset(test_dataset);
+    auto pi1 = best_btree_index::SingleThreadedIndex(dataset, test_query, 
         1, 4, best_btree_index::dist_type::kMaxDevDist1);
     pi1.build_index();
     pi1.print_index();
     std::cout << "***********" << std::endl;
 
-    auto pi2 = best_btree_index::SingleThreadedIndex(test_dataset, test_query, 
+    auto pi2 = best_btree_index::SingleThreadedIndex(dataset, test_query, 
         1, 4, best_btree_index::dist_type::kMaxDevDist2);
     pi2.build_index();
     pi2.print_index();
     std::cout << "***********" << std::endl;
 
-    auto pi3 = best_btree_index::SingleThreadedIndex(test_dataset, test_query, 
+    auto pi3 = best_btree_index::SingleThreadedIndex(dataset, test_query, 
         1, 4, best_btree_index::dist_type::kMaxDevDist3);
     pi3.build_index();
     pi3.print_index();
@@ -136,7 +138,8 @@ void simple_parallelizable() {
         "ka" //12
     });;
 
-    auto pi = best_btree_index::ParallelizableIndex(test_dataset, test_query, 1, 4, 
+    const Dataset dataset(test_dataset);
+    auto pi = best_btree_index::ParallelizableIndex(dataset, test_query, 1, 4, 
         4, best_btree_index::dist_type::kMaxDevDist1);
     pi.build_index();
     pi.print_index();
@@ -163,7 +166,8 @@ void simple_matcher() {
         "ka" //12
     });;
 
-    auto pi = best_btree_index::SingleThreadedIndex(test_dataset, test_query, 1, 4, 
+    const Dataset dataset(test_dataset);
+    auto pi = best_btree_index::SingleThreadedIndex(dataset, test_query, 1, 4, 
         best_btree_index::dist_type::kMaxDevDist1);
     pi.build_index();
     pi.print_index();
@@ -185,7 +189,8 @@ void longer_matcher() {
     double threshold;
     make_dataset_with_keys(test_query, test_dataset, threshold);
 
-    auto pi = best_btree_index::SingleThreadedIndex(test_dataset, test_query, 1, 4, 
+    const Dataset dataset(test_dataset);
+    auto pi = best_btree_index::SingleThreadedIndex(dataset, test_query, 1, 4, 
         best_btree_index::dist_type::kMaxDevDist1);
     pi.build_index();
     pi.print_index();
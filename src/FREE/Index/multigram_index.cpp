@@ -1,22 +1,10 @@
 #include "multigram_index.hpp"
+#include "../../utils/gram_table.hpp"
 
 /**-----------------------------Helpers Start----------------------------------**/
 
-using gram_count_map = std::unordered_map<std::string, long double>;
 using gram_set = std::unordered_set<std::string>;
 
-template <typename T, class hash_T>
-static void insert_or_increment(std::unordered_map<T, long double, hash_T> & kgrams, 
-                                T & key,
-                                std::unordered_set<T, hash_T> & visited_kgrams) {
-    auto [it, insert_success] = kgrams.insert({ key, 1 });
-    if (!insert_success) {
-        // Element was already present; increment the value at the key.
-        ++(it->second);
-    }
-    visited_kgrams.insert(key);
-}
-
 /**-----------------------------Helpers End----------------------------------**/
 
 // Algorithm 3.1 Multigram Index
@@ -34,6 +22,7 @@ void free_index::MultigramIndex::build_index(int upper_n) {
 
     start = std::chrono::high_resolution_clock::now();
     fill_posting(upper_n);
+    finalize_index();
     auto build_time = std::chrono::duration_cast<std::chrono::duration<double>>(
         std::chrono::high_resolution_clock::now() - start).count();
     
@@ -49,7 +38,7 @@ void free_index::MultigramIndex::fill_posting(int upper_n) {
         auto line = k_dataset_[i];
         for (auto pos = 0; pos < line.size(); pos++) {
             for (auto k = 1; k <= upper_n && k + pos <= line.size(); k++) {
-                const auto curr_substr = line.substr(pos, k);
+                const std::string curr_substr(line.substr(pos, k));
                 if (k_index_keys_.find(curr_substr) != k_index_keys_.end() &&
                     (k_index_[curr_substr].size() == 0 ||
                      k_index_[curr_substr].back() < i)
@@ -99,42 +88,59 @@ void free_index::MultigramIndex::select_grams(int upper_n) {
 void free_index::MultigramIndex::get_kgrams_not_indexed(
         std::unordered_map<std::string, long double> & kgrams,
         const std::unordered_set<std::string> & expand, size_t k) {
-    // get all grams whose prefix in expand
-    for (const auto & line : k_dataset_) {
-        gram_set visited_kgrams;
+    // grams are hashed and compared in place, pointing into expand and the
+    //   dataset; the line stamp in each entry replaces a per-line visited set
+    GramTable prefixes(k-1, expand.size());
+    for (const auto & s : expand) {
+        prefixes.find_or_insert(s.data(), RollingHash::hash(s));
+    }
+    GramTable curr_kgrams(k, expand.size());
+    RollingHash hasher(k);
+    for (size_t l = 0; l < k_dataset_size_; l++) {
+        std::string_view line = k_dataset_[l];
+        if (line.size() < k) continue;
+        hasher.set_line(line);
         for (size_t i = 0; i+k <= line.size(); i++) {
-            auto curr_kgram = line.substr(i, k);
-            // not seen in current line and in expand
-            if (visited_kgrams.find(curr_kgram) == visited_kgrams.end() &&
-                expand.find(line.substr(i, k-1)) != expand.end()) {
-                insert_or_increment(kgrams, curr_kgram, visited_kgrams);
+            if (prefixes.contains(line.data() + i, hasher.window(i, k-1))) {
+                curr_kgrams.count_once(line.data() + i, hasher.window(i, k), l);
             }
         }
     }
+    kgrams.reserve(curr_kgrams.size());
+    curr_kgrams.for_each([&](std::string_view gram, uint64_t count) {
+        kgrams.emplace(gram, count);
+    });
 } 
 
 void free_index::MultigramIndex::get_uni_bigram(
         std::unordered_map<char, long double> & unigrams,
         std::unordered_map<std::pair<char, char>, long double, hash_pair> & bigrams) {
-    for (const auto & line : k_dataset_) {
-        std::unordered_set<char> visited_unigrams;
-        std::unordered_set<std::pair<char, char>, hash_pair> visited_bigrams;
+    // direct-mapped counters, stamped with the last line that counted them
+    std::vector<uint64_t> uni_count(1 << 8, 0), uni_last(1 << 8, GramTable::kNoLine);
+    std::vector<uint64_t> bi_count(1 << 16, 0), bi_last(1 << 16, GramTable::kNoLine);
+    auto count_once = [](std::vector<uint64_t> & count, std::vector<uint64_t> & last,
+                         size_t gram, size_t l) {
+        if (last[gram] != l) {
+            last[gram] = l;
+            count[gram]++;
+        }
+    };
+    for (size_t l = 0; l < k_dataset_size_; l++) {
+        std::string_view line = k_dataset_[l];
         for (size_t i = 0; i + 1 < line.size(); i++) {
-            // optimize: Naively get all chars
-            char c1 = line.at(i);
-            char c2 = line.at(i+1);
-            if (visited_unigrams.find(c1) == visited_unigrams.end()) {
-                insert_or_increment(unigrams, c1, visited_unigrams);
-            }
-            if (visited_unigrams.find(c2) == visited_unigrams.end()) {
-                insert_or_increment(unigrams, c2, visited_unigrams);
-            }
-            auto curr_bigram = std::make_pair(c1, c2);
-            if (visited_bigrams.find(curr_bigram) == visited_bigrams.end()) {
-                insert_or_increment(bigrams, curr_bigram, visited_bigrams);
-            }
+            unsigned char c1 = line[i];
+            unsigned char c2 = line[i+1];
+            count_once(uni_count, uni_last, c1, l);
+            count_once(uni_count, uni_last, c2, l);
+            count_once(bi_count, bi_last, (size_t(c1) << 8) | c2, l);
         }
     }
+    for (size_t c = 0; c < uni_count.size(); c++) {
+        if (uni_count[c]) unigrams.emplace(char(c), uni_count[c]);
+    }
+    for (size_t p = 0; p < bi_count.size(); p++) {
+        if (bi_count[p]) bigrams.emplace(std::make_pair(char(p >> 8), char(p & 0xff)), bi_count[p]);
+    }
 }
 
 void free_index::MultigramIndex::insert_uni_bigram_into_index(
@@ -176,6 +182,7 @@ void free_index::MultigramIndex::insert_kgram_into_index(
         if (s_count/((double)k_dataset_size_) <= k_threshold_ &&
             k_index_keys_.size() < key_upper_bound_) {
             k_index_keys_.insert(s);
+            k_keys_dirty_ = true;
         } else {
             expand.insert(s);
         }
@@ -11,14 +11,17 @@ class MultigramIndex : public NGramInvertedIndex {
  public:
     MultigramIndex() = delete;
     MultigramIndex(const MultigramIndex &&) = delete;
-    MultigramIndex(const std::vector<std::string> & dataset, double sel_threshold)
+    MultigramIndex(const Dataset & dataset, double sel_threshold)
       : NGramInvertedIndex(dataset), k_threshold_(sel_threshold), k_tag_("") {}
     
     ~MultigramIndex() {}
 
     void build_index(int upper_n) override;
 
-    void manual_select_grams(std::set<std::string> & index_keys) { k_index_keys_ = index_keys; }
+    void manual_select_grams(std::set<std::string> & index_keys) {
+        k_index_keys_ = index_keys;
+        k_keys_dirty_ = true;
+    }
 
  protected:
     void select_grams(int upper_n) override;
@@ -3,6 +3,8 @@
 #include <sstream>
 #include <cassert>
 #include <cmath>
+#include <climits>
+#include <algorithm>
 
 #include "parallel_multigram_index.hpp"
 
@@ -12,134 +14,90 @@
 
 // Use 'loc_' prefix to denote a variable that should be unique to a thread
 
-template <typename T, class hash_T>
-void free_index::ParallelMultigramIndex::add_or_inc_w_lock(
-        std::map<T, atomic_ptr_t> & kgrams, 
-        const T & key, std::unordered_set<T, hash_T> & loc_visited_kgrams) {
-    if (!kgrams.contains(key)) {
-        grams_mutex_.lock();
-        if (!kgrams.contains(key))
-            kgrams.insert({ key, atomic_ptr_t(new std::atomic_ulong(1))});
-        else 
-            (*(kgrams.at(key)))++;
-        grams_mutex_.unlock();
-    } else {
-        grams_mutex_.lock_shared();
-        (*(kgrams.at(key)))++;
-        grams_mutex_.unlock_shared();
-    }
-    loc_visited_kgrams.insert(key);
-}
-
 void free_index::ParallelMultigramIndex::get_uni_bigram(size_t idx,
-        std::map<char, atomic_ptr_t> & unigrams,
-        std::map<std::pair<char, char>, atomic_ptr_t> & bigrams) {
-    for (size_t i = k_line_range_[idx]; i < k_line_range_[idx+1]; i++) {
-        auto line = k_dataset_[i];
-        std::unordered_set<char> loc_visited_unigrams;
-        std::unordered_set<std::pair<char, char>, hash_pair> loc_visited_bigrams;
-        for (size_t i = 0; i + 1 < line.size(); i++) {
-            // optimize: Naively get all chars
-            char c1 = line.at(i);
-            char c2 = line.at(i+1);
-            if (loc_visited_unigrams.find(c1) == loc_visited_unigrams.end()) {
-                add_or_inc_w_lock(unigrams, c1, loc_visited_unigrams);
-            }
-            if (loc_visited_unigrams.find(c2) == loc_visited_unigrams.end()) {
-                add_or_inc_w_lock(unigrams, c2, loc_visited_unigrams);
-            }
-            auto curr_bigram = std::make_pair(c1, c2);
-            if (loc_visited_bigrams.find(curr_bigram) == loc_visited_bigrams.end()) {
-                add_or_inc_w_lock(bigrams, curr_bigram, loc_visited_bigrams);
-            }
-        }
-    }
-}
-
-void free_index::ParallelMultigramIndex::insert_unigram_into_index(
-        const std::map<char, atomic_ptr_t> & unigrams,
-        std::map<char, atomic_ptr_t>::iterator s,
-        std::map<char, atomic_ptr_t>::iterator d,
-        std::vector<char> & loc_uni_expand,
-        std::vector<char> & loc_index_keys) {
-    for (; s != d; s++) {
-        char c = s->first;
-        if (*(s->second)/((double)k_dataset_size_) <= k_threshold_) {
-            loc_index_keys.push_back(c);
-        } else {
-            loc_uni_expand.push_back(c);
+        std::vector<uint64_t> & loc_unigrams,
+        std::vector<uint64_t> & loc_bigrams) {
+    // direct-mapped counters, stamped with the last line that counted them
+    loc_unigrams.assign(1 << 8, 0);
+    loc_bigrams.assign(1 << 16, 0);
+    std::vector<uint64_t> loc_uni_last(1 << 8, GramTable::kNoLine);
+    std::vector<uint64_t> loc_bi_last(1 << 16, GramTable::kNoLine);
+    auto count_once = [](std::vector<uint64_t> & count, std::vector<uint64_t> & last,
+                         size_t gram, size_t l) {
+        if (last[gram] != l) {
+            last[gram] = l;
+            count[gram]++;
         }
-    }
-}
-
-void free_index::ParallelMultigramIndex::insert_bigram_into_index(
-        const std::map<std::pair<char, char>, atomic_ptr_t> & bigrams,
-        std::map<std::pair<char, char>, atomic_ptr_t>::iterator s,
-        std::map<std::pair<char, char>, atomic_ptr_t>::iterator d,
-        const std::unordered_set<char> & uni_expand,
-        std::vector<std::pair<char, char>> & loc_bi_expand,
-        std::vector<std::pair<char, char>> & loc_index_keys) {
-    for (; s != d; s++) {
-        auto p = s->first;
-        // check if it is expand
-        if (uni_expand.find(p.first) != uni_expand.end()) {
-            if (*(s->second)/((double)k_dataset_size_) <= k_threshold_) {
-                loc_index_keys.push_back(p);
-            } else {
-                loc_bi_expand.push_back(p);
-            }
+    };
+    for (size_t l = k_line_range_[idx]; l < k_line_range_[idx+1]; l++) {
+        std::string_view line = k_dataset_[l];
+        for (size_t i = 0; i + 1 < line.size(); i++) {
+            unsigned char c1 = line[i];
+            unsigned char c2 = line[i+1];
+            count_once(loc_unigrams, loc_uni_last, c1, l);
+            count_once(loc_unigrams, loc_uni_last, c2, l);
+            count_once(loc_bigrams, loc_bi_last, (size_t(c1) << 8) | c2, l);
         }
     }
 }
 
 void free_index::ParallelMultigramIndex::get_kgrams_not_indexed(size_t idx,
-        std::map<std::string, atomic_ptr_t> & kgrams,
-        const std::unordered_set<std::string> & expand, size_t k) {
+        std::vector<GramTable> & loc_kgrams,
+        const GramTable & prefixes, size_t k) {
+    for (size_t p = 0; p < thread_count_; p++) {
+        loc_kgrams.emplace_back(k);
+    }
     // get all grams whose prefix in expand
-    for (size_t i = k_line_range_[idx]; i < k_line_range_[idx+1]; i++) {
-        auto line = k_dataset_[i];
-        std::unordered_set<std::string> loc_visited_kgrams;
+    RollingHash hasher(k);
+    for (size_t l = k_line_range_[idx]; l < k_line_range_[idx+1]; l++) {
+        std::string_view line = k_dataset_[l];
+        if (line.size() < k) continue;
+        hasher.set_line(line);
         for (size_t i = 0; i+k <= line.size(); i++) {
-            auto curr_kgram = line.substr(i, k);
-            // not seen in current line and in expand
-            if (loc_visited_kgrams.find(curr_kgram) == loc_visited_kgrams.end() &&
-                expand.find(line.substr(i, k-1)) != expand.end()) {
-                add_or_inc_w_lock(kgrams, curr_kgram, loc_visited_kgrams);
+            if (prefixes.contains(line.data() + i, hasher.window(i, k-1))) {
+                uint64_t h = hasher.window(i, k);
+                loc_kgrams[GramTable::partition(h, thread_count_)].count_once(
+                    line.data() + i, h, l);
             }
         }
     }
 } 
 
-void free_index::ParallelMultigramIndex::insert_kgram_into_index(
-        const std::map<std::string, atomic_ptr_t> & kgrams,
-        std::map<std::string, atomic_ptr_t>::iterator s,
-        std::map<std::string, atomic_ptr_t>::iterator d,
+void free_index::ParallelMultigramIndex::insert_kgram_into_index(size_t part,
+        const std::vector<std::vector<GramTable>> & loc_kgrams,
         std::vector<std::string> & loc_expand,
         std::vector<std::string> & loc_index_keys) {
+    size_t expected = 0;
+    for (const auto & thread_kgrams : loc_kgrams) {
+        expected = std::max(expected, thread_kgrams[part].size());
+    }
+    GramTable kgrams(loc_kgrams[0][part].gram_len(), expected);
+    for (const auto & thread_kgrams : loc_kgrams) {
+        thread_kgrams[part].for_each_entry([&](const GramTable::Entry & e) {
+            kgrams.add(e.gram, e.hash, e.count);
+        });
+    }
     // for each gram, if selectivity <= threshold, insert to index
     //    else insert to expand
-    for (; s != d; s++) {
-        auto str = s->first;
-        if (*(s->second)/((double)k_dataset_size_) <= k_threshold_) {
-            loc_index_keys.push_back(str);
+    kgrams.for_each([&](std::string_view gram, uint64_t count) {
+        if (count/((double)k_dataset_size_) <= k_threshold_) {
+            loc_index_keys.emplace_back(gram);
         } else {
-            loc_expand.push_back(str);
+            loc_expand.emplace_back(gram);
         }
-    }
+    });
 }
 
 void free_index::ParallelMultigramIndex::select_grams(int upper_n) {
     std::unordered_set<std::string> expand; // stores useless prefix
 
-    size_t posting_resv_size = std::ceil(k_dataset_size_*k_threshold_);
-
-    std::map<char, atomic_ptr_t> unigrams;
-    std::map<std::pair<char, char>, atomic_ptr_t> bigrams;
+    std::vector<std::vector<uint64_t>> loc_unigrams(thread_count_);
+    std::vector<std::vector<uint64_t>> loc_bigrams(thread_count_);
     std::vector<std::thread> threads;
     for (int i = 0; i < thread_count_; i++) {
         threads.push_back(std::thread(
             &free_index::ParallelMultigramIndex::get_uni_bigram, this,
-                i, std::ref(unigrams), std::ref(bigrams)
+                i, std::ref(loc_unigrams[i]), std::ref(loc_bigrams[i])
         ));
     }
     for (auto &th : threads) {
@@ -147,145 +105,88 @@ void free_index::ParallelMultigramIndex::select_grams(int upper_n) {
     }
     decltype(threads)().swap(threads);
 
-    std::unordered_set<char> uni_expand;
-    std::vector<std::vector<char>> loc_uni_expands(thread_count_);
-    std::vector<std::vector<char>> loc_index_keys_char(thread_count_);
-    auto num_per_thread = std::ceil(unigrams.size() / ((double) thread_count_));
-    for (size_t j = 0; j < thread_count_; j++) {
-        loc_uni_expands[j].reserve(num_per_thread);
-        loc_index_keys_char[j].reserve(num_per_thread);
-    }
-    int i = 0;
-    auto uni_start_it = unigrams.begin();
-    auto uni_end_it = uni_start_it;
-    for (; i < thread_count_ && num_per_thread*(i+1) < unigrams.size(); i++) {
-        std::advance(uni_end_it, num_per_thread);
-        threads.push_back(std::thread(
-            &free_index::ParallelMultigramIndex::insert_unigram_into_index, this,
-                std::cref(unigrams), uni_start_it, uni_end_it, 
-                std::ref(loc_uni_expands[i]), std::ref(loc_index_keys_char[i])
-        ));
-        uni_start_it = uni_end_it;
-    }
-    if (num_per_thread * i < unigrams.size()) {
-        threads.push_back(std::thread(
-            &free_index::ParallelMultigramIndex::insert_unigram_into_index, this,
-                std::cref(unigrams), uni_start_it, unigrams.end(),
-                std::ref(loc_uni_expands[i]), std::ref(loc_index_keys_char[i])
-        ));
-    }
-    for (auto &th : threads) {
-        th.join();
-    }
-    for (const auto & thread_local_vect : loc_uni_expands) {
-        for (const auto & c : thread_local_vect) {
-            uni_expand.insert(c);
-        }
+    std::vector<uint64_t> unigrams(1 << 8, 0);
+    std::vector<uint64_t> bigrams(1 << 16, 0);
+    for (int i = 0; i < thread_count_; i++) {
+        for (size_t c = 0; c < unigrams.size(); c++) unigrams[c] += loc_unigrams[i][c];
+        for (size_t p = 0; p < bigrams.size(); p++) bigrams[p] += loc_bigrams[i][p];
     }
-    for (const auto & thread_local_vect : loc_index_keys_char) {
-        for (const auto & c : thread_local_vect) {
+    decltype(loc_unigrams)().swap(loc_unigrams);
+    decltype(loc_bigrams)().swap(loc_bigrams);
+
+    // chars in ascending (signed) order, the order keys are inserted in
+    //   when the key upper bound is hit
+    std::unordered_set<char> uni_expand;
+    for (int c = CHAR_MIN; c <= CHAR_MAX; c++) {
+        uint64_t c_count = unigrams[static_cast<unsigned char>(c)];
+        if (c_count == 0) continue;
+        if (c_count/((double)k_dataset_size_) <= k_threshold_) {
             if (k_index_keys_.size() < key_upper_bound_) {
-                std::string curr_str = std::string(1, c);
+                std::string curr_str = std::string(1, char(c));
                 k_index_keys_.insert(curr_str);
+                k_keys_dirty_ = true;
                 k_index_.insert({curr_str, std::vector<size_t>()});
             }
+        } else {
+            uni_expand.insert(char(c));
         }
     }
-    decltype(unigrams)().swap(unigrams);
-    decltype(loc_uni_expands)().swap(loc_uni_expands);
-    decltype(loc_index_keys_char)().swap(loc_index_keys_char);
-    decltype(threads)().swap(threads);
 
     if (upper_n < 2) return;
 
-    std::vector<std::vector<std::pair<char,char>>> loc_bi_expands(thread_count_);
-    std::vector<std::vector<std::pair<char,char>>> loc_index_keys_pair(thread_count_);
-    num_per_thread = std::ceil(bigrams.size() / ((double) thread_count_));
-    i = 0;
-    auto bi_start_it = bigrams.begin();
-    auto bi_end_it = bi_start_it;
-    for (; i < thread_count_ && num_per_thread*(i+1) < bigrams.size(); i++) {
-        std::advance(bi_end_it, num_per_thread);
-        threads.push_back(std::thread(
-            &free_index::ParallelMultigramIndex::insert_bigram_into_index, this,
-                std::cref(bigrams), bi_start_it, bi_end_it,
-                std::cref(uni_expand),
-                std::ref(loc_bi_expands[i]), 
-                std::ref(loc_index_keys_pair[i])
-        ));
-        bi_start_it = bi_end_it;
-    }
-    if (num_per_thread * i < bigrams.size()) {
-        threads.push_back(std::thread(
-            &free_index::ParallelMultigramIndex::insert_bigram_into_index, this,
-                std::cref(bigrams), bi_start_it, bigrams.end(),
-                std::cref(uni_expand),
-                std::ref(loc_bi_expands[i]), 
-                std::ref(loc_index_keys_pair[i])
-        ));
-    }
-    for (auto &th : threads) {
-        th.join();
-    }
-    for (const auto & thread_local_vect : loc_bi_expands) {
-        for (const auto & p : thread_local_vect) {
-            std::string curr_str{p.first, p.second};
-            expand.insert(curr_str);
-        }
-    }
-    for (const auto & thread_local_vect : loc_index_keys_pair) {
-        for (const auto & p : thread_local_vect) {
-            if (k_index_keys_.size() < key_upper_bound_) {
-                std::string curr_str{p.first, p.second};
-                k_index_keys_.insert(curr_str);
-                k_index_.insert({curr_str, std::vector<size_t>()});
+    for (int c1 = CHAR_MIN; c1 <= CHAR_MAX; c1++) {
+        // check if it is expand
+        if (uni_expand.find(char(c1)) == uni_expand.end()) continue;
+        for (int c2 = CHAR_MIN; c2 <= CHAR_MAX; c2++) {
+            uint64_t p_count = bigrams[(size_t(static_cast<unsigned char>(c1)) << 8) | 
+                                       static_cast<unsigned char>(c2)];
+            if (p_count == 0) continue;
+            std::string curr_str{char(c1), char(c2)};
+            if (p_count/((double)k_dataset_size_) <= k_threshold_) {
+                if (k_index_keys_.size() < key_upper_bound_) {
+                    k_index_keys_.insert(curr_str);
+                    k_keys_dirty_ = true;
+                    k_index_.insert({curr_str, std::vector<size_t>()});
+                }
+            } else {
+                expand.insert(curr_str);
             }
         }
     }
     decltype(bigrams)().swap(bigrams);
-    decltype(loc_bi_expands)().swap(loc_bi_expands);
-    decltype(loc_index_keys_pair)().swap(loc_index_keys_pair);
-    decltype(threads)().swap(threads);
 
     int k = 3;
     while (!expand.empty() && k <= upper_n && 
            k_index_keys_.size() < key_upper_bound_) {
-        // get all k-grams whose prefix not in index already
-        std::map<std::string, atomic_ptr_t> curr_kgrams = {};
-
-        for (int i = 0; i < thread_count_; i++) {
-            threads.push_back(std::thread(
-                &free_index::ParallelMultigramIndex::get_kgrams_not_indexed, this,
-                    i, std::ref(curr_kgrams), std::cref(expand), k
-            ));
-        }
-        for (auto &th : threads) {
-            th.join();
+        // get all k-grams whose prefix not in index already;
+        //   loc_kgrams[i][p] holds thread i's grams of hash partition p
+        std::vector<std::vector<GramTable>> loc_kgrams(thread_count_);
+        {
+            GramTable prefixes(k-1, expand.size());
+            for (const auto & s : expand) {
+                prefixes.find_or_insert(s.data(), RollingHash::hash(s));
+            }
+            for (int i = 0; i < thread_count_; i++) {
+                threads.push_back(std::thread(
+                    &free_index::ParallelMultigramIndex::get_kgrams_not_indexed, this,
+                        i, std::ref(loc_kgrams[i]), std::cref(prefixes), k
+                ));
+            }
+            for (auto &th : threads) {
+                th.join();
+            }
+            decltype(threads)().swap(threads);
         }
-        decltype(threads)().swap(threads);
         // Clear the expand for current k
         decltype(expand)().swap(expand);
 
+        // one thread merges and classifies each partition
         std::vector<std::vector<std::string>> loc_expands(thread_count_);
         std::vector<std::vector<std::string>> loc_index_keys(thread_count_);
-        num_per_thread = std::ceil(curr_kgrams.size() / ((double) thread_count_));
-        i = 0;
-        auto start_it = curr_kgrams.begin();
-        auto end_it = start_it;
-        for (; i < thread_count_ && num_per_thread*(i+1) < curr_kgrams.size(); i++) {
-            std::advance(end_it, num_per_thread);
-            threads.push_back(std::thread(
-                &free_index::ParallelMultigramIndex::insert_kgram_into_index, this,
-                    std::cref(curr_kgrams), start_it, end_it, 
-                    std::ref(loc_expands[i]), 
-                    std::ref(loc_index_keys[i])
-            ));
-            start_it = end_it;
-        }
-        if (num_per_thread * i < curr_kgrams.size()) {
+        for (int i = 0; i < thread_count_; i++) {
             threads.push_back(std::thread(
                 &free_index::ParallelMultigramIndex::insert_kgram_into_index, this,
-                    std::cref(curr_kgrams), start_it, curr_kgrams.end(), 
+                    i, std::cref(loc_kgrams), 
                     std::ref(loc_expands[i]), 
                     std::ref(loc_index_keys[i])
             ));
@@ -293,23 +194,33 @@ void free_index::ParallelMultigramIndex::select_grams(int upper_n) {
         for (auto &th : threads) {
             th.join();
         }
+        decltype(threads)().swap(threads);
+        decltype(loc_kgrams)().swap(loc_kgrams);
+
         for (const auto & thread_local_vect : loc_expands) {
             for (const auto & s : thread_local_vect) {
                 expand.insert(s);
             }
         }
-        for (const auto & thread_local_vect : loc_index_keys) {
-            for (const auto & s : thread_local_vect) {
-                if (k_index_keys_.size() < key_upper_bound_) {
-                    k_index_keys_.insert(s);
-                    k_index_.insert({s, std::vector<size_t>()});
-                }
+        std::vector<std::string> new_keys;
+        for (auto & thread_local_vect : loc_index_keys) {
+            new_keys.insert(new_keys.end(), 
+                            std::make_move_iterator(thread_local_vect.begin()), 
+                            std::make_move_iterator(thread_local_vect.end()));
+        }
+        if (k_index_keys_.size() + new_keys.size() > key_upper_bound_) {
+            // only some fit; take the smallest ones, as in lexicographic order
+            std::sort(new_keys.begin(), new_keys.end());
+        }
+        for (const auto & s : new_keys) {
+            if (k_index_keys_.size() < key_upper_bound_) {
+                k_index_keys_.insert(s);
+                k_keys_dirty_ = true;
+                k_index_.insert({s, std::vector<size_t>()});
             }
         }
-        decltype(curr_kgrams)().swap(curr_kgrams);
         decltype(loc_expands)().swap(loc_expands);
         decltype(loc_index_keys)().swap(loc_index_keys);
-        decltype(threads)().swap(threads);
         k++;
     }
 }
@@ -320,7 +231,7 @@ void free_index::ParallelMultigramIndex::kgrams_in_line(int upper_n, size_t idx,
         auto line = k_dataset_[i];
         for (auto pos = 0; pos < line.size(); pos++) {
             for (auto k = 1; k <= upper_n && k + pos <= line.size(); k++) {
-                const auto curr_substr = line.substr(pos, k);
+                const std::string curr_substr(line.substr(pos, k));
                 if (k_index_keys_.find(curr_substr) != k_index_keys_.end() &&
                     (local_idx[curr_substr].size() == 0 ||
                      local_idx[curr_substr].back() < i)
@@ -385,20 +296,3 @@ void free_index::ParallelMultigramIndex::fill_posting(int upper_n) {
     decltype(loc_idxs)().swap(loc_idxs);
     decltype(threads)().swap(threads);
 }
-
-template 
-void free_index::ParallelMultigramIndex::add_or_inc_w_lock<char, std::hash<char>>(
-        std::map<char, atomic_ptr_t> & kgrams, 
-        const char & key, std::unordered_set<char, std::hash<char>> & loc_visited_kgrams);
-
-template 
-void free_index::ParallelMultigramIndex::add_or_inc_w_lock<std::pair<char,char>, hash_pair>(
-        std::map<std::pair<char,char>, atomic_ptr_t> & kgrams, 
-        const std::pair<char,char> & key, 
-        std::unordered_set<std::pair<char,char>, hash_pair> & loc_visited_kgrams);
-
-template 
-void free_index::ParallelMultigramIndex::add_or_inc_w_lock<std::string, std::hash<std::string>>(
-        std::map<std::string, atomic_ptr_t> & kgrams, 
-        const std::string & key, 
-        std::unordered_set<std::string, std::hash<std::string>> & loc_visited_kgrams);    
\ No newline at end of file
@@ -4,12 +4,9 @@
 #include <map>
 #include <unordered_map>
 #include <memory>
-#include <atomic>
-#include <shared_mutex>
 
 #include "multigram_index.hpp"
-
-using atomic_ptr_t = std::shared_ptr<std::atomic_ulong>;
+#include "../../utils/gram_table.hpp"
 
 namespace free_index {
 
@@ -17,7 +14,7 @@ class ParallelMultigramIndex : public MultigramIndex {
  public:
     ParallelMultigramIndex() = delete;
     ParallelMultigramIndex(const ParallelMultigramIndex &&) = delete;
-    ParallelMultigramIndex(const std::vector<std::string> & dataset, 
+    ParallelMultigramIndex(const Dataset & dataset, 
                    double sel_threshold, int num_threads)
       : MultigramIndex(dataset, sel_threshold) {
             k_tag_ = "-parallel";
@@ -40,41 +37,24 @@ class ParallelMultigramIndex : public MultigramIndex {
     void fill_posting(int upper_n) override;
 
     std::vector<size_t> k_line_range_;
-    std::shared_mutex grams_mutex_;
 
  private:
     /**Select Grams Helpers**/
-    template <typename T, class hash_T>
-    void add_or_inc_w_lock(
-        std::map<T, atomic_ptr_t> & kgrams, 
-        const T & key, std::unordered_set<T, hash_T> & loc_visited_kgrams);
-    
+    // each thread counts its own lines; no table is shared while counting
     void get_uni_bigram(size_t idx,
-        std::map<char, atomic_ptr_t> & unigrams,
-        std::map<std::pair<char, char>, atomic_ptr_t> & bigrams);
-    
-    void insert_unigram_into_index(const std::map<char, atomic_ptr_t> & unigrams,
-        std::map<char, atomic_ptr_t>::iterator s,
-        std::map<char, atomic_ptr_t>::iterator d,
-        std::vector<char> & loc_uni_expand,
-        std::vector<char> & loc_index_keys);
-    
-    void insert_bigram_into_index(
-        const std::map<std::pair<char, char>, atomic_ptr_t> & bigrams,
-        std::map<std::pair<char, char>, atomic_ptr_t>::iterator s,
-        std::map<std::pair<char, char>, atomic_ptr_t>::iterator d,
-        const std::unordered_set<char> & uni_expand,
-        std::vector<std::pair<char, char>> & loc_bi_expand,
-        std::vector<std::pair<char, char>> & loc_index_keys);
+        std::vector<uint64_t> & loc_unigrams,
+        std::vector<uint64_t> & loc_bigrams);
 
+    /**loc_kgrams[p] gets the k-grams of the lines of thread idx (whose 
+     * (k-1)-prefix is in prefixes) that fall in hash partition p**/
     void get_kgrams_not_indexed(size_t idx,
-        std::map<std::string, atomic_ptr_t> & kgrams,
-        const std::unordered_set<std::string> & expand, size_t k);
+        std::vector<GramTable> & loc_kgrams,
+        const GramTable & prefixes, size_t k);
 
-    void insert_kgram_into_index(
-        const std::map<std::string, atomic_ptr_t> & kgrams,
-        std::map<std::string, atomic_ptr_t>::iterator s,
-        std::map<std::string, atomic_ptr_t>::iterator d,
+    /**Merge hash partition part of all threads' k-grams and split it into
+     * grams to index and grams to expand**/
+    void insert_kgram_into_index(size_t part,
+        const std::vector<std::vector<GramTable>> & loc_kgrams,
         std::vector<std::string> & loc_expand,
         std::vector<std::string> & loc_index_keys);
     /**Select Grams Helpers End**/
@@ -17,6 +17,7 @@ void free_index::PresufShell::build_index(int upper_n) {
 
     start = std::chrono::high_resolution_clock::now();
     fill_posting(upper_n);
+    finalize_index();
     auto build_time = std::chrono::duration_cast<std::chrono::duration<double>>(
         std::chrono::high_resolution_clock::now() - start).count();
     std::cout << "Index Building End in " << build_time << std::endl;
@@ -50,6 +51,7 @@ void free_index::PresufShell::compute_suffix_free_set() {
             curr_full.substr(0, curr_prefix.size()) == curr_prefix) {
                 // remove this string
                 k_index_keys_.erase(rev_to_ori[curr_full]);
+                k_keys_dirty_ = true;
             }
             curr_prefix = curr_full;
     }
@@ -9,11 +9,11 @@ class PresufShell: public ParallelMultigramIndex {
  public:
     PresufShell() = delete;
     PresufShell(const PresufShell &&) = delete;
-    PresufShell(const std::vector<std::string> & dataset, double sel_threshold)
+    PresufShell(const Dataset & dataset, double sel_threshold)
         : ParallelMultigramIndex(dataset, sel_threshold, 1) {
             k_tag_ = "-presuf";
         }
-    PresufShell(const std::vector<std::string> & dataset, double sel_threshold,
+    PresufShell(const Dataset & dataset, double sel_threshold,
                 int num_threads)
         : ParallelMultigramIndex(dataset, sel_threshold, num_threads) {
             k_tag_ = "-presuf";
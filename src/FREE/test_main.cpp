@@ -1,10 +1,16 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <cstring>
+#include <algorithm>
+#include <cstddef>
 
 #include "Index/multigram_index.hpp"
 #include "Index/presuf_shell.hpp"
 #include "Index/parallel_multigram_index.hpp"
 #include "../simple_query_matcher.hpp"
+#include "../utils/index_file.hpp"
 
 #include <cassert>
 
@@ -80,7 +86,8 @@ void simple_index() {
         "5.fffff"
     });
 
-    auto pi = free_index::MultigramIndex(test_dataset, 1);
+    const Dataset dataset(test_dataset);
+    auto pi = free_index::MultigramIndex(dataset, 1);
 
     // try build index of uni and bigrams only
     pi.build_index(2);
@@ -116,7 +123,8 @@ void simple_index_threshold() {
         "5.fffff"
     });
 
-    auto pi = free_index::MultigramIndex(test_dataset, 0.9);
+    const Dataset dataset(test_dataset);
+    auto pi = free_index::MultigramIndex(dataset, 0.9);
 
     // try build index of uni and bigrams only
     pi.build_index(2);
@@ -150,7 +158,8 @@ void simple_presuf() {
         "5.fffff"
     });
 
-    auto pi = free_index::PresufShell(test_dataset, 0.9);
+    const Dataset dataset(test_dataset);
+    auto pi = free_index::PresufShell(dataset, 0.9);
 
     // try build index of uni and bigrams only
     pi.build_index(2);
@@ -186,7 +195,8 @@ void simple_multi_parallel() {
     double threshold;
     make_dataset_with_keys(test_keys, test_dataset, threshold);
 
-    auto pi = free_index::ParallelMultigramIndex(test_dataset, threshold, 4);
+    const Dataset dataset(test_dataset);
+    auto pi = free_index::ParallelMultigramIndex(dataset, threshold, 4);
     pi.build_index(5);
     pi.print_index();
 
@@ -209,7 +219,8 @@ void simple_find_keys() {
     double threshold;
     make_dataset_with_keys(test_keys, test_dataset, threshold);
 
-    auto pi = free_index::MultigramIndex(test_dataset, threshold);
+    const Dataset dataset(test_dataset);
+    auto pi = free_index::MultigramIndex(dataset, threshold);
     pi.build_index(5);
     pi.print_index();
 
@@ -220,6 +231,118 @@ void simple_find_keys() {
            "2 Keys indexed in Clinton");
 }
 
+void simple_reselect_keys() {
+    std::vector<std::string> test_keys({
+        "Will",
+        "liam",
+        "Clint",
+        "nton"
+    });
+
+    std::vector<std::string> test_dataset;
+    double threshold;
+    make_dataset_with_keys(test_keys, test_dataset, threshold);
+
+    const Dataset dataset(test_dataset);
+    auto pi = free_index::MultigramIndex(dataset, threshold);
+    pi.build_index(5);
+
+    // as many keys as before, so only the change itself tells the 
+    //   key automaton is out of date
+    std::set<std::string> new_keys({"Will", "liam", "Clint", "Bill"});
+    pi.manual_select_grams(new_keys);
+    assert(compare_lists(pi.find_all_keys("Bill"), {"Bill"}) && 
+           "Bill indexed after reselecting the keys");
+    assert(compare_lists(pi.find_all_keys("Clinton"), {"Clint"}) && 
+           "nton no longer indexed after reselecting the keys");
+}
+
+std::string read_bytes(const std::filesystem::path & path) {
+    std::ifstream in(path, std::ios::binary);
+    std::ostringstream bytes;
+    bytes << in.rdbuf();
+    return bytes.str();
+}
+
+void write_bytes(const std::filesystem::path & path, const std::string & bytes) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), bytes.size());
+}
+
+void simple_save_load() {
+    std::vector<std::string> test_keys({
+        "Will",
+        "liam",
+        "Clint",
+        "nton"
+    });
+
+    std::vector<std::string> test_dataset;
+    double threshold;
+    make_dataset_with_keys(test_keys, test_dataset, threshold);
+    // so that some posting lists have more than one line
+    test_dataset.push_back("William Clinton");
+    test_dataset.push_back("William Clinton");
+
+    const Dataset dataset(test_dataset);
+    auto pi = free_index::MultigramIndex(dataset, threshold);
+    pi.build_index(5);
+
+    auto path = std::filesystem::temp_directory_path() / "free_test_main.idx";
+    assert(pi.save_index(path) && "Index saved");
+
+    auto loaded = free_index::MultigramIndex(dataset, threshold);
+    assert(loaded.load_index(path) && "Index loaded over the same dataset");
+    assert(loaded.get_num_keys() == pi.get_num_keys() && "Same keys after loading");
+    for (const auto & line : test_dataset) {
+        auto keys = pi.find_all_keys(line);
+        assert(compare_lists(loaded.find_all_keys(line), keys) && 
+               "Same keys found after loading");
+        for (const auto & key : keys) {
+            assert(compare_lists(loaded.get_line_pos_at(key), pi.get_line_pos_at(key)) && 
+                   "Same posting lists after loading");
+        }
+    }
+
+    // every corruption is rejected, and leaves the index as it was
+    const std::string bytes = read_bytes(path);
+    IndexFileHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    size_t ids_begin = bytes.size() - header.num_ids * sizeof(size_t);
+
+    std::string truncated = bytes.substr(0, bytes.size() - sizeof(size_t));
+    write_bytes(path, truncated);
+    assert(!loaded.load_index(path) && "Truncated file rejected");
+
+    std::string huge_count = bytes;
+    uint64_t num_keys = (uint64_t(1) << 60) - 1;
+    std::memcpy(huge_count.data() + offsetof(IndexFileHeader, num_keys), &num_keys, sizeof(num_keys));
+    write_bytes(path, huge_count);
+    assert(!loaded.load_index(path) && "Overflowing key count rejected");
+
+    std::string out_of_range = bytes;
+    size_t bad_id = test_dataset.size();
+    std::memcpy(out_of_range.data() + ids_begin, &bad_id, sizeof(bad_id));
+    write_bytes(path, out_of_range);
+    assert(!loaded.load_index(path) && "Line id past the dataset rejected");
+
+    // swap the first two ids of the first list with more than one
+    std::string unsorted = bytes;
+    std::vector<uint64_t> posting_offsets(header.num_keys + 1);
+    std::memcpy(posting_offsets.data(), 
+                bytes.data() + sizeof(header) + posting_offsets.size() * sizeof(uint64_t), 
+                posting_offsets.size() * sizeof(uint64_t));
+    size_t list = 0;
+    while (posting_offsets[list+1] - posting_offsets[list] < 2) list++;
+    char * first_id = unsorted.data() + ids_begin + posting_offsets[list] * sizeof(size_t);
+    std::swap_ranges(first_id, first_id + sizeof(size_t), first_id + sizeof(size_t));
+    write_bytes(path, unsorted);
+    assert(!loaded.load_index(path) && "Unsorted posting list rejected");
+
+    assert(loaded.get_num_keys() == pi.get_num_keys() && "Rejected loads keep the index");
+    std::filesystem::remove(path);
+}
+
 void simple_match_all() {
     std::vector<std::string> test_keys({
         "Will",
@@ -240,7 +363,8 @@ void simple_match_all() {
     }
     test_dataset.push_back("William");
     test_dataset.push_back("Bill.Clinton");
-    auto pi = free_index::MultigramIndex(test_dataset, threshold);
+    const Dataset dataset(test_dataset);
+    auto pi = free_index::MultigramIndex(dataset, threshold);
     pi.build_index(5);
     pi.print_index();
     std::vector<std::string> reg_query = {"(Bill|William)(.*)Clinton", "TDT"};
@@ -270,7 +394,8 @@ void simple_match_one() {
     }
     test_dataset.push_back("William");
     test_dataset.push_back("Bill.Clinton");
-    auto pi = free_index::MultigramIndex(test_dataset, threshold);
+    const Dataset dataset(test_dataset);
+    auto pi = free_index::MultigramIndex(dataset, threshold);
     pi.build_index(5);
     pi.print_index();
     std::vector<std::string> reg_query = {"(Bill|William)(.*)Clinton"};
@@ -295,6 +420,10 @@ int main() {
     simple_multi_parallel();
     std::cout << "\t SIMPLE FIND KEYS-------------------------------------------" << std::endl;
     simple_find_keys();
+    std::cout << "\t SIMPLE RESELECT KEYS-------------------------------------------" << std::endl;
+    simple_reselect_keys();
+    std::cout << "\t SIMPLE SAVE LOAD-------------------------------------------" << std::endl;
+    simple_save_load();
     std::cout << "BEGIN MATCHER TESTS-------------------------------------------" << std::endl;
     std::cout << "\t SIMPLE MATCH ALL -------------------------------------------" << std::endl;
     simple_match_all();
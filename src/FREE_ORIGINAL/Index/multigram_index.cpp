@@ -34,6 +34,7 @@ void free_original_index::MultigramIndex::build_index(int upper_n) {
 
     start = std::chrono::high_resolution_clock::now();
     fill_posting(upper_n);
+    finalize_index();
     auto build_time = std::chrono::duration_cast<std::chrono::duration<double>>(
         std::chrono::high_resolution_clock::now() - start).count();
     
@@ -49,7 +50,7 @@ void free_original_index::MultigramIndex::fill_posting(int upper_n) {
         auto line = k_dataset_[i];
         for (auto pos = 0; pos < line.size(); pos++) {
             for (auto k = 1; k <= upper_n && k + pos <= line.size(); k++) {
-                const auto curr_substr = line.substr(pos, k);
+                const std::string curr_substr(line.substr(pos, k));
                 if (k_index_keys_.find(curr_substr) != k_index_keys_.end() &&
                     (k_index_[curr_substr].size() == 0 ||
                      k_index_[curr_substr].back() < i)
@@ -103,10 +104,10 @@ void free_original_index::MultigramIndex::get_kgrams_not_indexed(
     for (const auto & line : k_dataset_) {
         gram_set visited_kgrams;
         for (size_t i = 0; i+k <= line.size(); i++) {
-            auto curr_kgram = line.substr(i, k);
+            std::string curr_kgram(line.substr(i, k));
             // not seen in current line and in expand
             if (visited_kgrams.find(curr_kgram) == visited_kgrams.end() &&
-                expand.find(line.substr(i, k-1)) != expand.end()) {
+                expand.find(std::string(line.substr(i, k-1))) != expand.end()) {
                 insert_or_increment(kgrams, curr_kgram, visited_kgrams);
             }
         }
@@ -11,7 +11,7 @@ class MultigramIndex : public NGramInvertedIndex {
  public:
     MultigramIndex() = delete;
     MultigramIndex(const MultigramIndex &&) = delete;
-    MultigramIndex(const std::vector<std::string> & dataset, double sel_threshold)
+    MultigramIndex(const Dataset & dataset, double sel_threshold)
       : NGramInvertedIndex(dataset), k_threshold_(sel_threshold), k_tag_("") {}
     
     ~MultigramIndex() {}
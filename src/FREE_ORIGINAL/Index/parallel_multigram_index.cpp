@@ -100,10 +100,10 @@ void free_original_index::ParallelMultigramIndex::get_kgrams_not_indexed(size_t
         auto line = k_dataset_[i];
         std::unordered_set<std::string> loc_visited_kgrams;
         for (size_t i = 0; i+k <= line.size(); i++) {
-            auto curr_kgram = line.substr(i, k);
+            std::string curr_kgram(line.substr(i, k));
             // not seen in current line and in expand
             if (loc_visited_kgrams.find(curr_kgram) == loc_visited_kgrams.end() &&
-                expand.find(line.substr(i, k-1)) != expand.end()) {
+                expand.find(std::string(line.substr(i, k-1))) != expand.end()) {
                 add_or_inc_w_lock(kgrams, curr_kgram, loc_visited_kgrams);
             }
         }
@@ -320,7 +320,7 @@ void free_original_index::ParallelMultigramIndex::kgrams_in_line(int upper_n, si
         auto line = k_dataset_[i];
         for (auto pos = 0; pos < line.size(); pos++) {
             for (auto k = 1; k <= upper_n && k + pos <= line.size(); k++) {
-                const auto curr_substr = line.substr(pos, k);
+                const std::string curr_substr(line.substr(pos, k));
                 if (k_index_keys_.find(curr_substr) != k_index_keys_.end() &&
                     (local_idx[curr_substr].size() == 0 ||
                      local_idx[curr_substr].back() < i)
@@ -17,7 +17,7 @@ class ParallelMultigramIndex : public MultigramIndex {
  public:
     ParallelMultigramIndex() = delete;
     ParallelMultigramIndex(const ParallelMultigramIndex &&) = delete;
-    ParallelMultigramIndex(const std::vector<std::string> & dataset, 
+    ParallelMultigramIndex(const Dataset & dataset, 
                    double sel_threshold, int num_threads)
       : MultigramIndex(dataset, sel_threshold) {
             k_tag_ = "-parallel";
@@ -17,6 +17,7 @@ void free_original_index::PresufShell::build_index(int upper_n) {
 
     start = std::chrono::high_resolution_clock::now();
     fill_posting(upper_n);
+    finalize_index();
     auto build_time = std::chrono::duration_cast<std::chrono::duration<double>>(
         std::chrono::high_resolution_clock::now() - start).count();
     std::cout << "Index Building End in " << build_time << std::endl;
@@ -81,7 +81,7 @@ class QueryMatcher {
                        std::pair<std::unique_ptr<QueryParser>, std::shared_ptr<RE2>>> reg_evals_;
 
     long match_one_helper(const std::unique_ptr<QueryParser> & parser, const std::shared_ptr<RE2> & regex) {
-        auto dataset = k_index_.get_dataset();
+        const auto & dataset = k_index_.get_dataset();
         long count = 0;
         std::vector<size_t> idx_list;
         bool helped = parser->get_index_by_plan(idx_list);
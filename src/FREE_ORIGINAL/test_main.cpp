@@ -81,7 +81,8 @@ void simple_index() {
         "5.fffff"
     });
 
-    auto pi = free_original_index::MultigramIndex(test_dataset, 1);
+    const Dataset dataset(test_dataset);
+    auto pi = free_original_index::MultigramIndex(dataset, 1);
 
     // try build index of uni and bigrams only
     pi.build_index(2);
@@ -117,7 +118,8 @@ void simple_index_threshold() {
         "5.fffff"
     });
 
-    auto pi = free_original_index::MultigramIndex(test_dataset, 0.9);
+    const Dataset dataset(test_dataset);
+    auto pi = free_original_index::MultigramIndex(dataset, 0.9);
 
     // try build index of uni and bigrams only
     pi.build_index(2);
@@ -151,7 +153,8 @@ void simple_presuf() {
         "5.fffff"
     });
 
-    auto pi = free_original_index::PresufShell(test_dataset, 0.9);
+    const Dataset dataset(test_dataset);
+    auto pi = free_original_index::PresufShell(dataset, 0.9);
 
     // try build index of uni and bigrams only
     pi.build_index(2);
@@ -187,7 +190,8 @@ void simple_multi_parallel() {
     double threshold;
     make_dataset_with_keys(test_keys, test_dataset, threshold);
 
-    auto pi = free_original_index::ParallelMultigramIndex(test_dataset, threshold, 4);
+    const Dataset dataset(test_dataset);
+    auto pi = free_original_index::ParallelMultigramIndex(dataset, threshold, 4);
     pi.build_index(5);
     pi.print_index();
 
@@ -210,7 +214,8 @@ void simple_find_keys() {
     double threshold;
     make_dataset_with_keys(test_keys, test_dataset, threshold);
 
-    auto pi = free_original_index::MultigramIndex(test_dataset, threshold);
+    const Dataset dataset(test_dataset);
+    auto pi = free_original_index::MultigramIndex(dataset, threshold);
     pi.build_index(5);
     pi.print_index();
 
@@ -233,7 +238,8 @@ void simple_query_parser() {
     double threshold;
     make_dataset_with_keys(test_keys, test_dataset, threshold);
 
-    auto pi = free_original_index::MultigramIndex(test_dataset, threshold);
+    const Dataset dataset(test_dataset);
+    auto pi = free_original_index::MultigramIndex(dataset, threshold);
     pi.build_index(5);
     pi.print_index();
 
@@ -262,7 +268,8 @@ void simple_query_plan_by_index() {
     double threshold;
     make_dataset_with_keys(test_keys, test_dataset, threshold);
 
-    auto pi = free_original_index::MultigramIndex(test_dataset, threshold);
+    const Dataset dataset(test_dataset);
+    auto pi = free_original_index::MultigramIndex(dataset, threshold);
     pi.build_index(5);
     
     std::string reg_query = "(Bill|William)(.*)Clinton";
@@ -281,7 +288,8 @@ void simple_query_plan_by_index() {
 
 void complex_query_parser_traffic() {
     std::vector<std::string> test_dataset;
-    auto pi = free_original_index::MultigramIndex(test_dataset, 1);
+    const Dataset dataset(test_dataset);
+    auto pi = free_original_index::MultigramIndex(dataset, 1);
 
     auto traffic_reg = read_file(kTrafficRegex);
     auto traffic_grams = literals_from_regexes(traffic_reg);
@@ -306,7 +314,8 @@ void complex_query_parser_traffic() {
 
 void complex_query_parser_webpages() {
     std::vector<std::string> test_dataset;
-    auto pi = free_original_index::MultigramIndex(test_dataset, 1);
+    const Dataset dataset(test_dataset);
+    auto pi = free_original_index::MultigramIndex(dataset, 1);
 
     auto web_reg = read_file(kWebRegexFree);
     auto web_grams = literals_from_regexes(web_reg);
@@ -353,7 +362,8 @@ void simple_lines_by_plan() {
     // test_dataset.push_back("Clinton");
     test_dataset.push_back("Bill.Clinton");
 
-    auto pi1 = free_original_index::MultigramIndex(test_dataset, threshold);
+    const Dataset dataset(test_dataset);
+    auto pi1 = free_original_index::MultigramIndex(dataset, threshold);
     pi1.build_index(5);
     pi1.print_index();
     std::string reg_query = "(Bill|William)(.*)Clinton";
@@ -370,7 +380,7 @@ void simple_lines_by_plan() {
     assert(helped1 && compare_lists(idx_list1, {455}) && 
            "Multigram: Line 455 Clinton should be the only result");
 
-    auto pi2 = free_original_index::PresufShell(test_dataset, threshold);
+    auto pi2 = free_original_index::PresufShell(dataset, threshold);
     pi2.build_index(5);
     pi2.print_index();
 
@@ -408,7 +418,8 @@ void simple_match_all() {
     }
     test_dataset.push_back("William");
     test_dataset.push_back("Bill.Clinton");
-    auto pi = free_original_index::MultigramIndex(test_dataset, threshold);
+    const Dataset dataset(test_dataset);
+    auto pi = free_original_index::MultigramIndex(dataset, threshold);
     pi.build_index(5);
     pi.print_index();
     std::vector<std::string> reg_query = {"(Bill|William)(.*)Clinton", "TDT"};
@@ -438,7 +449,8 @@ void simple_match_one() {
     }
     test_dataset.push_back("William");
     test_dataset.push_back("Bill.Clinton");
-    auto pi = free_original_index::MultigramIndex(test_dataset, threshold);
+    const Dataset dataset(test_dataset);
+    auto pi = free_original_index::MultigramIndex(dataset, threshold);
     pi.build_index(5);
     pi.print_index();
     std::vector<std::string> reg_query = {"(Bill|William)(.*)Clinton"};
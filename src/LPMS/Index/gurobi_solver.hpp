@@ -0,0 +1,86 @@
+#ifndef LPMS_INDEX_GUROBI_SOLVER_HPP_
+#define LPMS_INDEX_GUROBI_SOLVER_HPP_
+
+#ifdef LPMS_GUROBI
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <iostream>
+
+#include "gurobi_c++.h"
+
+#include "lp_solver.hpp"
+
+namespace lpms_index {
+
+// Solves the relaxation with Gurobi; one environment for all the levels
+class GurobiSolver : public LpSolver {
+ public:
+    explicit GurobiSolver(int num_threads = 1)
+      : env_(std::make_unique<GRBEnv>()),
+        num_threads_(num_threads) {}
+
+    bool solve(const CoveringLp & lp, std::vector<double> & x) override {
+        size_t num_vars = lp.num_vars;
+        size_t num_rows = lp.num_rows();
+        GRBVar * vars = nullptr;
+        bool solved = false;
+        try {
+            GRBModel model = GRBModel(*env_);
+            model.set(GRB_IntParam_OutputFlag, 0);
+            model.set(GRB_StringAttr_ModelName, "model");
+            model.set(GRB_IntParam_Threads, num_threads_);
+
+            std::vector<std::string> var_names(num_vars);
+            for (size_t j = 0; j < num_vars; j++) {
+                var_names[j] = "x_" + std::to_string(j);
+            }
+            // one call for all variables: lb 0, ub infinity, continuous
+            vars = model.addVars(nullptr, nullptr, lp.c.data(), nullptr,
+                                 var_names.data(), num_vars);
+
+            std::vector<GRBLinExpr> Ax(num_rows);
+            std::vector<char> senses(num_rows, GRB_GREATER_EQUAL);
+            std::vector<std::string> constr_names(num_rows);
+            std::vector<GRBVar> x_i;
+            for (size_t i = 0; i < num_rows; i++) {
+                x_i.clear();
+                for (size_t e = lp.row_begin[i]; e < lp.row_begin[i + 1]; e++) {
+                    x_i.push_back(vars[lp.cols[e]]);
+                }
+                Ax[i].addTerms(lp.vals.data() + lp.row_begin[i], x_i.data(), x_i.size());
+                constr_names[i] = "Ax_" + std::to_string(i);
+            }
+            // one call for all constraints Ax >= b
+            delete[] model.addConstrs(Ax.data(), senses.data(), lp.b.data(),
+                                      constr_names.data(), num_rows);
+
+            model.optimize();
+
+            x.resize(num_vars);
+            for (size_t j = 0; j < num_vars; j++) {
+                x[j] = vars[j].get(GRB_DoubleAttr_X);
+            }
+            solved = true;
+        } catch (const GRBException & e) {
+            std::cout << "Error code = " << e.getErrorCode() << std::endl;
+            std::cout << e.getMessage() << std::endl;
+        } catch (const std::exception & e2) {
+            std::cout << "Exception during optimization" << std::endl;
+            std::cout << e2.what() << std::endl;
+        }
+        delete[] vars;
+        return solved;
+    }
+
+ private:
+    std::unique_ptr<GRBEnv> env_;
+    const int num_threads_;
+};
+
+} // namespace lpms_index
+
+#endif // LPMS_GUROBI
+
+#endif // LPMS_INDEX_GUROBI_SOLVER_HPP_
@@ -0,0 +1,331 @@
+#ifndef LPMS_INDEX_LP_SOLVER_HPP_
+#define LPMS_INDEX_LP_SOLVER_HPP_
+
+#include <vector>
+#include <thread>
+#include <barrier>
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+#include <cstddef>
+
+namespace lpms_index {
+
+/**
+ * Covering LP of one LPMS level:
+ *   minimize c^T x  s.t.  A x >= b,  x >= 0
+ *   with c, A, b >= 0. A is kept row by row (CSR), a row per query.
+ */
+struct CoveringLp {
+    size_t num_vars = 0;
+    std::vector<double> c;
+    std::vector<size_t> row_begin{0};
+    std::vector<size_t> cols;
+    std::vector<double> vals;
+    std::vector<double> b;
+
+    size_t num_rows() const { return b.size(); }
+
+    // the row's entries are appended to cols / vals beforehand
+    void close_row(double b_i) {
+        b.push_back(b_i);
+        row_begin.push_back(cols.size());
+    }
+};
+
+/**
+ * Backend solving the relaxation of build_model. solve() fills x (size
+ *   num_vars) and returns false if it has no (optimal) solution, in which
+ *   case x holds whatever the backend got to, possibly nothing.
+ */
+class LpSolver {
+ public:
+    virtual ~LpSolver() {}
+    virtual bool solve(const CoveringLp & lp, std::vector<double> & x) = 0;
+};
+
+/**
+ * Built-in first-order solver: primal-dual hybrid gradient (Chambolle-Pock)
+ *   with the diagonal step sizes of Pock & Chambolle (2011),
+ *   tau_j = 1 / \sum_i A_ij and sigma_i = 1 / \sum_j A_ij, which need no
+ *   estimate of ||A||. Rows are first scaled by 1/b_i and columns by c_j,
+ *   giving min 1^T z s.t. M z >= 1, so the tolerances do not depend on
+ *   the record counts in A, b and c.
+ * An iteration is one product with M and one with M^T. Rows (for M z)
+ *   and columns (for M^T y, on a column-major copy) are split into
+ *   num_threads ranges of about the same number of nonzeros; every entry
+ *   of z and y is written by one thread in a fixed order, so the result
+ *   does not depend on the number of threads.
+ * Every k_check_every_ iterations the relative KKT error (primal and dual
+ *   infeasibility, duality gap) of the current point and of the average
+ *   since the last restart decide on a restart; solve() stops once it is
+ *   below tolerance, or after max_iteration.
+ */
+class PdhgSolver : public LpSolver {
+ public:
+    explicit PdhgSolver(int num_threads = 1,
+                        double tolerance = 1e-4,
+                        size_t max_iteration = 100000)
+      : num_threads_(std::max(1, num_threads)),
+        tolerance_(tolerance),
+        max_iteration_(max_iteration) {}
+
+    bool solve(const CoveringLp & lp, std::vector<double> & x) override {
+        const size_t n = lp.num_vars;
+        x.assign(n, 0);
+
+        // 1. normal form; rows with b_i <= 0 hold for every x >= 0
+        std::vector<double> col_scale(n);
+        for (size_t j = 0; j < n; j++) {
+            col_scale[j] = lp.c[j] > 0 ? lp.c[j] : 1;
+        }
+        std::vector<size_t> m_begin{0};
+        std::vector<size_t> m_cols;
+        std::vector<double> m_vals;
+        for (size_t i = 0; i < lp.num_rows(); i++) {
+            if (lp.b[i] <= 0) continue;
+            for (size_t e = lp.row_begin[i]; e < lp.row_begin[i + 1]; e++) {
+                if (lp.vals[e] <= 0) continue;
+                m_cols.push_back(lp.cols[e]);
+                m_vals.push_back(lp.vals[e] / (lp.b[i] * col_scale[lp.cols[e]]));
+            }
+            if (m_cols.size() == m_begin.back()) {
+                std::cerr << "PdhgSolver: row " << i << " cannot be covered" << std::endl;
+                return false;
+            }
+            m_begin.push_back(m_cols.size());
+        }
+        const size_t m = m_begin.size() - 1;
+        if (m == 0) return true;
+
+        // column-major copy of M
+        std::vector<size_t> t_begin(n + 1, 0);
+        for (auto j : m_cols) t_begin[j + 1]++;
+        for (size_t j = 0; j < n; j++) t_begin[j + 1] += t_begin[j];
+        std::vector<size_t> t_rows(m_cols.size());
+        std::vector<double> t_vals(m_cols.size());
+        {
+            std::vector<size_t> fill(t_begin.begin(), t_begin.end() - 1);
+            for (size_t i = 0; i < m; i++) {
+                for (size_t e = m_begin[i]; e < m_begin[i + 1]; e++) {
+                    size_t pos = fill[m_cols[e]]++;
+                    t_rows[pos] = i;
+                    t_vals[pos] = m_vals[e];
+                }
+            }
+        }
+
+        // 2. step sizes; a variable in no row stays 0
+        std::vector<double> c_hat(n), tau(n, 0), sigma(m);
+        for (size_t j = 0; j < n; j++) {
+            c_hat[j] = lp.c[j] > 0 ? 1 : 0;
+            double sum = 0;
+            for (size_t e = t_begin[j]; e < t_begin[j + 1]; e++) sum += t_vals[e];
+            if (sum > 0) tau[j] = 1 / sum;
+        }
+        for (size_t i = 0; i < m; i++) {
+            double sum = 0;
+            for (size_t e = m_begin[i]; e < m_begin[i + 1]; e++) sum += m_vals[e];
+            sigma[i] = 1 / sum;
+        }
+
+        // 3. iterate
+        std::vector<double> z(n, 0), z_sum(n, 0), z_last(n, 0), mty(n, 0), mty_avg(n, 0);
+        std::vector<double> y(m, 0), y_sum(m, 0), y_last(m, 0), mz(m, 0), mz_avg(m, 0);
+        auto row_split = split(m_begin);
+        auto col_split = split(t_begin);
+        double c_norm = 0;
+        for (auto c_j : c_hat) c_norm += c_j * c_j;
+        c_norm = std::sqrt(c_norm);
+
+        // relative KKT error of (z, y) given M z and M^T y
+        auto kkt = [&](const std::vector<double> & z_, const std::vector<double> & y_,
+                       const std::vector<double> & mz_, const std::vector<double> & mty_,
+                       double scale) {
+            double primal_res = 0, dual_res = 0;
+            double primal_obj = 0, dual_obj = 0;
+            for (size_t i = 0; i < m; i++) {
+                double r = std::max(0.0, 1 - mz_[i] * scale);
+                primal_res += r * r;
+                dual_obj += y_[i] * scale;
+            }
+            for (size_t j = 0; j < n; j++) {
+                double r = std::max(0.0, mty_[j] * scale - c_hat[j]);
+                dual_res += r * r;
+                primal_obj += c_hat[j] * z_[j] * scale;
+            }
+            primal_res = std::sqrt(primal_res) / (1 + std::sqrt(double(m)));
+            dual_res = std::sqrt(dual_res) / (1 + c_norm);
+            double gap = std::abs(primal_obj - dual_obj) / (1 + primal_obj + dual_obj);
+            return std::max({ primal_res, dual_res, gap });
+        };
+
+        double omega = 1;            // primal weight
+        size_t curr_it = 0;
+        size_t num_avg = 0;          // iterations summed since the last restart
+        size_t last_restart = 0;
+        double kkt_last_restart = kkt(z, y, mz, mty, 1);
+        double kkt_last_candidate = kkt_last_restart;
+        bool is_check = false;
+        bool restart = false;
+        bool to_avg = false;
+        bool done = false;
+        bool converged = false;
+
+        auto end_iteration = [&]() noexcept {
+            curr_it++;
+            num_avg++;
+            is_check = curr_it % k_check_every_ == 0 || curr_it >= max_iteration_;
+        };
+        // adaptive restart of PDLP (Applegate et al., 2021): restart from the
+        //   average or the current point, whichever has the lower KKT error,
+        //   once it is well below the error at the last restart
+        auto end_check = [&]() noexcept {
+            double avg_scale = 1.0 / num_avg;
+            double kkt_curr = kkt(z, y, mz, mty, 1);
+            double kkt_avg = kkt(z_sum, y_sum, mz_avg, mty_avg, avg_scale);
+            to_avg = kkt_avg < kkt_curr;
+            double kkt_candidate = std::min(kkt_avg, kkt_curr);
+            if (kkt_candidate <= tolerance_ || curr_it >= max_iteration_) {
+                converged = kkt_candidate <= tolerance_;
+                done = true;
+                restart = true;
+                return;
+            }
+            restart = kkt_candidate <= 0.2 * kkt_last_restart ||
+                (kkt_candidate <= 0.8 * kkt_last_restart && kkt_candidate > kkt_last_candidate) ||
+                curr_it - last_restart >= 0.36 * curr_it;
+            kkt_last_candidate = kkt_candidate;
+            if (!restart) return;
+            kkt_last_restart = kkt_candidate;
+            kkt_last_candidate = kkt_candidate;
+            last_restart = curr_it;
+            // primal weight: balance the distance moved by z and by y
+            double dz = 0, dy = 0;
+            for (size_t j = 0; j < n; j++) {
+                double d = (to_avg ? z_sum[j] * avg_scale : z[j]) - z_last[j];
+                dz += d * d;
+            }
+            for (size_t i = 0; i < m; i++) {
+                double d = (to_avg ? y_sum[i] * avg_scale : y[i]) - y_last[i];
+                dy += d * d;
+            }
+            if (dz > 1e-20 && dy > 1e-20) {
+                omega = std::exp(0.5 * std::log(std::sqrt(dy / dz)) + 0.5 * std::log(omega));
+            }
+        };
+        auto end_restart = [&]() noexcept {
+            num_avg = 0;
+        };
+
+        std::barrier sync_iteration(num_threads_, end_iteration);
+        std::barrier sync_check(num_threads_, end_check);
+        std::barrier sync_restart(num_threads_, end_restart);
+        std::barrier sync(num_threads_);
+        auto work = [&](size_t t) {
+            const size_t col_lo = col_split[t], col_hi = col_split[t + 1];
+            const size_t row_lo = row_split[t], row_hi = row_split[t + 1];
+            while (!done) {
+                // z = max(0, z - tau / omega (c - M^T y))
+                for (size_t j = col_lo; j < col_hi; j++) {
+                    double sum = 0;
+                    for (size_t e = t_begin[j]; e < t_begin[j + 1]; e++) {
+                        sum += t_vals[e] * y[t_rows[e]];
+                    }
+                    mty[j] = sum;
+                    z[j] = std::max(0.0, z[j] - tau[j] / omega * (c_hat[j] - sum));
+                    z_sum[j] += z[j];
+                }
+                sync.arrive_and_wait();
+                // y = max(0, y + sigma omega (1 - M (2 z_new - z_old)))
+                for (size_t i = row_lo; i < row_hi; i++) {
+                    double sum = 0;
+                    for (size_t e = m_begin[i]; e < m_begin[i + 1]; e++) {
+                        sum += m_vals[e] * z[m_cols[e]];
+                    }
+                    y[i] = std::max(0.0, y[i] + sigma[i] * omega * (1 - (2 * sum - mz[i])));
+                    mz[i] = sum;
+                    y_sum[i] += y[i];
+                }
+                sync_iteration.arrive_and_wait();
+                if (!is_check) continue;
+
+                // M^T y of the current y, and M, M^T of the (unscaled) averages
+                for (size_t j = col_lo; j < col_hi; j++) {
+                    double sum = 0, sum_avg = 0;
+                    for (size_t e = t_begin[j]; e < t_begin[j + 1]; e++) {
+                        sum += t_vals[e] * y[t_rows[e]];
+                        sum_avg += t_vals[e] * y_sum[t_rows[e]];
+                    }
+                    mty[j] = sum;
+                    mty_avg[j] = sum_avg;
+                }
+                for (size_t i = row_lo; i < row_hi; i++) {
+                    double sum = 0;
+                    for (size_t e = m_begin[i]; e < m_begin[i + 1]; e++) {
+                        sum += m_vals[e] * z_sum[m_cols[e]];
+                    }
+                    mz_avg[i] = sum;
+                }
+                sync_check.arrive_and_wait();
+                if (!restart) continue;
+
+                const double avg_scale = 1.0 / num_avg;
+                for (size_t j = col_lo; j < col_hi; j++) {
+                    if (to_avg) z[j] = z_sum[j] * avg_scale;
+                    z_last[j] = z[j];
+                    z_sum[j] = 0;
+                }
+                for (size_t i = row_lo; i < row_hi; i++) {
+                    if (to_avg) {
+                        y[i] = y_sum[i] * avg_scale;
+                        mz[i] = mz_avg[i] * avg_scale;
+                    }
+                    y_last[i] = y[i];
+                    y_sum[i] = 0;
+                }
+                sync_restart.arrive_and_wait();
+            }
+        };
+        std::vector<std::thread> threads;
+        for (size_t t = 1; t < num_threads_; t++) {
+            threads.push_back(std::thread(work, t));
+        }
+        work(0);
+        for (auto & th : threads) {
+            th.join();
+        }
+
+        for (size_t j = 0; j < n; j++) {
+            x[j] = z[j] / col_scale[j];
+        }
+        if (!converged) {
+            std::cerr << "PdhgSolver: no convergence in " << max_iteration_
+                      << " iterations" << std::endl;
+        }
+        return converged;
+    }
+
+ private:
+    static constexpr size_t k_check_every_ = 64;
+    const size_t num_threads_;
+    const double tolerance_;
+    const size_t max_iteration_;
+
+    // num_threads_ + 1 bounds of ranges with about the same number of nonzeros
+    std::vector<size_t> split(const std::vector<size_t> & begin) const {
+        size_t num = begin.size() - 1;
+        std::vector<size_t> bounds{0};
+        for (size_t t = 1; t < num_threads_; t++) {
+            size_t target = begin.back() * t / num_threads_;
+            size_t at = std::lower_bound(begin.begin(), begin.end(), target) - begin.begin();
+            bounds.push_back(std::clamp(at, bounds.back(), num));
+        }
+        bounds.push_back(num);
+        return bounds;
+    }
+};
+
+} // namespace lpms_index
+
+#endif // LPMS_INDEX_LP_SOLVER_HPP_
@@ -1,5 +1,7 @@
 #include <exception>
 #include <cassert>
+#include <thread>
+#include <string_view>
 
 #include "lpms.hpp"
 #include "../../utils/utils.hpp"
@@ -38,25 +40,145 @@ static void insert_or_increment(std::unordered_map<size_t, long double> & kgrams
     visited_kgrams.insert(key);
 }
 
+/**
+ * @brief Grams of one range of records; ids are local to the range and
+ *        follow the first occurrence, postings[id] holds the records of
+ *        the range containing the gram, ascending and once each
+ */
+template <typename T>
+struct RangeGrams {
+    std::unordered_map<T, size_t> ids;
+    std::vector<T> grams;
+    std::vector<std::vector<size_t>> postings;
+    std::vector<std::vector<size_t>> partitions;  // local ids by hash partition
+
+    void add(T gram, size_t r) {
+        auto [it, inserted] = ids.try_emplace(gram, grams.size());
+        if (inserted) {
+            grams.push_back(gram);
+            postings.emplace_back();
+        }
+        auto & posting = postings[it->second];
+        if (posting.empty() || posting.back() != r) {
+            posting.push_back(r);
+        }
+    }
+};
+
+/**
+ * @brief Scan the records on num_threads threads, each over a contiguous
+ *        range, and merge the grams of the ranges into count / grams /
+ *        gr_map (expected empty) with the ids and posting lists a single
+ *        scan in record order gives: the grams of range t not in any
+ *        range before t take the next ids in their local order, and the
+ *        posting lists are the ranges' lists concatenated in range order.
+ *        The merge is split by gram hash, so each partition finds the
+ *        occurrences of its own grams across the ranges in parallel.
+ * @param scan scan(r, range) adds the grams of record r to range
+ */
+template <typename T, typename K, class Scan>
+static void scan_and_merge(size_t num_records, int thread_count, Scan && scan,
+                           std::unordered_map<size_t, long double> & count,
+                           std::unordered_map<K, size_t> & grams,
+                           std::vector<std::vector<size_t>> & gr_map) {
+    size_t num_threads = std::min<size_t>(std::max(1, thread_count), std::max<size_t>(1, num_records));
+    auto run = [num_threads](auto && f) {
+        std::vector<std::thread> threads;
+        for (size_t t = 1; t < num_threads; t++) {
+            threads.push_back(std::thread(f, t));
+        }
+        f(0);
+        for (auto & th : threads) {
+            th.join();
+        }
+    };
+
+    // 1. scan the ranges and bucket their grams by hash
+    std::vector<RangeGrams<T>> ranges(num_threads);
+    size_t range_size = (num_records + num_threads - 1) / num_threads;
+    run([&](size_t t) {
+        auto & range = ranges[t];
+        size_t end = std::min((t + 1) * range_size, num_records);
+        for (size_t r = std::min(t * range_size, num_records); r < end; r++) {
+            scan(r, range);
+        }
+        range.partitions.resize(num_threads);
+        for (size_t l = 0; l < range.grams.size(); l++) {
+            range.partitions[std::hash<T>()(range.grams[l]) % num_threads].push_back(l);
+        }
+    });
+
+    // 2. per partition, the occurrences (range, local id) of each gram in
+    //    range order; first[t][l] is the first occurrence of gram l of range t
+    using occurrence = std::pair<size_t, size_t>;
+    std::vector<std::vector<std::vector<occurrence>>> occurrences(num_threads);
+    std::vector<std::vector<occurrence>> first(num_threads);
+    for (size_t t = 0; t < num_threads; t++) {
+        first[t].resize(ranges[t].grams.size());
+    }
+    run([&](size_t p) {
+        std::unordered_map<T, size_t> index;
+        for (size_t t = 0; t < num_threads; t++) {
+            for (auto l : ranges[t].partitions[p]) {
+                auto [it, inserted] = index.try_emplace(ranges[t].grams[l], occurrences[p].size());
+                if (inserted) {
+                    occurrences[p].emplace_back();
+                }
+                occurrences[p][it->second].push_back({t, l});
+                first[t][l] = occurrences[p][it->second].front();
+            }
+        }
+    });
+
+    // 3. global ids in order of first occurrence
+    std::vector<std::vector<size_t>> ids(num_threads);
+    size_t num_grams = 0;
+    for (size_t t = 0; t < num_threads; t++) {
+        ids[t].resize(ranges[t].grams.size());
+        for (size_t l = 0; l < ids[t].size(); l++) {
+            auto [first_t, first_l] = first[t][l];
+            ids[t][l] = first_t == t ? num_grams++ : ids[first_t][first_l];
+        }
+    }
+
+    // 4. concatenate the posting lists, each partition its own grams
+    gr_map.resize(num_grams);
+    run([&](size_t p) {
+        for (const auto & occ : occurrences[p]) {
+            auto & posting = gr_map[ids[occ.front().first][occ.front().second]];
+            size_t size = 0;
+            for (auto [t, l] : occ) {
+                size += ranges[t].postings[l].size();
+            }
+            posting.reserve(size);
+            for (auto [t, l] : occ) {
+                const auto & local = ranges[t].postings[l];
+                posting.insert(posting.end(), local.begin(), local.end());
+            }
+        }
+    });
+
+    count.reserve(num_grams);
+    grams.reserve(num_grams);
+    for (size_t t = 0; t < num_threads; t++) {
+        for (size_t l = 0; l < ids[t].size(); l++) {
+            if (first[t][l].first != t) continue;
+            grams.insert({ K(ranges[t].grams[l]), ids[t][l] });
+            count.insert({ ids[t][l], gr_map[ids[t][l]].size() });
+        }
+    }
+}
+
 void lpms_index::LpmsIndex::get_unigram_r(
         std::unordered_map<size_t, long double> & uni_count,
         std::unordered_map<char, size_t> & unigrams,
         std::vector<std::vector<size_t>> & uni_gr_map) {
-    for (size_t r = 0; r < k_dataset_size_; r++) {
-        auto line = k_dataset_[r];
-        std::unordered_set<char> visited_unigrams;
-        for (size_t i = 0; i < line.size(); i++) {
-            char c = line.at(i);
-            if (visited_unigrams.find(c) == visited_unigrams.end()) {
-                insert_or_increment(uni_count, c, visited_unigrams, unigrams);
-                if (uni_count.size() > uni_gr_map.size()) {
-                    uni_gr_map.push_back(std::vector<size_t>{r});
-                } else {
-                    uni_gr_map[unigrams.at(c)].push_back(r);
-                }
+    scan_and_merge<char>(k_dataset_size_, thread_count_,
+        [this](size_t r, RangeGrams<char> & range) {
+            for (char c : k_dataset_[r]) {
+                range.add(c, r);
             }
-        }
-    }
+        }, uni_count, unigrams, uni_gr_map);
 }
 
 void get_unigram_q(const std::vector<std::vector<std::string>> & q_lits, 
@@ -85,24 +207,18 @@ void lpms_index::LpmsIndex::get_kgrams_r(
         std::vector<std::vector<size_t>> & gr_map,
         const std::unordered_set<std::string> & expand, size_t k) {
     // get all grams whose prefix in expand
-    for (size_t r = 0; r < k_dataset_size_; r++) {
-        auto line = k_dataset_[r];
-        gram_set visited_kgrams;
-        for (size_t i = 0; i+k <= line.size(); i++) {
-            auto curr_kgram = line.substr(i, k);
-            // not seen in current line and in expand
-            if (visited_kgrams.find(curr_kgram) == visited_kgrams.end() &&
-                    expand.find(line.substr(i, k-1)) != expand.end()) {
-                insert_or_increment(r_count, curr_kgram, visited_kgrams, kgrams);
-                if (r_count.size() > gr_map.size()) {
-                    gr_map.push_back(std::vector<size_t>{r});
-                } else {
-                    assert(gr_map.size() > kgrams.at(curr_kgram) && "line 103 gr_map size");
-                    gr_map[kgrams.at(curr_kgram)].push_back(r);
+    // Note: grams are views of the records until merged, so the scan
+    //    allocates no string per position
+    std::unordered_set<std::string_view> expand_views(expand.begin(), expand.end());
+    scan_and_merge<std::string_view>(k_dataset_size_, thread_count_,
+        [&](size_t r, RangeGrams<std::string_view> & range) {
+            auto line = k_dataset_[r];
+            for (size_t i = 0; i+k <= line.size(); i++) {
+                if (expand_views.contains(line.substr(i, k-1))) {
+                    range.add(line.substr(i, k), r);
                 }
             }
-        }
-    }
+        }, r_count, kgrams, gr_map);
 } 
 
 void get_kgrams_q(const std::vector<std::vector<std::string>> & q_lits,
@@ -120,7 +236,7 @@ void get_kgrams_q(const std::vector<std::vector<std::string>> & q_lits,
                 if (visited_kgrams.find(curr_kgram) == visited_kgrams.end() &&
                         expand.find(lit.substr(i, k-1)) != expand.end()) {
                     insert_or_increment(q_count, curr_kgram, visited_kgrams, kgrams);
-                    assert(qg_map.size() > kgrams.at(curr_kgram) && "line 124 gr_map size");
+                    assert(qg_map.size() > q && "qg_map size <= q");
                     qg_map[q].insert(kgrams.at(curr_kgram));
                 }            
             }
@@ -140,120 +256,109 @@ std::vector<bool> lpms_index::LpmsIndex::build_model(size_t k,
         const std::unordered_map<size_t, long double> & r_count, 
         const std::unordered_map<size_t, long double> & q_count, 
         const std::vector<std::set<size_t>> & qg_map,
-        GRBEnv* env) {
-    GRBVar* x = 0;
-
+        LpSolver & solver) {
     size_t num_grams = r_count.size();
     size_t num_queries = qg_map.size();
     std::vector<bool> x_result(num_grams, false);
 
-    try {
-        // Model
-        GRBModel model = GRBModel(*env);
-        model.set(GRB_IntParam_OutputFlag, 0);
-        model.set(GRB_StringAttr_ModelName, "model");
-        model.set(GRB_IntParam_Threads, thread_count_);
-
-        // minimize \sum_{g \in G} c_g x_g ; x \in {0, 1}
-        // Gurobi by default minimize the objective
-
-        // 5. populate vector c where c_g is 
-        //    (r_count of g) / (|g| * q_count of g) 
-        //    c length num_gram
-        // Note: Definition of c in Section 3.1, formulae (5)
-        x = model.addVars(num_grams, GRB_CONTINUOUS);
-        double smax = 0;
-        double smin = k_dataset_size_;
-        for (const auto & [g_idx, curr_r_count] : r_count) {
-            long double curr_q_count = 0;
-            if (q_count.contains(g_idx)) {
-                curr_q_count = q_count.at(g_idx); 
-            }
-            double c_g = (curr_r_count / k) * curr_q_count;
-            x[g_idx].set(GRB_DoubleAttr_Obj, c_g);
-            x[g_idx].set(GRB_StringAttr_VarName, "x_" + std::to_string(g_idx));
-            if (curr_r_count > smax) smax = curr_r_count;
-            if (curr_r_count < smin) smin = curr_r_count;
+    // minimize \sum_{g \in G} c_g x_g ; x \in {0, 1}, relaxed to x >= 0
+    CoveringLp lp;
+    lp.num_vars = num_grams;
+
+    // 5. populate vector c where c_g is 
+    //    (r_count of g) / (|g| * q_count of g) 
+    //    c length num_gram
+    // Note: Definition of c in Section 3.1, formulae (5)
+    lp.c.assign(num_grams, 0);
+    double smax = 0;
+    double smin = k_dataset_size_;
+    for (const auto & [g_idx, curr_r_count] : r_count) {
+        long double curr_q_count = 0;
+        if (q_count.contains(g_idx)) {
+            curr_q_count = q_count.at(g_idx); 
         }
+        lp.c[g_idx] = (curr_r_count / k) * curr_q_count;
+        if (curr_r_count > smax) smax = curr_r_count;
+        if (curr_r_count < smin) smin = curr_r_count;
+    }
 
-        double mstar = 0;
-        // qg_map : key: q; value: set of g in q
-        for (size_t q_idx = 0; q_idx < num_queries; ++q_idx) {
-            auto curr_grams_in_q = qg_map[q_idx];
-            size_t b_q = k_dataset_size_;
-            if (curr_grams_in_q.empty()) {
-                b_q = 0;
-            } else {
-                if (curr_grams_in_q.size() > mstar) mstar = curr_grams_in_q.size();
-                // 4. populate vector b, where b_q denote the smallest
-                //    r_count among all grams in query q; b length num_query
-                // Note: Definition of b in Section 3.1, formulae (3)
-                for (const auto & curr_gram_idx : curr_grams_in_q) {
-                    long double curr_r_count = 0;
-                    if (r_count.contains(curr_gram_idx)) {
-                        curr_r_count = q_count.at(curr_gram_idx);
-                    }
-                    if (curr_r_count < b_q) {
-                        b_q = curr_r_count;
-                    }
+    double mstar = 0;
+    // qg_map : key: q; value: set of g in q
+    for (size_t q_idx = 0; q_idx < num_queries; ++q_idx) {
+        const auto & curr_grams_in_q = qg_map[q_idx];
+        size_t b_q = k_dataset_size_;
+        if (curr_grams_in_q.empty()) {
+            b_q = 0;
+        } else {
+            if (curr_grams_in_q.size() > mstar) mstar = curr_grams_in_q.size();
+            // 4. populate vector b, where b_q denote the smallest
+            //    r_count among all grams in query q; b length num_query
+            // Note: Definition of b in Section 3.1, formulae (3)
+            for (const auto & curr_gram_idx : curr_grams_in_q) {
+                long double curr_r_count = 0;
+                if (r_count.contains(curr_gram_idx)) {
+                    curr_r_count = q_count.at(curr_gram_idx);
                 }
-            }
-            // 3. populate matrix A, where A_{q, g} denote 
-            //    r_count of g if g \in q; A has size num_query * num_gram
-            // Note: Definition of A in Section 3.1, formulae (2)
-            // Note: so whenever some gram g is in some query q, 
-            //    the value of the matrix entry is the count of 
-            //    number of records in the whole dataset that 
-            //    contains this gram
-            GRBLinExpr Ax_q = 0;
-
-            // This should follow the order of the temp vector grams_ordered!
-            for (size_t g_inner_idx = 0; g_inner_idx < num_grams; ++g_inner_idx) {
-                size_t A_qg = 0;
-
-                if (r_count.contains(g_inner_idx) && qg_map[q_idx].contains(g_inner_idx)) {
-                    A_qg = r_count.at(g_inner_idx);
+                if (curr_r_count < b_q) {
+                    b_q = curr_r_count;
                 }
-                Ax_q += A_qg*x[g_inner_idx];
             }
-            
-            model.addConstr(Ax_q >= b_q, "Ax_" + std::to_string(q_idx));
         }
+        // 3. populate matrix A, where A_{q, g} denote 
+        //    r_count of g if g \in q; A has size num_query * num_gram
+        // Note: Definition of A in Section 3.1, formulae (2)
+        // Note: so whenever some gram g is in some query q, 
+        //    the value of the matrix entry is the count of 
+        //    number of records in the whole dataset that 
+        //    contains this gram
+        // Note: A is sparse; row q only has the grams of q that
+        //    occur in the dataset, so it is built from qg_map[q]
+        //    rather than by probing every gram
+        for (const auto & g_idx : curr_grams_in_q) {
+            if (r_count.contains(g_idx)) {
+                lp.cols.push_back(g_idx);
+                lp.vals.push_back(r_count.at(g_idx));
+            }
+        }
+        // Note: no gram of q is in the dataset, so no x covers
+        //    the row; it is left out instead of making the LP infeasible
+        if (lp.cols.size() == lp.row_begin.back()) b_q = 0;
+        lp.close_row(b_q);
+    }
 
-        // Solve
-        model.optimize();
-
-        // 6. use lp solver with deterministic relaxation 
-        //    or random rounding to find x
-        switch (k_relaxation_type_) {
-            case kDeterministic: {
-                double threshold = (smax*mstar > 0) ? smin/(smax*mstar) : 1;
-                for (size_t g_idx = 0; g_idx < num_grams; ++g_idx) {
-                    if (x[g_idx].get(GRB_DoubleAttr_X) > threshold) {
-                        x_result[g_idx] = true;
-                    }
+    // Solve
+    std::vector<double> x;
+    if (!solver.solve(lp, x)) {
+        std::cerr << "LPMS: relaxation of level " << k << " not solved" << std::endl;
+    }
+    x.resize(num_grams, 0);
+
+    // 6. use lp solver with deterministic relaxation 
+    //    or random rounding to find x
+    switch (k_relaxation_type_) {
+        case kDeterministic: {
+            double threshold = (smax*mstar > 0) ? smin/(smax*mstar) : 1;
+            for (size_t g_idx = 0; g_idx < num_grams; ++g_idx) {
+                if (x[g_idx] > threshold) {
+                    x_result[g_idx] = true;
                 }
-                break;
             }
-            case kRandomized:
-                for (size_t g_idx = 0; g_idx < num_grams; ++g_idx) {
-                    x_result[g_idx] = (std::rand() / double(RAND_MAX)) < (x[g_idx].get(GRB_DoubleAttr_X));
-                }
-                break;
+            break;
         }
-    } catch (GRBException e) {
-        std::cout << "Error code = " << e.getErrorCode() << std::endl;
-        std::cout << e.getMessage() << std::endl;
-    } catch (std::exception e2) {
-        std::cout << "Exception during optimization" << std::endl;
-        std::cout << e2.what() << std::endl;
+        case kRandomized:
+            for (size_t g_idx = 0; g_idx < num_grams; ++g_idx) {
+                x_result[g_idx] = (std::rand() / double(RAND_MAX)) < x[g_idx];
+            }
+            break;
+        case kInvalid:
+            std::cerr << "LPMS: invalid relaxation type, no gram selected" << std::endl;
+            break;
     }
-    delete x;
     return x_result;
 }
 
 void lpms_index::LpmsIndex::uni_special(std::unordered_set<std::string> & expand, 
-        const std::vector<std::vector<std::string>> & query_literals, GRBEnv * env) {
+        const std::vector<std::vector<std::string>> & query_literals, LpSolver & solver) {
     std::unordered_map<size_t, long double> unigrams_r_count;
     std::unordered_map<char, size_t> unigrams; 
     std::vector<std::vector<size_t>> uni_gr_map;
@@ -265,14 +370,18 @@ void lpms_index::LpmsIndex::uni_special(std::unordered_set<std::string> & expand
     get_unigram_q(query_literals, unigrams_q_count, unigrams, uni_qg_map);
 
     // 3. build matrix A for unigram
-    std::vector<bool> mask_uni = build_model(1, unigrams_r_count, unigrams_q_count, uni_qg_map, env);
+    std::vector<bool> mask_uni = build_model(1, unigrams_r_count, unigrams_q_count, uni_qg_map, solver);
 
     for (const auto & [c, idx] : unigrams) {
+        // Note: chars only in the queries have no variable in the model
+        //    and no line to index, nor to extend
+        if (idx >= mask_uni.size()) continue;
         std::string curr_kgram = std::string(1, c);
         if (mask_uni[idx]) {
             // 7. Move all multigtams in the children set
             //    whose associated value in x is 1 to G (the index)
             k_index_keys_.insert(curr_kgram); 
+            k_keys_dirty_ = true;
             k_index_.insert({ curr_kgram, uni_gr_map.at(idx) });
             if (k_index_keys_.size() >= key_upper_bound_) break;
         } else {
@@ -285,14 +394,19 @@ void lpms_index::LpmsIndex::uni_special(std::unordered_set<std::string> & expand
 
 // Algorithm 1: LPMS multigram selection algorithm
 void lpms_index::LpmsIndex::select_grams(int upper_n) {
-    GRBEnv* env = new GRBEnv();
-    // env->set("OutputFlag", 0);
+    if (!lp_solver_) {
+#ifdef LPMS_GUROBI
+        lp_solver_ = std::make_unique<GurobiSolver>(thread_count_);
+#else
+        lp_solver_ = std::make_unique<PdhgSolver>(thread_count_);
+#endif
+    }
 
     // Initialize a empty expand set
     gram_set expand; // stores useless prefix
     auto query_literals = get_query_literals();
 
-    uni_special(expand, query_literals, env);
+    uni_special(expand, query_literals, *lp_solver_);
     size_t k = 2;
 
     // 9. stop until expand set empty.
@@ -320,15 +434,19 @@ void lpms_index::LpmsIndex::select_grams(int upper_n) {
 
         if (q_count.empty()) break;
         
-        std::vector<bool> mask = build_model(k, r_count, q_count, qg_map, env);
+        std::vector<bool> mask = build_model(k, r_count, q_count, qg_map, *lp_solver_);
         
         decltype(expand)().swap(expand);
 
         for (const auto & [curr_kgram, idx] : kgrams) {
+            // Note: grams only in the queries have no variable in the model
+            //    and no line to index, nor to extend
+            if (idx >= mask.size()) continue;
             if (mask[idx]) {
                 // 7. Move all multigtams in the children set
                 //    whose associated value in x is 1 to G (the index)
                 k_index_keys_.insert(curr_kgram); 
+                k_keys_dirty_ = true;
                 assert(gr_map.size() > idx && "line 324 gr_map size < idx");
                 k_index_[curr_kgram] = gr_map.at(idx);
                 if (k_index_keys_.size() >= key_upper_bound_) goto END_SELECT;
@@ -341,12 +459,12 @@ void lpms_index::LpmsIndex::select_grams(int upper_n) {
         k++;
     }
     END_SELECT:;
-    delete env;
 }
 
 void lpms_index::LpmsIndex::build_index(int upper_n) {
     auto start = std::chrono::high_resolution_clock::now();
     select_grams(upper_n);
+    finalize_index();
     auto elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(
         std::chrono::high_resolution_clock::now() - start).count();
     std::cout << "Select Grams and Index Building End in " << elapsed << " s" << std::endl;
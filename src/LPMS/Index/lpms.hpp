@@ -1,9 +1,11 @@
 #ifndef LPMS_INDEX_LPMS_INDEX_HPP_
 #define LPMS_INDEX_LPMS_INDEX_HPP_
 
-#include "gurobi_c++.h"
+#include <memory>
 
 #include "../../ngram_inverted_index.hpp"
+#include "lp_solver.hpp"
+#include "gurobi_solver.hpp"
 
 namespace lpms_index {
 
@@ -15,7 +17,7 @@ class LpmsIndex : public NGramInvertedIndex {
     LpmsIndex() = delete;
     LpmsIndex(const LpmsIndex &&) = delete;
 
-    LpmsIndex(const std::vector<std::string> & dataset, 
+    LpmsIndex(const Dataset & dataset, 
               const std::vector<std::string> & queries,
               relaxation_type re_type = kDeterministic)
       : NGramInvertedIndex(dataset, queries),
@@ -23,7 +25,7 @@ class LpmsIndex : public NGramInvertedIndex {
             thread_count_ = 1;
         }
 
-    LpmsIndex(const std::vector<std::string> & dataset, 
+    LpmsIndex(const Dataset & dataset, 
               const std::vector<std::string> & queries,
               int thread_count, 
               relaxation_type re_type = kDeterministic)
@@ -35,11 +37,18 @@ class LpmsIndex : public NGramInvertedIndex {
 
     void build_index(int upper_n=-1) override;
 
+    // backend of the relaxation; by default Gurobi when built with
+    //   LP_SOLVER=gurobi, otherwise the built-in PdhgSolver
+    void set_lp_solver(std::unique_ptr<LpSolver> solver) {
+        lp_solver_ = std::move(solver);
+    }
+
  protected:
     void select_grams(int upper_n=-1) override;
     
  private:
     const relaxation_type k_relaxation_type_;
+    std::unique_ptr<LpSolver> lp_solver_;
 
     void get_kgrams_r(std::unordered_map<size_t, long double> & r_count,
         std::unordered_map<std::string, size_t> & kgrams,
@@ -52,12 +61,12 @@ class LpmsIndex : public NGramInvertedIndex {
 
     void uni_special(std::unordered_set<std::string> & expand, 
         const std::vector<std::vector<std::string>> & query_literals, 
-        GRBEnv * env);
+        LpSolver & solver);
 
     std::vector<bool> build_model(size_t k,
         const std::unordered_map<size_t, long double> & r_count, 
         const std::unordered_map<size_t, long double> & q_count, 
-        const std::vector<std::set<size_t>> & qg_map, GRBEnv * env);    
+        const std::vector<std::set<size_t>> & qg_map, LpSolver & solver);    
 
 };
 
@@ -3,6 +3,10 @@
 #include "../simple_query_matcher.hpp"
 
 #include <cassert>
+#include <cmath>
+#include <random>
+#include <set>
+#include <algorithm>
 #include <unordered_set>
 
 const double k_number_repeat = 10;
@@ -49,7 +53,8 @@ void simple_index() {
         "kane",
     });;
 
-    auto pi = lpms_index::LpmsIndex(test_dataset, test_query);
+    const Dataset dataset(test_dataset);
+    auto pi = lpms_index::LpmsIndex(dataset, test_query);
 
     pi.build_index();
     pi.print_index();
@@ -69,7 +74,8 @@ void simple_index_radonmized() {
         "kane",
     });;
 
-    auto pi2 = lpms_index::LpmsIndex(test_dataset, test_query, 
+    const Dataset dataset(test_dataset);
+    auto pi2 = lpms_index::LpmsIndex(dataset, test_query, 
         lpms_index::relaxation_type::kRandomized);
     pi2.build_index();
     pi2.print_index();
@@ -97,7 +103,8 @@ void simple_matcher() {
         "ka" //12
     });;
 
-    auto pi = lpms_index::LpmsIndex(test_dataset, test_query);
+    const Dataset dataset(test_dataset);
+    auto pi = lpms_index::LpmsIndex(dataset, test_query);
     pi.build_index();
     pi.print_index();
     auto matcher = SimpleQueryMatcher(pi);
@@ -118,7 +125,8 @@ void longer_matcher() {
     double threshold;
     make_dataset_with_keys(test_query, test_dataset, threshold);
 
-    auto pi = lpms_index::LpmsIndex(test_dataset, test_query);
+    const Dataset dataset(test_dataset);
+    auto pi = lpms_index::LpmsIndex(dataset, test_query);
 
     pi.build_index();
     pi.print_index();
@@ -130,7 +138,113 @@ void longer_matcher() {
 
 }
 
+double lp_objective(const lpms_index::CoveringLp & lp, const std::vector<double> & x) {
+    double obj = 0;
+    for (size_t j = 0; j < lp.num_vars; j++) obj += lp.c[j] * x[j];
+    return obj;
+}
+
+// every row of A x >= b holds, up to the relative tolerance
+bool lp_feasible(const lpms_index::CoveringLp & lp, const std::vector<double> & x, double tol) {
+    for (size_t i = 0; i < lp.num_rows(); i++) {
+        double ax = 0;
+        for (size_t e = lp.row_begin[i]; e < lp.row_begin[i+1]; e++) {
+            ax += lp.vals[e] * x[lp.cols[e]];
+        }
+        if (ax < lp.b[i] * (1 - tol)) return false;
+    }
+    return std::all_of(x.begin(), x.end(), [](double x_j) { return x_j >= 0; });
+}
+
+void add_row(lpms_index::CoveringLp & lp, const std::vector<std::pair<size_t, double>> & row, double b) {
+    for (const auto & [col, val] : row) {
+        lp.cols.push_back(col);
+        lp.vals.push_back(val);
+    }
+    lp.close_row(b);
+}
+
+void pdhg_small() {
+    // min 2 x0 + 3 x1 + 4 x2 s.t. x0 + x1 >= 1, x1 + x2 >= 1, x0 + x2 >= 1:
+    //   the unique optimum is (0.5, 0.5, 0.5) of cost 4.5, as the dual 
+    //   (0.5, 2.5, 1.5) is feasible with the same cost; x3 is in no row
+    lpms_index::CoveringLp lp;
+    lp.num_vars = 4;
+    lp.c = {2, 3, 4, 1};
+    add_row(lp, {{0, 1}, {1, 1}}, 1);
+    add_row(lp, {{1, 1}, {2, 1}}, 1);
+    add_row(lp, {{0, 1}, {2, 1}}, 1);
+    // holds for every x >= 0
+    add_row(lp, {{3, 5}}, 0);
+
+    lpms_index::PdhgSolver solver(1, 1e-6);
+    std::vector<double> x;
+    assert(solver.solve(lp, x) && "Small LP solved");
+    assert(std::abs(lp_objective(lp, x) - 4.5) < 1e-4 && "Small LP optimum is 4.5");
+    for (size_t j = 0; j < 3; j++) {
+        assert(std::abs(x[j] - 0.5) < 1e-3 && "Small LP optimum at x = 0.5");
+    }
+    assert(x[3] == 0 && "Variable in no row stays 0");
+    assert(lp_feasible(lp, x, 1e-4) && "Small LP solution feasible");
+
+    // a row without entries cannot be covered
+    add_row(lp, {}, 1);
+    assert(!solver.solve(lp, x) && "Uncoverable row reported");
+}
+
+void pdhg_threads() {
+    // vertex cover of an odd cycle, scaled like record counts: the 
+    //   optimum of the relaxation is x = 0.5 * b / a everywhere, cost n/2 c;
+    //   both LPs take a few thousand iterations, so go through restarts
+    const size_t n = 1001;
+    const double count = 250, cost = 3;
+    lpms_index::CoveringLp cycle;
+    cycle.num_vars = n;
+    cycle.c.assign(n, cost);
+    for (size_t i = 0; i < n; i++) {
+        add_row(cycle, {{i, count}, {(i + 1) % n, count}}, count);
+    }
+
+    // random rows, for a point that depends on the order of the sums
+    std::mt19937 gen(7);
+    lpms_index::CoveringLp random_lp;
+    random_lp.num_vars = 300;
+    for (size_t j = 0; j < random_lp.num_vars; j++) random_lp.c.push_back(1 + gen() % 100);
+    for (size_t i = 0; i < 500; i++) {
+        std::vector<std::pair<size_t, double>> row;
+        std::set<size_t> cols;
+        while (cols.size() < 2 + gen() % 8) cols.insert(gen() % random_lp.num_vars);
+        for (auto col : cols) row.emplace_back(col, 1 + gen() % 1000);
+        add_row(random_lp, row, 1 + gen() % 1000);
+    }
+
+    const double tol = 1e-4;
+    std::vector<double> x_one, x_four;
+    lpms_index::PdhgSolver one(1, tol), four(4, tol);
+
+    assert(one.solve(cycle, x_one) && four.solve(cycle, x_four) && "Cycle LP solved");
+    assert(x_one == x_four && "Same point with 1 and 4 threads");
+    assert(std::abs(lp_objective(cycle, x_four) - n / 2.0 * cost) < 1e-3 * n * cost && 
+           "Cycle LP optimum is n/2 c");
+    assert(lp_feasible(cycle, x_four, 1e-3) && "Cycle LP solution feasible");
+
+    assert(one.solve(random_lp, x_one) && four.solve(random_lp, x_four) && "Random LP solved");
+    assert(x_one == x_four && "Same point with 1 and 4 threads");
+    assert(lp_feasible(random_lp, x_four, 1e-3) && "Random LP solution feasible");
+
+    // stopped early, the solver still returns its last point
+    lpms_index::PdhgSolver capped(4, tol, 64);
+    assert(!capped.solve(random_lp, x_four) && x_four.size() == random_lp.num_vars && 
+           "No convergence in 64 iterations reported");
+}
+
 int main() {
+    std::cout << "BEGIN LP SOLVER TESTS -------------------------------------------" << std::endl;
+    std::cout << "\t PDHG SMALL -------------------------------------------" << std::endl;
+    pdhg_small();
+    std::cout << "\t PDHG THREADS -------------------------------------------" << std::endl;
+    pdhg_threads();
+    std::cout << "END LP SOLVER TESTS -------------------------------------------" << std::endl;
     std::cout << "BEGIN INDEX TESTS -------------------------------------------" << std::endl;
     std::cout << "\t SIMPLE LP 0.99 -------------------------------------------" << std::endl;
     simple_index();
@@ -7,10 +7,10 @@
 #include <chrono>
 #include "../../utils/utils.hpp"
 
-void trigram_index::TrigramInvertedIndex::extract_trigrams(const std::string & line, std::set<std::string> & trigrams) const {
+void trigram_index::TrigramInvertedIndex::extract_trigrams(std::string_view line, std::set<std::string> & trigrams) const {
     if (line.size() < 3) return;
     for (size_t i = 0; i + 3 <= line.size(); ++i) {
-        trigrams.insert(line.substr(i, 3));
+        trigrams.emplace(line.substr(i, 3));
     }
 }
 
@@ -64,6 +64,7 @@ void trigram_index::TrigramInvertedIndex::build_index(int upper_n) {
     } else {
         k_index_keys_ = all_trigrams;
     }
+    k_keys_dirty_ = true;
     auto selection_time = std::chrono::duration_cast<std::chrono::duration<double>>(
         std::chrono::high_resolution_clock::now() - start).count();
     std::cout << "Select Grams End in " << selection_time << " s" << std::endl;
@@ -75,6 +76,7 @@ void trigram_index::TrigramInvertedIndex::build_index(int upper_n) {
 
     // Step 2: Fill posting lists (threaded)
     fill_posting();
+    finalize_index();
 
     auto build_time = std::chrono::duration_cast<std::chrono::duration<double>>(
         std::chrono::high_resolution_clock::now() - start).count();
@@ -96,12 +98,16 @@ void trigram_index::TrigramInvertedIndex::fill_posting() {
 
         std::unordered_map<std::string, std::vector<size_t>> local_index;
         for (size_t i = start; i < end; ++i) {
-            const std::string & line = k_dataset_[i];
+            std::string_view line = k_dataset_[i];
             if (line.size() < 3) continue;
             for (size_t j = 0; j + 3 <= line.size(); ++j) {
-                std::string trigram = line.substr(j, 3);
-                if (k_index_keys_.count(trigram))
-                    local_index[trigram].push_back(i);
+                std::string trigram(line.substr(j, 3));
+                if (k_index_keys_.count(trigram)) {
+                    // a trigram may occur several times in one line
+                    auto & posting = local_index[trigram];
+                    if (posting.empty() || posting.back() != i)
+                        posting.push_back(i);
+                }
             }
         }
         // Merge local_index into global index
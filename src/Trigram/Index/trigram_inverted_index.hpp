@@ -17,10 +17,10 @@ class TrigramInvertedIndex : public NGramInvertedIndex {
     TrigramInvertedIndex() = delete;
     TrigramInvertedIndex(const TrigramInvertedIndex &&) = delete;
 
-    TrigramInvertedIndex(const std::vector<std::string> & dataset)
+    TrigramInvertedIndex(const Dataset & dataset)
         : NGramInvertedIndex(dataset) {}
 
-    TrigramInvertedIndex(const std::vector<std::string> & dataset,
+    TrigramInvertedIndex(const Dataset & dataset,
                          const std::vector<std::string> & queries)
         : NGramInvertedIndex(dataset, queries) {}
 
@@ -33,7 +33,7 @@ class TrigramInvertedIndex : public NGramInvertedIndex {
     size_t get_num_keys() const override { return k_index_keys_.size(); }
 
  protected:
-    void extract_trigrams(const std::string & line, std::set<std::string> & trigrams) const;
+    void extract_trigrams(std::string_view line, std::set<std::string> & trigrams) const;
     void fill_posting();
 
     std::mutex index_mutex_;
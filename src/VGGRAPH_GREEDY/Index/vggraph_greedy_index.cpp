@@ -5,6 +5,9 @@
 #include <iostream>
 #include <algorithm>
 #include <limits>
+#include <array>
+#include <queue>
+#include <atomic>
 
 namespace vggraph_greedy_index {
 
@@ -20,6 +23,7 @@ void VGGraph_Greedy::build_index(int upper_n) {
     log << k_threshold_ << "," << key_upper_bound_ << "," << k_queries_size_ << ",";
     log << selection_time << ",";
 
+    finalize_index();
     auto build_time = std::chrono::duration_cast<std::chrono::duration<double>>(
         std::chrono::high_resolution_clock::now() - start).count();
 
@@ -36,7 +40,8 @@ void VGGraph_Greedy::select_grams(int upper_n) {
     
     // Step 1: Build initial q_min-grams for dynamic tau computation
     std::unordered_map<std::string, PostingList> current_grams;
-    build_initial_ngrams_parallel(current_grams);
+    PositionMap current_positions;
+    build_initial_ngrams_parallel(current_grams, current_positions);
     
     // Step 2: Compute dynamic tau based on initial gram frequencies using k_threshold_ as quantile
     size_t tau = 0;
@@ -48,6 +53,7 @@ void VGGraph_Greedy::select_grams(int upper_n) {
     }
     // Step 3: Iterative pruning approach
     std::set<std::string> selected_grams_cumulative;
+    auto query_literals = get_query_literals();
     
     for (size_t current_len = q_min_; current_len <= max_gram_len_; ++current_len) {        
         // Filter grams by frequency threshold (tau)
@@ -60,17 +66,44 @@ void VGGraph_Greedy::select_grams(int upper_n) {
 
         // Apply set cover optimization if queries are available
         if (k_queries_size_ > 0 && !filtered_grams.empty()) {
-            auto query_literals = get_query_literals();
             std::set<std::string> gram_keys;
             for (const auto& entry : filtered_grams) {
                 gram_keys.insert(entry.first);
             }
-            std::set<std::string> selected_this_round;
+            // One automaton over the grams of this level, shared by the
+            // queries; key ids follow gram_keys
+            std::vector<std::string> keys(gram_keys.begin(), gram_keys.end());
+            std::vector<size_t> key_costs;
+            key_costs.reserve(keys.size());
+            for (const auto& gram : keys) {
+                key_costs.push_back(filtered_grams.at(gram).size());
+            }
+            KeyAutomaton key_automaton;
+            key_automaton.build(keys.begin(), keys.end());
             
-            // Apply set cover for each query and collect selected grams
-            for (const auto& literals : query_literals) {
-                auto selected = vggraph_greedy_cover(literals, gram_keys, filtered_grams);
-                selected_this_round.insert(selected.begin(), selected.end());
+            // Apply set cover for each query, queries in parallel
+            std::vector<std::vector<uint32_t>> selected(query_literals.size());
+            std::atomic<size_t> next_query{0};
+            auto cover_queries = [&]() {
+                for (size_t q = next_query++; q < query_literals.size(); q = next_query++) {
+                    selected[q] = vggraph_greedy_cover(query_literals[q], key_automaton, key_costs);
+                }
+            };
+            std::vector<std::thread> threads;
+            for (int t = 1; t < thread_count_; ++t) {
+                threads.emplace_back(cover_queries);
+            }
+            cover_queries();
+            for (auto& thread : threads) {
+                thread.join();
+            }
+            
+            // Collect selected grams
+            std::set<std::string> selected_this_round;
+            for (const auto& key_ids : selected) {
+                for (auto key_id : key_ids) {
+                    selected_this_round.insert(keys[key_id]);
+                }
             }
 
             // Add selected grams to cumulative set
@@ -82,6 +115,7 @@ void VGGraph_Greedy::select_grams(int upper_n) {
                 if (it != filtered_grams.end()) {
                     k_index_[gram] = it->second;
                     k_index_keys_.insert(gram);
+                    k_keys_dirty_ = true;
                     
                     if (key_upper_bound_ > 0 && k_index_keys_.size() >= key_upper_bound_) {
                         return;
@@ -94,6 +128,7 @@ void VGGraph_Greedy::select_grams(int upper_n) {
             for (const auto& entry : filtered_grams) {
                 k_index_[entry.first] = entry.second;
                 k_index_keys_.insert(entry.first);
+                k_keys_dirty_ = true;
                 selected_grams_cumulative.insert(entry.first);
                 
                 if (key_upper_bound_ > 0 && k_index_keys_.size() >= key_upper_bound_) {
@@ -105,8 +140,11 @@ void VGGraph_Greedy::select_grams(int upper_n) {
         // Step 4: Extend only the selected grams for next iteration
         if (current_len < max_gram_len_) {
             std::unordered_map<std::string, PostingList> next_grams;
-            extend_selected_grams(current_grams, selected_grams_cumulative, next_grams, tau);
+            PositionMap next_positions;
+            extend_selected_grams(current_grams, current_positions, selected_grams_cumulative,
+                                  next_grams, next_positions, tau);
             current_grams = std::move(next_grams);
+            current_positions = std::move(next_positions);
        
             if (current_grams.empty()) {
                 break;
@@ -131,10 +169,10 @@ void VGGraph_Greedy::merge_index_maps(
     }
 }
 
-std::vector<std::string> VGGraph_Greedy::vggraph_greedy_cover(
+std::vector<uint32_t> VGGraph_Greedy::vggraph_greedy_cover(
     const std::vector<std::string>& literals,
-    const std::set<std::string>& index_keys,
-    const std::unordered_map<std::string, PostingList>& index_map) {
+    const KeyAutomaton& key_automaton,
+    const std::vector<size_t>& key_costs) {
     
     size_t total_chars = 0;
     std::vector<size_t> lit_offsets;
@@ -143,60 +181,66 @@ std::vector<std::string> VGGraph_Greedy::vggraph_greedy_cover(
         total_chars += lit.size();
     }
     
-    std::unordered_map<std::string, std::vector<size_t>> gram2cover;
-    for (const auto& gram : index_keys) {
-        std::vector<size_t> covered;
-        for (size_t li = 0; li < literals.size(); ++li) {
-            const std::string& lit = literals[li];
-            for (size_t i = 0; i + gram.size() <= lit.size(); ++i) {
-                if (lit.substr(i, gram.size()) == gram) {
-                    for (size_t k = 0; k < gram.size(); ++k) {
-                        covered.push_back(lit_offsets[li] + i + k);
-                    }
-                }
+    // Characters covered by each gram occurring in the literals, once
+    // per occurrence, from one automaton pass over each literal
+    std::unordered_map<uint32_t, size_t> cover_idx;
+    std::vector<uint32_t> cover_keys;
+    std::vector<std::vector<size_t>> gram2cover;
+    for (size_t li = 0; li < literals.size(); ++li) {
+        key_automaton.for_each_match(literals[li], [&](size_t start, size_t len, uint32_t key_id) {
+            auto [it, inserted] = cover_idx.try_emplace(key_id, gram2cover.size());
+            if (inserted) {
+                cover_keys.push_back(key_id);
+                gram2cover.emplace_back();
             }
-        }
-        if (!covered.empty()) {
-            gram2cover[gram] = std::move(covered);
-        }
+            for (size_t k = 0; k < len; ++k) {
+                gram2cover[it->second].push_back(lit_offsets[li] + start + k);
+            }
+        });
     }
     
     std::vector<bool> covered(total_chars, false);
     size_t uncovered = total_chars;
-    std::vector<std::string> selected;
+    std::vector<uint32_t> selected;
     
-    while (uncovered > 0) {
-        double best_score = std::numeric_limits<double>::max();
-        std::string best_gram;
-        
-        for (const auto& kv : gram2cover) {
-            const auto& gram = kv.first;
-            auto index_it = index_map.find(gram);
-            if (index_it == index_map.end()) continue;
-            
-            size_t cost = index_it->second.size();
-            size_t gain = 0;
-            for (size_t pos : kv.second) {
-                if (!covered[pos]) ++gain;
-            }
-            if (gain == 0) continue;
-            
-            double score = static_cast<double>(cost) / gain;
-            if (score < best_score) {
-                best_score = score;
-                best_gram = gram;
-            }
+    auto gain_of = [&](size_t c) {
+        size_t gain = 0;
+        for (size_t pos : gram2cover[c]) {
+            if (!covered[pos]) ++gain;
         }
+        return gain;
+    };
+    
+    // Lazy greedy: gains only drop as characters get covered, so the
+    // score (cost / gain) of a heap entry is a lower bound of the current
+    // one; the top is taken once its score is current. Lowest score first,
+    // the smallest key id on ties.
+    using entry = std::pair<double, uint32_t>;
+    std::priority_queue<entry, std::vector<entry>, std::greater<entry>> heap;
+    for (size_t c = 0; c < gram2cover.size(); ++c) {
+        heap.push({static_cast<double>(key_costs[cover_keys[c]]) / gram2cover[c].size(), cover_keys[c]});
+    }
+    
+    while (uncovered > 0 && !heap.empty()) {
+        auto [score, key_id] = heap.top();
+        heap.pop();
+        size_t c = cover_idx.at(key_id);
+        size_t gain = gain_of(c);
+        if (gain == 0) continue;
         
-        if (best_gram.empty()) break;
+        double curr_score = static_cast<double>(key_costs[key_id]) / gain;
+        if (curr_score != score) {
+            heap.push({curr_score, key_id});
+            continue;
+        }
         
-        for (size_t pos : gram2cover[best_gram]) {
+        for (size_t pos : gram2cover[c]) {
             if (!covered[pos]) {
                 covered[pos] = true;
                 --uncovered;
             }
         }
-        selected.push_back(best_gram);
+        selected.push_back(key_id);
     }
     
     return selected;
@@ -221,9 +265,10 @@ size_t VGGraph_Greedy::dynamic_tau(
 }
 
 void VGGraph_Greedy::build_initial_ngrams_parallel(
-    std::unordered_map<std::string, PostingList>& initial_grams) {
+    std::unordered_map<std::string, PostingList>& initial_grams,
+    PositionMap& initial_positions) {
     
-    std::vector<std::unordered_map<std::string, PostingList>> thread_grams(thread_count_);
+    std::vector<ChunkGrams> thread_grams(thread_count_);
     std::vector<std::thread> threads;
     
     size_t chunk_size = (k_dataset_size_ + thread_count_ - 1) / thread_count_;
@@ -243,41 +288,43 @@ void VGGraph_Greedy::build_initial_ngrams_parallel(
         thread.join();
     }
     
-    // Merge results from all threads
-    for (const auto& local_grams : thread_grams) {
-        for (const auto& entry : local_grams) {
-            const std::string& gram = entry.first;
-            const PostingList& positions = entry.second;
-            
-            initial_grams[gram].insert(initial_grams[gram].end(), positions.begin(), positions.end());
+    // Merge results from all threads; chunks are consecutive record
+    // ranges, so appending them in order keeps the lists sorted
+    for (auto& local_grams : thread_grams) {
+        for (auto& [gram_view, occurrences] : local_grams) {
+            std::string gram(gram_view);
+            auto& records = initial_grams[gram];
+            auto& positions = initial_positions[gram];
+            records.insert(records.end(), occurrences.first.begin(), occurrences.first.end());
+            positions.counts.insert(positions.counts.end(),
+                occurrences.second.counts.begin(), occurrences.second.counts.end());
+            positions.offsets.insert(positions.offsets.end(),
+                occurrences.second.offsets.begin(), occurrences.second.offsets.end());
         }
+        ChunkGrams().swap(local_grams);
     }
-    
-    // Sort and remove duplicates for each gram
-    for (auto& entry : initial_grams) {
-        auto& vec = entry.second;
-        std::sort(vec.begin(), vec.end());
-        vec.erase(std::unique(vec.begin(), vec.end()), vec.end());
-    }
+    bound_positions(initial_positions);
 }
 
 void VGGraph_Greedy::process_chunk_for_initial_grams(
     size_t start, size_t end,
-    std::unordered_map<std::string, PostingList>& thread_grams) {
+    ChunkGrams& thread_grams) {
     
     for (RecordId rec_id = start; rec_id < end; ++rec_id) {
-        const std::string& rec = k_dataset_[rec_id];
+        std::string_view rec = k_dataset_[rec_id];
         for (size_t i = 0; i + q_min_ <= rec.size(); ++i) {
-            std::string gram = rec.substr(i, q_min_);
-            thread_grams[gram].push_back(rec_id);
+            auto& occurrences = thread_grams[rec.substr(i, q_min_)];
+            add_occurrence(occurrences.first, occurrences.second, rec_id, i);
         }
     }
 }
 
 void VGGraph_Greedy::extend_selected_grams(
     const std::unordered_map<std::string, PostingList>& current_grams,
+    const PositionMap& current_positions,
     const std::set<std::string>& selected_grams,
     std::unordered_map<std::string, PostingList>& next_grams,
+    PositionMap& next_positions,
     size_t tau) {
     
     // Find which grams need extension (those that are too frequent)
@@ -295,18 +342,22 @@ void VGGraph_Greedy::extend_selected_grams(
     }
         
     if (!grams_to_extend.empty()) {
-        extend_grams_parallel(current_grams, grams_to_extend, next_grams, tau);
+        extend_grams_parallel(current_grams, current_positions, grams_to_extend,
+                              next_grams, next_positions, tau);
     }
 }
 
 void VGGraph_Greedy::extend_grams_parallel(
     const std::unordered_map<std::string, PostingList>& current_grams,
+    const PositionMap& current_positions,
     const std::set<std::string>& grams_to_extend,
     std::unordered_map<std::string, PostingList>& extended_grams,
+    PositionMap& extended_positions,
     size_t tau) {
     
     std::vector<std::string> grams_vec(grams_to_extend.begin(), grams_to_extend.end());
     std::vector<std::unordered_map<std::string, PostingList>> thread_results(thread_count_);
+    std::vector<PositionMap> thread_positions(thread_count_);
     std::vector<std::thread> threads;
     
     size_t chunk_size = (grams_vec.size() + thread_count_ - 1) / thread_count_;
@@ -316,42 +367,67 @@ void VGGraph_Greedy::extend_grams_parallel(
         size_t end = std::min(start + chunk_size, grams_vec.size());
         if (start >= end) break;
         
-        threads.emplace_back([this, &grams_vec, &current_grams, &thread_results, t, start, end]() {
+        threads.emplace_back([this, &grams_vec, &current_grams, &current_positions,
+                              &thread_results, &thread_positions, t, start, end]() {
             auto& local_extended = thread_results[t];
+            auto& local_positions = thread_positions[t];
             
             for (size_t i = start; i < end; ++i) {
                 const std::string& gram = grams_vec[i];
                 auto gram_it = current_grams.find(gram);
                 if (gram_it == current_grams.end()) continue;
                 
-                const PostingList& positions = gram_it->second;
+                const PostingList& records = gram_it->second;
                 
-                // Extend this gram by one character
-                std::unordered_map<std::string, PostingList> local_extensions;
+                // Extend this gram by one character: the extensions are
+                // keyed by the byte following each occurrence
+                std::array<int, 256> slot;
+                slot.fill(-1);
+                std::vector<char> ext_chars;
+                std::vector<PostingList> ext_records;
+                std::vector<GramPositions> ext_positions;
+                auto extend_at = [&](RecordId rec_id, std::string_view rec, size_t pos) {
+                    if (pos + gram.size() >= rec.size()) return;
+                    char c = rec[pos + gram.size()];
+                    int& ext = slot[static_cast<unsigned char>(c)];
+                    if (ext < 0) {
+                        ext = ext_chars.size();
+                        ext_chars.push_back(c);
+                        ext_records.emplace_back();
+                        ext_positions.emplace_back();
+                    }
+                    add_occurrence(ext_records[ext], ext_positions[ext], rec_id, pos);
+                };
                 
-                for (RecordId rec_id : positions) {
-                    const std::string& rec = k_dataset_[rec_id];
-                    
-                    // Find all occurrences of the gram in this record
-                    for (size_t pos = 0; pos + gram.size() < rec.size(); ++pos) {
-                        if (rec.substr(pos, gram.size()) == gram) {
-                            // Extend with the next character
-                            std::string ext_gram = gram + rec[pos + gram.size()];
-                            local_extensions[ext_gram].push_back(rec_id);
+                auto pos_it = current_positions.find(gram);
+                if (pos_it != current_positions.end()) {
+                    // Inspect the next byte at the known occurrences
+                    const GramPositions& positions = pos_it->second;
+                    size_t o = 0;
+                    for (size_t r = 0; r < records.size(); ++r) {
+                        std::string_view rec = k_dataset_[records[r]];
+                        for (uint32_t n = 0; n < positions.counts[r]; ++n) {
+                            extend_at(records[r], rec, positions.offsets[o++]);
+                        }
+                    }
+                } else {
+                    // Positions dropped by bound_positions: find the
+                    // occurrences of the gram in its records
+                    for (RecordId rec_id : records) {
+                        std::string_view rec = k_dataset_[rec_id];
+                        for (size_t pos = rec.find(gram); pos != std::string_view::npos;
+                             pos = rec.find(gram, pos + 1)) {
+                            extend_at(rec_id, rec, pos);
                         }
                     }
                 }
                 
-                // Add valid extensions to thread results
-                for (auto& ext_entry : local_extensions) {
-                    auto& ext_positions = ext_entry.second;
-                    std::sort(ext_positions.begin(), ext_positions.end());
-                    ext_positions.erase(std::unique(ext_positions.begin(), ext_positions.end()), ext_positions.end());
-                    
-                    // Only keep extensions that have at least one occurrence
-                    if (!ext_positions.empty()) {
-                        local_extended[ext_entry.first] = std::move(ext_positions);
-                    }
+                // Extensions of different grams are different grams, and
+                // their records are already sorted and unique
+                for (size_t ext = 0; ext < ext_chars.size(); ++ext) {
+                    std::string ext_gram = gram + ext_chars[ext];
+                    local_extended[ext_gram] = std::move(ext_records[ext]);
+                    local_positions[ext_gram] = std::move(ext_positions[ext]);
                 }
             }
         });
@@ -363,20 +439,36 @@ void VGGraph_Greedy::extend_grams_parallel(
     }
     
     // Merge results from all threads
-    for (const auto& thread_result : thread_results) {
-        for (const auto& entry : thread_result) {
-            const std::string& gram = entry.first;
-            const PostingList& positions = entry.second;
-            
-            extended_grams[gram].insert(extended_grams[gram].end(), positions.begin(), positions.end());
-        }
+    for (int t = 0; t < thread_count_; ++t) {
+        extended_grams.merge(thread_results[t]);
+        extended_positions.merge(thread_positions[t]);
     }
+    bound_positions(extended_positions);
+}
+
+// Keep at most max_positions_ offsets, for the grams with the fewest
+// occurrences first; the others are searched for when extended
+void VGGraph_Greedy::bound_positions(PositionMap& positions) {
     
-    // Sort and remove duplicates for each extended gram
-    for (auto& entry : extended_grams) {
-        auto& vec = entry.second;
-        std::sort(vec.begin(), vec.end());
-        vec.erase(std::unique(vec.begin(), vec.end()), vec.end());
+    size_t total = 0;
+    for (const auto& entry : positions) {
+        total += entry.second.offsets.size();
+    }
+    if (total <= max_positions_) return;
+    
+    std::vector<std::pair<size_t, std::string>> by_size;
+    for (const auto& entry : positions) {
+        by_size.push_back({entry.second.offsets.size(), entry.first});
+    }
+    std::sort(by_size.begin(), by_size.end());
+    
+    size_t kept = 0;
+    for (const auto& [size, gram] : by_size) {
+        if (kept + size <= max_positions_) {
+            kept += size;
+        } else {
+            positions.erase(gram);
+        }
     }
 }
 
@@ -20,6 +20,8 @@
 #include <algorithm>
 #include <future>
 #include <limits>
+#include <string_view>
+#include <cstdint>
 
 #include "../../ngram_inverted_index.hpp"
 
@@ -30,7 +32,7 @@ class VGGraph_Greedy : public NGramInvertedIndex {
     VGGraph_Greedy() = delete;
     VGGraph_Greedy(const VGGraph_Greedy &&) = delete;
     
-    VGGraph_Greedy(const std::vector<std::string> & dataset, 
+    VGGraph_Greedy(const Dataset & dataset, 
                    const std::vector<std::string> & queries,
                    float selectivity_threshold, 
                    int upper_n, 
@@ -42,7 +44,7 @@ class VGGraph_Greedy : public NGramInvertedIndex {
         q_min_(2),
         max_gram_len_(upper_n) {}
     
-    VGGraph_Greedy(const std::vector<std::string> & dataset, 
+    VGGraph_Greedy(const Dataset & dataset, 
                    float selectivity_threshold, 
                    int upper_n, 
                    int thread_count)
@@ -56,6 +58,10 @@ class VGGraph_Greedy : public NGramInvertedIndex {
     ~VGGraph_Greedy() {}
 
     void build_index(int upper_n = -1) override;
+
+    // bound on the gram occurrence offsets kept between levels; grams
+    //   beyond it are extended by searching their records instead
+    void set_max_positions(size_t max_positions) { max_positions_ = max_positions; }
         
  protected:
     void select_grams(int upper_n = -1) override;
@@ -68,16 +74,40 @@ class VGGraph_Greedy : public NGramInvertedIndex {
     // Greedy algorithm parameters
     size_t q_min_;
     size_t max_gram_len_;
+    size_t max_positions_ = size_t(1) << 28;
     
     // Type aliases for compatibility with reference implementation
     using RecordId = size_t;
     using PostingList = std::vector<RecordId>;
 
+    // Offsets of the occurrences of a gram, aligned with its PostingList:
+    //   the first counts[0] offsets are in records[0], the next counts[1]
+    //   in records[1], and so on
+    struct GramPositions {
+        std::vector<uint32_t> counts;
+        std::vector<uint32_t> offsets;
+    };
+    using PositionMap = std::unordered_map<std::string, GramPositions>;
+    using ChunkGrams = std::unordered_map<std::string_view, std::pair<PostingList, GramPositions>>;
+
+    // record an occurrence at offset in rec_id; records come in ascending order
+    static void add_occurrence(PostingList& records, GramPositions& positions,
+                               RecordId rec_id, size_t offset) {
+        if (records.empty() || records.back() != rec_id) {
+            records.push_back(rec_id);
+            positions.counts.push_back(0);
+        }
+        positions.counts.back()++;
+        positions.offsets.push_back(static_cast<uint32_t>(offset));
+    }
+
     // Core greedy algorithm methods (iterative approach with pruning)
     void extend_selected_grams(
         const std::unordered_map<std::string, PostingList>& current_grams,
+        const PositionMap& current_positions,
         const std::set<std::string>& selected_grams,
         std::unordered_map<std::string, PostingList>& next_grams,
+        PositionMap& next_positions,
         size_t tau);
     
     void merge_index_maps(
@@ -86,10 +116,10 @@ class VGGraph_Greedy : public NGramInvertedIndex {
         const std::set<std::string>& in_keys,
         const std::unordered_map<std::string, PostingList>& in_index);
     
-    std::vector<std::string> vggraph_greedy_cover(
+    std::vector<uint32_t> vggraph_greedy_cover(
         const std::vector<std::string>& literals,
-        const std::set<std::string>& index_keys,
-        const std::unordered_map<std::string, PostingList>& index_map);
+        const KeyAutomaton& key_automaton,
+        const std::vector<size_t>& key_costs);
     
     size_t dynamic_tau(
         const std::unordered_map<std::string, PostingList>& grams, 
@@ -97,17 +127,22 @@ class VGGraph_Greedy : public NGramInvertedIndex {
 
     // Parallel processing methods
     void build_initial_ngrams_parallel(
-        std::unordered_map<std::string, PostingList>& initial_grams);
+        std::unordered_map<std::string, PostingList>& initial_grams,
+        PositionMap& initial_positions);
         
     void process_chunk_for_initial_grams(
         size_t start, size_t end,
-        std::unordered_map<std::string, PostingList>& thread_grams);
+        ChunkGrams& thread_grams);
         
     void extend_grams_parallel(
         const std::unordered_map<std::string, PostingList>& current_grams,
+        const PositionMap& current_positions,
         const std::set<std::string>& grams_to_extend,
         std::unordered_map<std::string, PostingList>& extended_grams,
+        PositionMap& extended_positions,
         size_t tau);
+
+    void bound_positions(PositionMap& positions);
 };
 
 } // namespace vggraph_greedy_index
@@ -5,6 +5,8 @@
 #include <iostream>
 #include <future>
 #include <iterator>
+#include <atomic>
+#include <random>
 
 namespace vggraph_opt_index {
 
@@ -17,7 +19,7 @@ void VGGraph_Opt::build_index(int upper_n) {
     
     std::ostringstream log;
     log << "VGGraph-Opt" << "," << thread_count_ << "," << upper_n << ",";
-    log << k_threshold_ << "," << key_upper_bound_ << "," << k_queries_size_ << ",";
+    log << selectivity_threshold_ << "," << key_upper_bound_ << "," << k_queries_size_ << ",";
     log << selection_time << ",";
 
     start = std::chrono::high_resolution_clock::now();
@@ -42,14 +44,14 @@ void VGGraph_Opt::build_index(int upper_n) {
     select_optimal_ngrams();
     
     // Step 6: Build the actual inverted index
-    for (const auto& pair : graph_nodes_) {
-        if (pair.second.selected) {
-            k_index_keys_.insert(pair.first);
-            k_index_[pair.first] = std::vector<size_t>(pair.second.document_ids.begin(), 
-                                                     pair.second.document_ids.end());
-            std::sort(k_index_[pair.first].begin(), k_index_[pair.first].end());
+    for (const auto& node : graph_nodes_) {
+        if (node.selected) {
+            k_index_keys_.insert(node.ngram);
+            k_keys_dirty_ = true;
+            k_index_[node.ngram] = node.document_ids;
         }
     }
+    finalize_index();
     
     auto build_time = std::chrono::duration_cast<std::chrono::duration<double>>(
         std::chrono::high_resolution_clock::now() - start).count();
@@ -68,144 +70,365 @@ void VGGraph_Opt::select_grams(int upper_n) {
 }
 
 void VGGraph_Opt::build_variability_graph(int max_n) {
-    const int num_threads = std::min(thread_count_, static_cast<int>(k_dataset_size_));
-    const int docs_per_thread = k_dataset_size_ / num_threads;
+    const size_t num_threads = std::max<size_t>(1, std::min<size_t>(thread_count_, k_dataset_size_));
+    const size_t docs_per_thread = k_dataset_size_ / num_threads;
     
+    std::vector<LocalNgrams> local_ngrams(num_threads);
     std::vector<std::future<void>> futures;
     
-    for (int i = 0; i < num_threads; ++i) {
-        int start_idx = i * docs_per_thread;
-        int end_idx = (i == num_threads - 1) ? k_dataset_size_ : (i + 1) * docs_per_thread;
+    for (size_t i = 0; i < num_threads; ++i) {
+        size_t start_idx = i * docs_per_thread;
+        size_t end_idx = (i == num_threads - 1) ? k_dataset_size_ : (i + 1) * docs_per_thread;
         
         futures.push_back(std::async(std::launch::async, 
                                    &VGGraph_Opt::process_documents_parallel, 
-                                   this, start_idx, end_idx, max_n));
+                                   this, start_idx, end_idx, max_n,
+                                   std::ref(local_ngrams[i])));
     }
     
     // Wait for all threads to complete
     for (auto& future : futures) {
         future.get();
     }
+    
+    merge_local_results(local_ngrams);
 }
 
-void VGGraph_Opt::process_documents_parallel(int start_idx, int end_idx, int max_n) {
-    std::unordered_map<std::string, std::set<size_t>> local_ngrams;
-    
-    for (int doc_id = start_idx; doc_id < end_idx; ++doc_id) {
+void VGGraph_Opt::process_documents_parallel(size_t start_idx, size_t end_idx, int max_n,
+                                             LocalNgrams& local_ngrams) {
+    for (size_t doc_id = start_idx; doc_id < end_idx; ++doc_id) {
         extract_ngrams_from_document(k_dataset_[doc_id], max_n, local_ngrams, doc_id);
     }
-    
-    // Merge results into global structure
-    merge_local_results(local_ngrams);
 }
 
-void VGGraph_Opt::extract_ngrams_from_document(const std::string& document, 
+void VGGraph_Opt::extract_ngrams_from_document(std::string_view document, 
                                               int max_n, 
-                                              std::unordered_map<std::string, std::set<size_t>>& local_ngrams,
+                                              LocalNgrams& local_ngrams,
                                               size_t doc_id) {
-    for (int n = 1; n <= max_n; ++n) {
-        std::vector<std::string> ngrams = generate_ngrams(document, n);
-        for (const std::string& ngram : ngrams) {
-            local_ngrams[ngram].insert(doc_id);
+    // n-grams are views of the document until merged; documents come in
+    // increasing id, so each list stays sorted and unique
+    for (size_t n = 1; n <= static_cast<size_t>(max_n); ++n) {
+        for (size_t i = 0; i + n <= document.size(); ++i) {
+            auto& doc_ids = local_ngrams[document.substr(i, n)];
+            if (doc_ids.empty() || doc_ids.back() != doc_id) {
+                doc_ids.push_back(doc_id);
+            }
         }
     }
 }
 
-std::vector<std::string> VGGraph_Opt::generate_ngrams(const std::string& text, int n) {
-    std::vector<std::string> ngrams;
-    if (text.length() < n) {
-        return ngrams;
-    }
-    
-    for (size_t i = 0; i <= text.length() - n; ++i) {
-        ngrams.push_back(text.substr(i, n));
-    }
-    
-    return ngrams;
-}
-
-void VGGraph_Opt::merge_local_results(const std::unordered_map<std::string, std::set<size_t>>& local_ngrams) {
-    std::lock_guard<std::mutex> lock(graph_mutex_);
+void VGGraph_Opt::merge_local_results(std::vector<LocalNgrams>& local_ngrams) {
+    // Lock-free merge split by n-gram hash: each thread first buckets its
+    // own n-grams, then each partition concatenates the document lists of
+    // its n-grams in thread order (increasing document ranges)
+    const size_t num_parts = local_ngrams.size();
+    using local_entry = LocalNgrams::value_type;
+    std::vector<std::vector<std::vector<local_entry*>>> buckets(num_parts);
+    std::vector<std::vector<GraphNode>> parts(num_parts);
+    auto run = [num_parts](auto&& f) {
+        std::vector<std::future<void>> futures;
+        for (size_t t = 0; t < num_parts; ++t) {
+            futures.push_back(std::async(std::launch::async, f, t));
+        }
+        for (auto& future : futures) {
+            future.get();
+        }
+    };
     
-    for (const auto& pair : local_ngrams) {
-        const std::string& ngram = pair.first;
-        const std::set<size_t>& doc_ids = pair.second;
-        
-        if (graph_nodes_.find(ngram) == graph_nodes_.end()) {
-            graph_nodes_[ngram] = GraphNode(ngram);
+    run([&](size_t t) {
+        buckets[t].resize(num_parts);
+        for (auto& entry : local_ngrams[t]) {
+            buckets[t][std::hash<std::string_view>()(entry.first) % num_parts].push_back(&entry);
         }
-        
-        graph_nodes_[ngram].document_ids.insert(doc_ids.begin(), doc_ids.end());
+    });
+    run([&](size_t p) {
+        std::unordered_map<std::string_view, size_t> index;
+        for (size_t t = 0; t < num_parts; ++t) {
+            for (auto* entry : buckets[t][p]) {
+                auto [it, inserted] = index.try_emplace(entry->first, parts[p].size());
+                if (inserted) {
+                    parts[p].emplace_back(std::string(entry->first));
+                }
+                auto& doc_ids = parts[p][it->second].document_ids;
+                doc_ids.insert(doc_ids.end(), entry->second.begin(), entry->second.end());
+            }
+        }
+    });
+    
+    for (auto& part : parts) {
+        std::move(part.begin(), part.end(), std::back_inserter(graph_nodes_));
+    }
+    std::vector<std::vector<GraphNode>>().swap(parts);
+    std::vector<LocalNgrams>().swap(local_ngrams);
+    
+    // Node ids in n-gram order, independent of the number of threads
+    std::sort(graph_nodes_.begin(), graph_nodes_.end(),
+              [](const GraphNode& a, const GraphNode& b) { return a.ngram < b.ngram; });
+    node_ids_.reserve(graph_nodes_.size());
+    for (size_t i = 0; i < graph_nodes_.size(); ++i) {
+        node_ids_[graph_nodes_[i].ngram] = i;
     }
 }
 
 void VGGraph_Opt::calculate_node_selectivity() {
-    for (auto& pair : graph_nodes_) {
-        GraphNode& node = pair.second;
+    for (auto& node : graph_nodes_) {
         node.selectivity = static_cast<double>(node.document_ids.size()) / k_dataset_size_;
     }
 }
 
+static inline uint64_t mix64(uint64_t x) {
+    // splitmix64 finalizer
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+std::vector<uint64_t> VGGraph_Opt::compute_minhash_signatures(size_t num_hashes) {
+    // Signature of node i is [i * num_hashes, (i + 1) * num_hashes); hash h
+    // of a document is mix64(doc_id ^ seed_h)
+    std::vector<uint64_t> seeds(num_hashes);
+    for (size_t h = 0; h < num_hashes; ++h) {
+        seeds[h] = mix64(h + 1);
+    }
+    std::vector<uint64_t> signatures(graph_nodes_.size() * num_hashes, UINT64_MAX);
+    
+    const size_t num_threads = std::max(1, thread_count_);
+    std::atomic<size_t> next_node{0};
+    auto sign_nodes = [&]() {
+        for (size_t i = next_node++; i < graph_nodes_.size(); i = next_node++) {
+            uint64_t* signature = &signatures[i * num_hashes];
+            for (size_t doc_id : graph_nodes_[i].document_ids) {
+                for (size_t h = 0; h < num_hashes; ++h) {
+                    signature[h] = std::min(signature[h], mix64(doc_id ^ seeds[h]));
+                }
+            }
+        }
+    };
+    std::vector<std::future<void>> futures;
+    for (size_t t = 1; t < num_threads; ++t) {
+        futures.push_back(std::async(std::launch::async, sign_nodes));
+    }
+    sign_nodes();
+    for (auto& future : futures) {
+        future.get();
+    }
+    return signatures;
+}
+
 void VGGraph_Opt::build_graph_edges() {
-    std::vector<std::string> ngrams;
-    for (const auto& pair : graph_nodes_) {
-        ngrams.push_back(pair.first);
+    // Only n-grams agreeing on every row of some band of their MinHash
+    // signatures are compared; two n-grams with Jaccard similarity s are
+    // compared with probability 1 - (1 - s^rows_per_band_)^num_bands_
+    const size_t num_nodes = graph_nodes_.size();
+    const size_t rows = std::max<size_t>(1, rows_per_band_);
+    const size_t num_bands = std::max<size_t>(1, num_bands_);
+    const size_t num_hashes = num_bands * rows;
+    auto signatures = compute_minhash_signatures(num_hashes);
+    auto same_band = [&](uint32_t u, uint32_t v, size_t band) {
+        const uint64_t* su = &signatures[u * num_hashes + band * rows];
+        const uint64_t* sv = &signatures[v * num_hashes + band * rows];
+        return std::equal(su, su + rows, sv);
+    };
+    
+    const size_t num_threads = std::max(1, thread_count_);
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> thread_edges(num_threads);
+    std::atomic<size_t> next_band{0};
+    auto bucket_bands = [&](size_t t) {
+        std::vector<uint32_t> order(num_nodes);
+        for (size_t band = next_band++; band < num_bands; band = next_band++) {
+            // nodes with the same rows in this band are adjacent
+            std::iota(order.begin(), order.end(), 0);
+            std::sort(order.begin(), order.end(), [&](uint32_t u, uint32_t v) {
+                const uint64_t* su = &signatures[u * num_hashes + band * rows];
+                const uint64_t* sv = &signatures[v * num_hashes + band * rows];
+                return std::lexicographical_compare(su, su + rows, sv, sv + rows) ||
+                       (std::equal(su, su + rows, sv) && u < v);
+            });
+            for (size_t begin = 0, end = 0; begin < num_nodes; begin = end) {
+                end = begin + 1;
+                while (end < num_nodes && same_band(order[begin], order[end], band)) ++end;
+                for (size_t i = begin; i < end; ++i) {
+                    for (size_t j = i + 1; j < end; ++j) {
+                        uint32_t u = order[i], v = order[j];
+                        // a pair colliding in several bands is compared in the first one
+                        bool seen = false;
+                        for (size_t b = 0; b < band && !seen; ++b) {
+                            seen = same_band(u, v, b);
+                        }
+                        if (seen) continue;
+                        
+                        double similarity = calculate_jaccard_similarity(
+                            graph_nodes_[u].document_ids,
+                            graph_nodes_[v].document_ids
+                        );
+                        // Add edge if similarity is above threshold
+                        if (similarity > 0.1) {  // Threshold for graph connectivity
+                            thread_edges[t].push_back({u, v});
+                        }
+                    }
+                }
+            }
+        }
+    };
+    std::vector<std::future<void>> futures;
+    for (size_t t = 1; t < num_threads; ++t) {
+        futures.push_back(std::async(std::launch::async, bucket_bands, t));
+    }
+    bucket_bands(0);
+    for (auto& future : futures) {
+        future.get();
     }
     
-    // Build edges based on Jaccard similarity
-    for (size_t i = 0; i < ngrams.size(); ++i) {
-        for (size_t j = i + 1; j < ngrams.size(); ++j) {
-            const std::string& ngram1 = ngrams[i];
-            const std::string& ngram2 = ngrams[j];
-            
-            double similarity = calculate_jaccard_similarity(
-                graph_nodes_[ngram1].document_ids,
-                graph_nodes_[ngram2].document_ids
-            );
-            
-            // Add edge if similarity is above threshold
-            if (similarity > 0.1) {  // Threshold for graph connectivity
-                graph_nodes_[ngram1].neighbors.push_back(ngram2);
-                graph_nodes_[ngram2].neighbors.push_back(ngram1);
-            }
+    // Adjacency in CSR, both directions of each edge
+    adjacency_offsets_.assign(num_nodes + 1, 0);
+    for (const auto& edges : thread_edges) {
+        for (auto [u, v] : edges) {
+            ++adjacency_offsets_[u + 1];
+            ++adjacency_offsets_[v + 1];
+        }
+    }
+    std::partial_sum(adjacency_offsets_.begin(), adjacency_offsets_.end(), adjacency_offsets_.begin());
+    adjacency_.resize(adjacency_offsets_.back());
+    std::vector<size_t> fill(adjacency_offsets_.begin(), adjacency_offsets_.end() - 1);
+    for (const auto& edges : thread_edges) {
+        for (auto [u, v] : edges) {
+            adjacency_[fill[u]++] = v;
+            adjacency_[fill[v]++] = u;
         }
     }
+    for (size_t v = 0; v < num_nodes; ++v) {
+        std::sort(adjacency_.begin() + adjacency_offsets_[v], adjacency_.begin() + adjacency_offsets_[v + 1]);
+    }
 }
 
-double VGGraph_Opt::calculate_jaccard_similarity(const std::set<size_t>& set1, 
-                                                const std::set<size_t>& set2) {
-    std::set<size_t> intersection;
-    std::set_intersection(set1.begin(), set1.end(),
-                         set2.begin(), set2.end(),
-                         std::inserter(intersection, intersection.begin()));
-    
-    std::set<size_t> union_set;
-    std::set_union(set1.begin(), set1.end(),
-                   set2.begin(), set2.end(),
-                   std::inserter(union_set, union_set.begin()));
-    
-    if (union_set.empty()) return 0.0;
-    return static_cast<double>(intersection.size()) / union_set.size();
+double VGGraph_Opt::calculate_jaccard_similarity(const std::vector<size_t>& set1, 
+                                                const std::vector<size_t>& set2) {
+    size_t intersection = 0;
+    for (size_t i = 0, j = 0; i < set1.size() && j < set2.size();) {
+        if (set1[i] < set2[j]) {
+            ++i;
+        } else if (set2[j] < set1[i]) {
+            ++j;
+        } else {
+            ++intersection;
+            ++i;
+            ++j;
+        }
+    }
+    
+    size_t union_size = set1.size() + set2.size() - intersection;
+    if (union_size == 0) return 0.0;
+    return static_cast<double>(intersection) / union_size;
 }
 
 void VGGraph_Opt::calculate_centrality_scores() {
     // Calculate betweenness centrality for each node
-    for (auto& pair : graph_nodes_) {
-        const std::string& ngram = pair.first;
-        pair.second.centrality_score = calculate_betweenness_centrality(ngram);
+    auto betweenness = calculate_betweenness_centrality();
+    for (uint32_t id = 0; id < graph_nodes_.size(); ++id) {
+        GraphNode& node = graph_nodes_[id];
+        double selectivity_weight = 1.0 - node.selectivity;  // Lower selectivity = higher weight
+        node.centrality_score = betweenness[id] * selectivity_weight;
     }
 }
 
-double VGGraph_Opt::calculate_betweenness_centrality(const std::string& ngram) {
-    // Simplified betweenness centrality calculation
-    // In a full implementation, this would use algorithms like Brandes' algorithm
-    const GraphNode& node = graph_nodes_[ngram];
+std::vector<double> VGGraph_Opt::calculate_betweenness_centrality() {
+    // Brandes' algorithm: a BFS from each source s counts the shortest
+    // paths sigma, then the dependencies delta of s on each node are
+    // accumulated in reverse BFS order. Sources are split over the
+    // threads, each with its own accumulator.
+    const size_t num_nodes = graph_nodes_.size();
+    std::vector<double> betweenness(num_nodes, 0.0);
+    if (num_nodes == 0) return betweenness;
+    
+    std::vector<uint32_t> sources(num_nodes);
+    std::iota(sources.begin(), sources.end(), 0);
+    double scale = 1.0;
+    if (centrality_epsilon_ > 0) {
+        // Hoeffding over delta_s(v) / (n - 2) in [0, 1], union bound over
+        // the n nodes
+        double num_samples = std::ceil(std::log(2.0 * num_nodes / centrality_delta_) /
+                                       (2.0 * centrality_epsilon_ * centrality_epsilon_));
+        if (num_samples < num_nodes) {
+            std::mt19937_64 rng(centrality_seed_);
+            std::shuffle(sources.begin(), sources.end(), rng);
+            sources.resize(static_cast<size_t>(num_samples));
+            std::sort(sources.begin(), sources.end());
+            scale = static_cast<double>(num_nodes) / sources.size();
+        }
+    }
     
-    // For simplicity, use degree centrality weighted by selectivity
-    double degree = static_cast<double>(node.neighbors.size());
-    double selectivity_weight = 1.0 - node.selectivity;  // Lower selectivity = higher weight
+    const size_t num_threads = std::min<size_t>(std::max(1, thread_count_), sources.size());
+    std::vector<std::vector<double>> thread_betweenness(num_threads);
+    auto accumulate = [&](size_t t) {
+        auto& local = thread_betweenness[t];
+        local.assign(num_nodes, 0.0);
+        std::vector<int32_t> dist(num_nodes, -1);
+        std::vector<double> sigma(num_nodes, 0.0);
+        std::vector<double> delta(num_nodes, 0.0);
+        std::vector<uint32_t> order;    // BFS order, doubles as the queue
+        
+        for (size_t i = t; i < sources.size(); i += num_threads) {
+            uint32_t s = sources[i];
+            order.clear();
+            order.push_back(s);
+            dist[s] = 0;
+            sigma[s] = 1.0;
+            for (size_t head = 0; head < order.size(); ++head) {
+                uint32_t v = order[head];
+                for (size_t e = adjacency_offsets_[v]; e < adjacency_offsets_[v + 1]; ++e) {
+                    uint32_t w = adjacency_[e];
+                    if (dist[w] < 0) {
+                        dist[w] = dist[v] + 1;
+                        order.push_back(w);
+                    }
+                    if (dist[w] == dist[v] + 1) {
+                        sigma[w] += sigma[v];
+                    }
+                }
+            }
+            // predecessors of w are its neighbors one level closer to s
+            for (size_t j = order.size(); j-- > 0;) {
+                uint32_t w = order[j];
+                for (size_t e = adjacency_offsets_[w]; e < adjacency_offsets_[w + 1]; ++e) {
+                    uint32_t v = adjacency_[e];
+                    if (dist[v] == dist[w] - 1) {
+                        delta[v] += sigma[v] / sigma[w] * (1.0 + delta[w]);
+                    }
+                }
+                if (w != s) {
+                    local[w] += delta[w];
+                }
+            }
+            // reset only what this source reached
+            for (uint32_t v : order) {
+                dist[v] = -1;
+                sigma[v] = 0.0;
+                delta[v] = 0.0;
+            }
+        }
+    };
+    std::vector<std::future<void>> futures;
+    for (size_t t = 1; t < num_threads; ++t) {
+        futures.push_back(std::async(std::launch::async, accumulate, t));
+    }
+    accumulate(0);
+    for (auto& future : futures) {
+        future.get();
+    }
     
-    return degree * selectivity_weight;
+    // each path is counted from both of its ends
+    for (const auto& local : thread_betweenness) {
+        for (size_t v = 0; v < num_nodes; ++v) {
+            betweenness[v] += local[v];
+        }
+    }
+    for (auto& b : betweenness) {
+        b *= scale / 2.0;
+    }
+    return betweenness;
 }
 
 void VGGraph_Opt::select_optimal_ngrams() {
@@ -221,13 +444,14 @@ void VGGraph_Opt::greedy_selection_with_coverage() {
         return;
     }
     
-    std::vector<std::pair<std::string, double>> candidates;
+    std::vector<std::pair<uint32_t, double>> candidates;
     
     // Filter candidates by selectivity threshold
-    for (const auto& pair : graph_nodes_) {
-        if (pair.second.selectivity <= selectivity_threshold_) {
-            double score = pair.second.centrality_score / (pair.second.selectivity + 1e-10);
-            candidates.push_back({pair.first, score});
+    for (uint32_t id = 0; id < graph_nodes_.size(); ++id) {
+        const GraphNode& node = graph_nodes_[id];
+        if (node.selectivity <= selectivity_threshold_) {
+            double score = node.centrality_score / (node.selectivity + 1e-10);
+            candidates.push_back({id, score});
         }
     }
     
@@ -247,8 +471,8 @@ void VGGraph_Opt::greedy_selection_with_coverage() {
     
     // Greedy selection with key upper bound constraint
     for (const auto& candidate : candidates) {
-        const std::string& ngram = candidate.first;
-        const GraphNode& node = graph_nodes_[ngram];
+        GraphNode& node = graph_nodes_[candidate.first];
+        const std::string& ngram = node.ngram;
         
         // Check if we've reached the key upper bound
         if (selected_ngrams.size() >= effective_bound) {
@@ -268,7 +492,7 @@ void VGGraph_Opt::greedy_selection_with_coverage() {
              (selected_ngrams.size() < 100 || new_coverage.size() > 1))) {
             selected_ngrams.insert(ngram);
             covered_documents.insert(node.document_ids.begin(), node.document_ids.end());
-            graph_nodes_[ngram].selected = true;
+            node.selected = true;
         }
         
         // Stop if we have good coverage or reached the limit
@@ -287,7 +511,7 @@ bool VGGraph_Opt::has_sufficient_coverage(const std::set<std::string>& selected_
     std::set<size_t> covered_documents;
     
     for (const std::string& ngram : selected_ngrams) {
-        const auto& doc_ids = graph_nodes_[ngram].document_ids;
+        const auto& doc_ids = graph_nodes_[node_ids_.at(ngram)].document_ids;
         covered_documents.insert(doc_ids.begin(), doc_ids.end());
     }
     
@@ -299,7 +523,7 @@ double VGGraph_Opt::calculate_coverage_score(const std::set<std::string>& select
     std::set<size_t> covered_documents;
     
     for (const std::string& ngram : selected_ngrams) {
-        const auto& doc_ids = graph_nodes_[ngram].document_ids;
+        const auto& doc_ids = graph_nodes_[node_ids_.at(ngram)].document_ids;
         covered_documents.insert(doc_ids.begin(), doc_ids.end());
     }
     
@@ -15,9 +15,10 @@
 #include <vector>
 #include <set>
 #include <thread>
-#include <mutex>
 #include <string>
+#include <string_view>
 #include <algorithm>
+#include <cstdint>
 
 #include "../../ngram_inverted_index.hpp"
 
@@ -28,7 +29,7 @@ class VGGraph_Opt : public NGramInvertedIndex {
     VGGraph_Opt() = delete;
     VGGraph_Opt(const VGGraph_Opt &&) = delete;
     
-    VGGraph_Opt(const std::vector<std::string> & dataset, 
+    VGGraph_Opt(const Dataset & dataset, 
                  float selectivity_threshold, 
                  int upper_n, 
                  int thread_count)
@@ -37,7 +38,7 @@ class VGGraph_Opt : public NGramInvertedIndex {
         upper_n_(upper_n),
         thread_count_(thread_count) {}
     
-    VGGraph_Opt(const std::vector<std::string> & dataset, 
+    VGGraph_Opt(const Dataset & dataset, 
                  const std::vector<std::string> & queries,
                  float selectivity_threshold, 
                  int upper_n, 
@@ -50,6 +51,23 @@ class VGGraph_Opt : public NGramInvertedIndex {
     ~VGGraph_Opt() {}
 
     void build_index(int upper_n = -1) override;
+
+    // MinHash signatures of num_bands * rows_per_band hashes; two n-grams
+    //   are compared only if all rows of some band agree
+    void set_lsh(size_t num_bands, size_t rows_per_band) {
+        num_bands_ = num_bands;
+        rows_per_band_ = rows_per_band;
+    }
+
+    // Betweenness from a uniform sample of BFS sources instead of all of
+    //   them: with probability >= 1 - delta, every node's betweenness
+    //   normalized by n(n-2) is within epsilon of the exact one.
+    //   epsilon 0 (the default) computes it exactly.
+    void set_centrality_sampling(double epsilon, double delta = 0.1, uint64_t seed = 0) {
+        centrality_epsilon_ = epsilon;
+        centrality_delta_ = delta;
+        centrality_seed_ = seed;
+    }
     
  protected:
     void select_grams(int upper_n = -1) override;
@@ -59,12 +77,20 @@ class VGGraph_Opt : public NGramInvertedIndex {
     const int upper_n_;
     const int thread_count_;
 
+    // LSH banding of the MinHash signatures
+    size_t num_bands_ = 64;
+    size_t rows_per_band_ = 2;
+
+    // source sampling of the betweenness centrality
+    double centrality_epsilon_ = 0;
+    double centrality_delta_ = 0.1;
+    uint64_t centrality_seed_ = 0;
+
     // Graph-based structures for n-gram selection
     struct GraphNode {
         std::string ngram;
         double selectivity;
-        std::set<size_t> document_ids;
-        std::vector<std::string> neighbors;
+        std::vector<size_t> document_ids;   // sorted
         double centrality_score;
         bool selected;
         
@@ -73,8 +99,16 @@ class VGGraph_Opt : public NGramInvertedIndex {
                                            centrality_score(0.0), selected(false) {}
     };
 
-    std::unordered_map<std::string, GraphNode> graph_nodes_;
-    std::mutex graph_mutex_;
+    // nodes sorted by n-gram; a node id is its position
+    std::vector<GraphNode> graph_nodes_;
+    std::unordered_map<std::string, uint32_t> node_ids_;
+
+    // adjacency (CSR): the neighbors of node v are
+    //   adjacency_[adjacency_offsets_[v] .. adjacency_offsets_[v + 1]), sorted
+    std::vector<size_t> adjacency_offsets_;
+    std::vector<uint32_t> adjacency_;
+
+    using LocalNgrams = std::unordered_map<std::string_view, std::vector<size_t>>;
 
     // Helper methods for VGGraph algorithm
     void build_variability_graph(int max_n);
@@ -83,17 +117,19 @@ class VGGraph_Opt : public NGramInvertedIndex {
     void select_optimal_ngrams();
     
     // Multi-threaded processing helpers
-    void process_documents_parallel(int start_idx, int end_idx, int max_n);
-    void extract_ngrams_from_document(const std::string& document, 
+    void process_documents_parallel(size_t start_idx, size_t end_idx, int max_n,
+                                    LocalNgrams& local_ngrams);
+    void extract_ngrams_from_document(std::string_view document, 
                                     int max_n, 
-                                    std::unordered_map<std::string, std::set<size_t>>& local_ngrams,
+                                    LocalNgrams& local_ngrams,
                                     size_t doc_id);
     
     // Graph analysis methods
     void build_graph_edges();
-    double calculate_jaccard_similarity(const std::set<size_t>& set1, 
-                                      const std::set<size_t>& set2);
-    double calculate_betweenness_centrality(const std::string& ngram);
+    std::vector<uint64_t> compute_minhash_signatures(size_t num_hashes);
+    double calculate_jaccard_similarity(const std::vector<size_t>& set1, 
+                                      const std::vector<size_t>& set2);
+    std::vector<double> calculate_betweenness_centrality();
     
     // Selection optimization
     void greedy_selection_with_coverage();
@@ -101,8 +137,7 @@ class VGGraph_Opt : public NGramInvertedIndex {
     double calculate_coverage_score(const std::set<std::string>& selected_ngrams);
     
     // Utility methods
-    std::vector<std::string> generate_ngrams(const std::string& text, int n);
-    void merge_local_results(const std::unordered_map<std::string, std::set<size_t>>& local_ngrams);
+    void merge_local_results(std::vector<LocalNgrams>& local_ngrams);
 };
 
 } // namespace vggraph_opt_index
@@ -29,7 +29,7 @@ int main(int argc, char* argv[]) {
     }
 
     // Load dataset
-    std::vector<std::string> dataset;
+    Dataset dataset;
     std::ifstream dataset_stream(dataset_file);
     if (!dataset_stream.is_open()) {
         std::cerr << "Error: Could not open dataset file: " << dataset_file << std::endl;
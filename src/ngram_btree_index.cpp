@@ -4,7 +4,8 @@
 static const std::vector<size_t> k_empty_pos_list_;
 
 long long int NGramBtreeIndex::get_bytes_used() const { 
-    long long int contentSize = k_index_.bytes_used() + k_index_keys_.bytes_used(); 
+    long long int contentSize = k_index_.bytes_used() + k_index_keys_.bytes_used() +
+                                k_key_automaton_.get_bytes_used(); 
     for (const auto & [key, val] : k_index_) {
         // value size
         contentSize += calculate_vector_size(val);
@@ -42,7 +43,7 @@ const std::vector<size_t> & NGramBtreeIndex::get_line_pos_at(
 std::vector<std::string> NGramBtreeIndex::find_all_keys(
         const std::string & reg) const {
     std::vector<std::string> found_keys;
-    auto literals = extract_literals(reg);
+    auto literals = extract_required_literals(reg);
     for (const auto & lit : literals) {
         find_all_keys_helper(lit, found_keys);
     }
@@ -51,6 +52,13 @@ std::vector<std::string> NGramBtreeIndex::find_all_keys(
 
 void NGramBtreeIndex::find_all_keys_helper(
         const std::string & line, std::vector<std::string> & found_keys) const {
+    if (!k_keys_dirty_) {
+        k_key_automaton_.for_each_shortest_match(line, 
+            [&](size_t start, size_t len, uint32_t) {
+                found_keys.emplace_back(line, start, len);
+            });
+        return;
+    }
     for (size_t i = 0; i < line.size(); i++) {
         auto curr_c = line.at(i);
         std::string curr_key = line.substr(i,1);
@@ -4,13 +4,14 @@
 #include "utils/cpp-btree/btree/map.h"
 #include "utils/cpp-btree/btree/set.h"
 #include "ngram_index.hpp"
+#include "utils/aho_corasick.hpp"
 
 class NGramBtreeIndex : public NGramIndex {
  public:
     NGramBtreeIndex() = delete;
     NGramBtreeIndex(const NGramBtreeIndex &&) = delete;
-    NGramBtreeIndex(const std::vector<std::string> & dataset) : NGramIndex(dataset) {}
-    NGramBtreeIndex(const std::vector<std::string> & dataset,
+    NGramBtreeIndex(const Dataset & dataset) : NGramIndex(dataset) {}
+    NGramBtreeIndex(const Dataset & dataset,
         const std::vector<std::string> & queries) : NGramIndex(dataset, queries) {}
     ~NGramBtreeIndex() {}
 
@@ -42,6 +43,20 @@ class NGramBtreeIndex : public NGramIndex {
     btree::set<std::string> k_index_keys_;
     btree::map<std::string, std::vector<size_t>> k_index_;
 
+    /**Automaton over k_index_keys_ used by find_all_keys_helper; 
+     * the btree scan is used instead while it is out of date**/
+    KeyAutomaton k_key_automaton_;
+
+    /**Set whenever k_index_keys_ changes, cleared once k_key_automaton_ 
+     * is rebuilt over them**/
+    bool k_keys_dirty_ = true;
+
+    // call once the keys are selected
+    void build_key_automaton() { 
+        k_key_automaton_.build(k_index_keys_.cbegin(), k_index_keys_.cend()); 
+        k_keys_dirty_ = false;
+    }
+
     void find_all_keys_helper(
         const std::string & line,  std::vector<std::string> & found_keys) const override;
 };
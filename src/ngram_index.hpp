@@ -10,18 +10,23 @@
 #include <chrono>
 #include <climits>
 #include <filesystem>
+#include <algorithm>
+#include <iterator>
 
 #include "utils/reg_utils.hpp"
+#include "utils/utils.hpp"
+#include "utils/intersection.hpp"
+#include "utils/dataset.hpp"
 
 class NGramIndex {
  public:
     NGramIndex() = delete;
     NGramIndex(const NGramIndex &&) = delete;
-    NGramIndex(const std::vector<std::string> & dataset)
+    NGramIndex(const Dataset & dataset)
       : k_dataset_(dataset), k_dataset_size_(dataset.size()),
 	  	k_queries_(empty_queries_), k_queries_size_(0) {}
     
-	NGramIndex(const std::vector<std::string> & dataset,
+	NGramIndex(const Dataset & dataset,
 			  const std::vector<std::string> & queries)
       : k_dataset_(dataset), k_dataset_size_(dataset.size()),
 	  	k_queries_(queries), k_queries_size_(queries.size()) {}
@@ -33,13 +38,56 @@ class NGramIndex {
     // return all substrings of the given string that are keys in the index
     virtual std::vector<std::string> find_all_keys(const std::string & line) const = 0;
 
+    // keys in the index occurring in literal, taken as a plain string (not a regex)
+    std::vector<std::string> find_literal_keys(const std::string & literal) const {
+        std::vector<std::string> found_keys;
+        find_all_keys_helper(literal, found_keys);
+        return found_keys;
+    }
+
     virtual void print_index(bool size_only=false) const = 0;
     
     virtual void wirte_index_keys_to_file(const std::filesystem::path & out_path) const = 0;
 
     virtual const std::vector<size_t> & get_line_pos_at(const std::string & key)  const = 0;
 
-    const std::vector<std::string> & get_dataset() const {
+    // number of lines in the posting list of key, without materializing it
+    virtual size_t get_line_pos_size(const std::string & key) const {
+        return get_line_pos_at(key).size();
+    }
+
+    // keep in container (sorted line ids) only the lines also in the posting list of key
+    virtual void intersect_line_pos_at(const std::string & key, 
+                                       std::vector<size_t> & container) const {
+        sorted_lists_intersection_in_place(container, get_line_pos_at(key));
+    }
+
+    // line ids in the posting lists of all keys (at least one), given in 
+    //   increasing order of posting list size
+    virtual void get_line_pos_intersection(const std::vector<std::string> & keys,
+                                           std::vector<size_t> & container) const {
+        container = get_line_pos_at(keys[0]);
+        for (size_t i = 1; i < keys.size() && !container.empty(); i++) {
+            intersect_line_pos_at(keys[i], container);
+        }
+    }
+
+    // line ids in the posting list of any of keys (at least one)
+    virtual void get_line_pos_union(const std::vector<std::string> & keys,
+                                    std::vector<size_t> & container) const {
+        container = get_line_pos_at(keys[0]);
+        std::vector<size_t> merged;
+        for (size_t i = 1; i < keys.size(); i++) {
+            const auto & list = get_line_pos_at(keys[i]);
+            merged.clear();
+            merged.reserve(container.size() + list.size());
+            std::set_union(container.begin(), container.end(), list.begin(), list.end(),
+                           std::back_inserter(merged));
+            container.swap(merged);
+        }
+    }
+
+    const Dataset & get_dataset() const {
         return k_dataset_;
     }
 
@@ -52,7 +100,7 @@ class NGramIndex {
     std::vector<std::vector<std::string>> get_query_literals() const {
 		std::vector<std::vector<std::string>> query_literals;
 		for (const auto & q : k_queries_) {
-			std::vector<std::string> literals = extract_literals(q);
+			std::vector<std::string> literals = extract_required_literals(q);
 			query_literals.push_back(literals);
 		}
 		return query_literals;
@@ -68,6 +116,8 @@ class NGramIndex {
 
     void set_thread_count(int thread_count) { thread_count_ = thread_count; }
 
+    int get_thread_count() const { return thread_count_; }
+
     void set_key_upper_bound(long long int key_upper_bound) { key_upper_bound_ = key_upper_bound; }
 
     void set_outfile(std::ofstream & outfile) { outfile_ = &outfile; }
@@ -78,7 +128,7 @@ class NGramIndex {
     virtual void select_grams(int upper_n) {};
     
     // the index structure should be stored here
-    const std::vector<std::string> & k_dataset_;
+    const Dataset & k_dataset_;
     const size_t k_dataset_size_;
 
 	const long double k_queries_size_;
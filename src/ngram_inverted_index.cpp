@@ -1,5 +1,8 @@
 #include "ngram_inverted_index.hpp"
 #include "utils/utils.hpp"
+#include "utils/index_file.hpp"
+
+#include <cstring>
 
 static const std::vector<size_t> k_empty_pos_list_;
 
@@ -21,6 +24,30 @@ long long int NGramInvertedIndex::get_bytes_used() const {
         // rbtree; let us just count as 2 ptrs per key
         contentSize += key.size() * sizeof(char) + 2 * sizeof(void*);
     }
+#ifdef COMPRESS_POSTING
+    totalSize += k_packed_index_.bucket_count() * bucketSize;
+    for (const auto & [key, val] : k_packed_index_) {
+        contentSize += key.size() * sizeof(char) + sizeof(void*);
+        contentSize += val.get_bytes_used();
+        contentSize += key.size() * sizeof(char) + 2 * sizeof(void*);
+    }
+#endif
+#ifdef HYBRID_POSTING
+    totalSize += k_hybrid_index_.bucket_count() * bucketSize;
+    for (const auto & [key, val] : k_hybrid_index_) {
+        contentSize += key.size() * sizeof(char) + sizeof(void*);
+        contentSize += val.get_bytes_used();
+        contentSize += key.size() * sizeof(char) + 2 * sizeof(void*);
+    }
+#endif
+    totalSize += k_mapped_index_.bucket_count() * bucketSize;
+    for (const auto & [key, val] : k_mapped_index_) {
+        contentSize += key.size() * sizeof(char) + sizeof(void*);
+        contentSize += sizeof(val) + val.size_bytes();
+        contentSize += key.size() * sizeof(char) + 2 * sizeof(void*);
+    }
+
+    totalSize += k_key_automaton_.get_bytes_used();
 
     totalSize += contentSize;
     return totalSize;
@@ -33,10 +60,10 @@ void NGramInvertedIndex::print_index(bool size_only) const {
     for (const auto & key : k_index_keys_) {
         std::cout << "\"" << key << "\"" << ": ";
         if (size_only) {
-            std::cout << k_index_.at(key).size() << " lines" << std::endl;
+            std::cout << get_line_pos_at(key).size() << " lines" << std::endl;
         } else {
             std::cout << "[";
-            for (auto idx : k_index_.at(key)) {
+            for (auto idx : get_line_pos_at(key)) {
                 std::cout << idx << ",";
             }
             std::cout << "]"  << std::endl;
@@ -59,13 +86,285 @@ const std::vector<size_t> & NGramInvertedIndex::get_line_pos_at(
     if (auto it = k_index_.find(key); it != k_index_.end()) {
         return it->second;
     }
+    // decoded / copied lists are only valid until the next call from the same thread
+    thread_local std::vector<size_t> decoded;
+#ifdef COMPRESS_POSTING
+    if (auto it = k_packed_index_.find(key); it != k_packed_index_.end()) {
+        it->second.decode(decoded);
+        return decoded;
+    }
+#endif
+#ifdef HYBRID_POSTING
+    if (auto it = k_hybrid_index_.find(key); it != k_hybrid_index_.end()) {
+        it->second.decode(decoded);
+        return decoded;
+    }
+#endif
+    if (auto it = k_mapped_index_.find(key); it != k_mapped_index_.end()) {
+        decoded.assign(it->second.begin(), it->second.end());
+        return decoded;
+    }
     return k_empty_pos_list_;
 }
 
+size_t NGramInvertedIndex::get_line_pos_size(const std::string & key) const {
+    if (auto it = k_index_.find(key); it != k_index_.end()) {
+        return it->second.size();
+    }
+#ifdef COMPRESS_POSTING
+    if (auto it = k_packed_index_.find(key); it != k_packed_index_.end()) {
+        return it->second.size();
+    }
+#endif
+#ifdef HYBRID_POSTING
+    if (auto it = k_hybrid_index_.find(key); it != k_hybrid_index_.end()) {
+        return it->second.size();
+    }
+#endif
+    if (auto it = k_mapped_index_.find(key); it != k_mapped_index_.end()) {
+        return it->second.size();
+    }
+    return 0;
+}
+
+void NGramInvertedIndex::intersect_line_pos_at(const std::string & key,
+        std::vector<size_t> & container) const {
+    if (auto it = k_index_.find(key); it != k_index_.end()) {
+        sorted_lists_intersection_in_place(container, it->second);
+        return;
+    }
+#ifdef COMPRESS_POSTING
+    if (auto it = k_packed_index_.find(key); it != k_packed_index_.end()) {
+        it->second.intersect(container);
+        return;
+    }
+#endif
+#ifdef HYBRID_POSTING
+    if (auto it = k_hybrid_index_.find(key); it != k_hybrid_index_.end()) {
+        it->second.intersect(container);
+        return;
+    }
+#endif
+    if (auto it = k_mapped_index_.find(key); it != k_mapped_index_.end()) {
+        sorted_lists_intersection_in_place(container, it->second.data(), it->second.size());
+        return;
+    }
+    container.clear();
+}
+
+void NGramInvertedIndex::get_line_pos_intersection(const std::vector<std::string> & keys,
+        std::vector<size_t> & container) const {
+#ifdef HYBRID_POSTING
+    // intersect chunk by chunk (e.g. AND of bitmap words) while the lists 
+    //   are all hybrid, and decode only the result
+    std::vector<const HybridPostingList *> lists;
+    for (const auto & key : keys) {
+        auto it = k_hybrid_index_.find(key);
+        if (it == k_hybrid_index_.end()) break;
+        lists.push_back(&it->second);
+    }
+    if (keys.size() > 1 && lists.size() == keys.size()) {
+        HybridPostingList result = lists[0]->intersect(*lists[1]);
+        for (size_t i = 2; i < lists.size() && !result.empty(); i++) {
+            result = result.intersect(*lists[i]);
+        }
+        result.decode(container);
+        return;
+    }
+#endif
+    NGramIndex::get_line_pos_intersection(keys, container);
+}
+
+void NGramInvertedIndex::get_line_pos_union(const std::vector<std::string> & keys,
+        std::vector<size_t> & container) const {
+#ifdef HYBRID_POSTING
+    // unite chunk by chunk (e.g. OR of bitmap words) while the lists are 
+    //   all hybrid, and decode only the result
+    std::vector<const HybridPostingList *> lists;
+    for (const auto & key : keys) {
+        auto it = k_hybrid_index_.find(key);
+        if (it == k_hybrid_index_.end()) break;
+        lists.push_back(&it->second);
+    }
+    if (keys.size() > 1 && lists.size() == keys.size()) {
+        HybridPostingList result = lists[0]->unite(*lists[1]);
+        for (size_t i = 2; i < lists.size(); i++) {
+            result = result.unite(*lists[i]);
+        }
+        result.decode(container);
+        return;
+    }
+#endif
+    NGramIndex::get_line_pos_union(keys, container);
+}
+
+bool NGramInvertedIndex::save_index(const std::filesystem::path & path) const {
+    IndexFileHeader header;
+    std::memcpy(header.magic, kIndexFileMagic, sizeof(header.magic));
+    header.version = kIndexFileVersion;
+    header.id_bytes = sizeof(size_t);
+    header.dataset_size = k_dataset_size_;
+    header.dataset_checksum = dataset_checksum(k_dataset_);
+    header.num_keys = k_index_keys_.size();
+
+    std::vector<uint64_t> key_offsets{0};
+    std::vector<uint64_t> posting_offsets{0};
+    key_offsets.reserve(header.num_keys + 1);
+    posting_offsets.reserve(header.num_keys + 1);
+    for (const auto & key : k_index_keys_) {
+        key_offsets.push_back(key_offsets.back() + key.size());
+        posting_offsets.push_back(posting_offsets.back() + get_line_pos_size(key));
+    }
+    header.key_bytes = key_offsets.back();
+    header.num_ids = posting_offsets.back();
+
+    std::ofstream outfile(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!outfile) {
+        std::cerr << "Cannot open index file " << path << " for writing" << std::endl;
+        return false;
+    }
+    outfile.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    outfile.write(reinterpret_cast<const char *>(key_offsets.data()),
+                  key_offsets.size() * sizeof(uint64_t));
+    outfile.write(reinterpret_cast<const char *>(posting_offsets.data()),
+                  posting_offsets.size() * sizeof(uint64_t));
+    for (const auto & key : k_index_keys_) {
+        outfile.write(key.data(), key.size());
+    }
+    static const char padding[8] = {};
+    outfile.write(padding, pad_to_8(header.key_bytes) - header.key_bytes);
+    for (const auto & key : k_index_keys_) {
+        const auto & pos = get_line_pos_at(key);
+        outfile.write(reinterpret_cast<const char *>(pos.data()), pos.size() * sizeof(size_t));
+    }
+    outfile.close();
+    if (!outfile) {
+        std::cerr << "Failed writing index file " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool NGramInvertedIndex::load_index(const std::filesystem::path & path) {
+    auto file = std::make_unique<MappedFile>();
+    if (!file->open(path)) {
+        std::cerr << "Cannot map index file " << path << std::endl;
+        return false;
+    }
+    IndexFileHeader header;
+    if (file->size() < sizeof(header)) {
+        std::cerr << "Index file " << path << " is truncated" << std::endl;
+        return false;
+    }
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (std::memcmp(header.magic, kIndexFileMagic, sizeof(header.magic)) != 0 ||
+        header.version != kIndexFileVersion || header.id_bytes != sizeof(size_t)) {
+        std::cerr << "Index file " << path << " has an unsupported format" << std::endl;
+        return false;
+    }
+    if (header.dataset_size != k_dataset_size_ ||
+        header.dataset_checksum != dataset_checksum(k_dataset_)) {
+        std::cerr << "Index file " << path << " was built over another dataset" << std::endl;
+        return false;
+    }
+    // sections are sized against the bytes left, as the counts in the 
+    //   header may be anything and their products overflow
+    size_t remaining = file->size() - sizeof(header);
+    if (header.num_keys >= remaining / (2 * sizeof(uint64_t))) {
+        std::cerr << "Index file " << path << " is truncated" << std::endl;
+        return false;
+    }
+    size_t offsets_bytes = 2 * (header.num_keys + 1) * sizeof(uint64_t);
+    remaining -= offsets_bytes;
+    if (header.key_bytes > remaining || pad_to_8(header.key_bytes) > remaining) {
+        std::cerr << "Index file " << path << " is truncated" << std::endl;
+        return false;
+    }
+    remaining -= pad_to_8(header.key_bytes);
+    if (header.num_ids > remaining / sizeof(size_t) ||
+        remaining != header.num_ids * sizeof(size_t)) {
+        std::cerr << "Index file " << path << " is truncated" << std::endl;
+        return false;
+    }
+
+    const char * base = file->data() + sizeof(header);
+    auto key_offsets = reinterpret_cast<const uint64_t *>(base);
+    auto posting_offsets = key_offsets + header.num_keys + 1;
+    const char * keys = base + offsets_bytes;
+    auto ids = reinterpret_cast<const size_t *>(keys + pad_to_8(header.key_bytes));
+    for (size_t i = 0; i < header.num_keys; i++) {
+        if (key_offsets[i] > key_offsets[i+1] || posting_offsets[i] > posting_offsets[i+1]) {
+            std::cerr << "Index file " << path << " is corrupted" << std::endl;
+            return false;
+        }
+    }
+    if (key_offsets[header.num_keys] != header.key_bytes ||
+        posting_offsets[header.num_keys] != header.num_ids) {
+        std::cerr << "Index file " << path << " is corrupted" << std::endl;
+        return false;
+    }
+    // the lists are used in place, so they have to be what the index
+    //   builds: strictly ascending line ids of the dataset
+    for (size_t i = 0; i < header.num_keys; i++) {
+        for (size_t j = posting_offsets[i]; j < posting_offsets[i+1]; j++) {
+            if (ids[j] >= k_dataset_size_ || (j > posting_offsets[i] && ids[j] <= ids[j-1])) {
+                std::cerr << "Index file " << path << " is corrupted" << std::endl;
+                return false;
+            }
+        }
+    }
+
+    k_index_.clear();
+    k_index_keys_.clear();
+#ifdef COMPRESS_POSTING
+    k_packed_index_.clear();
+#endif
+#ifdef HYBRID_POSTING
+    k_hybrid_index_.clear();
+#endif
+    k_mapped_index_.clear();
+    k_mapped_index_.reserve(header.num_keys);
+    for (size_t i = 0; i < header.num_keys; i++) {
+        std::string key(keys + key_offsets[i], key_offsets[i+1] - key_offsets[i]);
+        k_mapped_index_.emplace(key, std::span<const size_t>(
+            ids + posting_offsets[i], posting_offsets[i+1] - posting_offsets[i]));
+        // keys are stored sorted; hint the insertion at the end
+        k_index_keys_.emplace_hint(k_index_keys_.end(), std::move(key));
+    }
+    k_mapped_file_ = std::move(file);
+    k_key_automaton_.build(k_index_keys_.cbegin(), k_index_keys_.cend());
+    k_keys_dirty_ = false;
+    return true;
+}
+
+void NGramInvertedIndex::finalize_index() {
+    k_key_automaton_.build(k_index_keys_.cbegin(), k_index_keys_.cend());
+    k_keys_dirty_ = false;
+    compress_posting();
+}
+
+void NGramInvertedIndex::compress_posting() {
+#ifdef COMPRESS_POSTING
+    k_packed_index_.reserve(k_index_.size());
+    for (auto & [key, val] : k_index_) {
+        k_packed_index_.emplace(key, PackedPostingList(val));
+        decltype(k_index_)::mapped_type().swap(val);
+    }
+    decltype(k_index_)().swap(k_index_);
+#elif defined(HYBRID_POSTING)
+    k_hybrid_index_.reserve(k_index_.size());
+    for (auto & [key, val] : k_index_) {
+        k_hybrid_index_.emplace(key, HybridPostingList(val));
+        decltype(k_index_)::mapped_type().swap(val);
+    }
+    decltype(k_index_)().swap(k_index_);
+#endif
+}
+
 std::vector<std::string> NGramInvertedIndex::find_all_keys(
         const std::string & reg) const {
     std::vector<std::string> found_keys;
-    auto literals = extract_literals(reg);
+    auto literals = extract_required_literals(reg);
     for (const auto & lit : literals) {
         find_all_keys_helper(lit, found_keys);
     }
@@ -74,6 +373,15 @@ std::vector<std::string> NGramInvertedIndex::find_all_keys(
 
 void NGramInvertedIndex::find_all_keys_helper(
         const std::string & line, std::vector<std::string> & found_keys) const {
+    if (!k_keys_dirty_) {
+        // the shortest key at each position, as the scan below picks the
+        //   smallest matching key in lexicographic order
+        k_key_automaton_.for_each_shortest_match(line, 
+            [&](size_t start, size_t len, uint32_t) {
+                found_keys.emplace_back(line, start, len);
+            });
+        return;
+    }
     for (size_t i = 0; i < line.size(); i++) {
         auto curr_c = line.at(i);
         std::string curr_key = line.substr(i,1);
@@ -2,19 +2,29 @@
 #define NGRAM_INVERTED_INDEX_HPP_
 
 #include <unordered_map>
+#include <memory>
+#include <span>
 #include "ngram_index.hpp"
+#include "utils/mapped_file.hpp"
+#include "utils/aho_corasick.hpp"
+#ifdef COMPRESS_POSTING
+#include "utils/packed_posting.hpp"
+#endif
+#ifdef HYBRID_POSTING
+#include "utils/hybrid_posting.hpp"
+#endif
 
 class NGramInvertedIndex : public NGramIndex {
  public:
     NGramInvertedIndex() = delete;
     NGramInvertedIndex(const NGramInvertedIndex &&) = delete;
-    NGramInvertedIndex(const std::vector<std::string> & dataset) : NGramIndex(dataset) {
+    NGramInvertedIndex(const Dataset & dataset) : NGramIndex(dataset) {
         // https://www.geeksforgeeks.org/how-to-use-unordered_map-efficiently-in-c/
         k_index_.reserve(1024); // RESERVING SPACE BEFOREHAND
         k_index_.max_load_factor(0.25); // DECREASING MAX_LOAD_FACTOR
     }
     
-    NGramInvertedIndex(const std::vector<std::string> & dataset, 
+    NGramInvertedIndex(const Dataset & dataset, 
             const std::vector<std::string> & queries) : NGramIndex(dataset, queries) {
         // https://www.geeksforgeeks.org/how-to-use-unordered_map-efficiently-in-c/
         k_index_.reserve(1024); // RESERVING SPACE BEFOREHAND
@@ -38,6 +48,26 @@ class NGramInvertedIndex : public NGramIndex {
 
     const std::vector<size_t> & get_line_pos_at(const std::string & key) const override;
 
+    size_t get_line_pos_size(const std::string & key) const override;
+
+    void intersect_line_pos_at(const std::string & key, 
+                               std::vector<size_t> & container) const override;
+
+    void get_line_pos_intersection(const std::vector<std::string> & keys,
+                                   std::vector<size_t> & container) const override;
+
+    void get_line_pos_union(const std::vector<std::string> & keys,
+                            std::vector<size_t> & container) const override;
+
+    /**Write keys and posting lists to a binary index file (see utils/index_file.hpp);
+     * return false if the file cannot be written**/
+    bool save_index(const std::filesystem::path & path) const;
+
+    /**Replace the index by the one saved at path, mapped into memory; posting
+     * lists are read in place from the mapping. Return false (leaving the index
+     * untouched) if the file is not a valid index over the current dataset**/
+    bool load_index(const std::filesystem::path & path);
+
     bool empty() const override { return k_index_keys_.empty(); }
 
     size_t get_num_keys() const override { return k_index_keys_.size(); }
@@ -49,6 +79,36 @@ class NGramInvertedIndex : public NGramIndex {
     std::unordered_map<std::string, std::vector<size_t>> k_index_;
     std::set<std::string> k_index_keys_;
 
+#ifdef COMPRESS_POSTING
+    /**Same as k_index_, with posting lists delta encoded and bit-packed**/
+    std::unordered_map<std::string, PackedPostingList> k_packed_index_;
+#endif
+
+#ifdef HYBRID_POSTING
+    /**Same as k_index_, with posting lists in array, bitmap or run containers**/
+    std::unordered_map<std::string, HybridPostingList> k_hybrid_index_;
+#endif
+
+    /**Posting lists of a loaded index, pointing into k_mapped_file_**/
+    std::unordered_map<std::string, std::span<const size_t>> k_mapped_index_;
+    std::unique_ptr<MappedFile> k_mapped_file_;
+
+    /**Automaton over k_index_keys_ used by find_all_keys_helper; 
+     * the std::set scan is used instead while it is out of date**/
+    KeyAutomaton k_key_automaton_;
+
+    /**Set whenever k_index_keys_ changes, cleared once k_key_automaton_ 
+     * is rebuilt over them**/
+    bool k_keys_dirty_ = true;
+
+    /**Called once the keys and all posting lists are filled: compiles the key 
+     * automaton and compresses the posting lists**/
+    void finalize_index();
+
+    /**Move the posting lists in k_index_ to their compressed form, 
+     * if compiled with COMPRESS_POSTING or HYBRID_POSTING**/
+    void compress_posting();
+
     void find_all_keys_helper(
         const std::string & line,  std::vector<std::string> & found_keys) const override;
 };
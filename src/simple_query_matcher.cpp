@@ -1,44 +1,249 @@
 #include "simple_query_matcher.hpp"
+#include <algorithm>
+#include <iterator>
+#include <cmath>
 #include "utils/utils.hpp"
+#include "utils/work_stealing_pool.hpp"
 
 bool SimpleQueryMatcher::get_indexed(const std::string & reg,
                                      std::vector<size_t> & container) const {
-    long count = 0;
-    auto all_keys = k_index_.find_all_keys(reg);
-    if (all_keys.empty()) {
+    auto plan = compile_plan(parse_query_plan(reg));
+    if (plan.is_all()) {
         return false;
     }
-    container.clear();
-    bool is_first = true;
-    for (const auto & key : all_keys) {
-        if (is_first) {
-            container = k_index_.get_line_pos_at(key);
-            is_first = false;
+    evaluate_plan(plan, container);
+    return true;
+}
+
+QueryPlan SimpleQueryMatcher::compile_plan(const QueryPlan & plan) const {
+    if (plan.type == QueryPlan::Type::kLiteral) {
+        auto keys = k_index_.find_literal_keys(plan.literal);
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        std::vector<QueryPlan> key_plans;
+        key_plans.reserve(keys.size());
+        for (auto & key : keys) {
+            key_plans.push_back(QueryPlan::of_literal(std::move(key)));
+        }
+        return QueryPlan::make(QueryPlan::Type::kAnd, std::move(key_plans));
+    }
+    if (plan.is_all()) {
+        return QueryPlan::all();
+    }
+    std::vector<QueryPlan> children;
+    children.reserve(plan.children.size());
+    for (const auto & child : plan.children) {
+        children.push_back(compile_plan(child));
+    }
+    return QueryPlan::make(plan.type, std::move(children));
+}
+
+size_t SimpleQueryMatcher::estimate_plan_size(const QueryPlan & plan) const {
+    if (plan.type == QueryPlan::Type::kLiteral) {
+        return k_index_.get_line_pos_size(plan.literal);
+    }
+    if (plan.type == QueryPlan::Type::kAnd) {
+        size_t size = k_index_.get_dataset_size();
+        for (const auto & child : plan.children) {
+            size = std::min(size, estimate_plan_size(child));
+        }
+        return size;
+    }
+    if (plan.type == QueryPlan::Type::kOr) {
+        size_t size = 0;
+        for (const auto & child : plan.children) {
+            size += estimate_plan_size(child);
+        }
+        return std::min(size, k_index_.get_dataset_size());
+    }
+    return k_index_.get_dataset_size();
+}
+
+void SimpleQueryMatcher::evaluate_plan(const QueryPlan & plan,
+                                       std::vector<size_t> & container) const {
+    if (plan.type == QueryPlan::Type::kLiteral) {
+        container = k_index_.get_line_pos_at(plan.literal);
+        return;
+    }
+    // keys are evaluated together (intersect_keys for an AND, a union of 
+    //   posting lists for an OR), the other children one by one
+    std::vector<std::pair<size_t, std::string>> keys;
+    std::vector<std::pair<size_t, const QueryPlan *>> others;
+    for (const auto & child : plan.children) {
+        if (child.type == QueryPlan::Type::kLiteral) {
+            keys.emplace_back(k_index_.get_line_pos_size(child.literal), child.literal);
         } else {
-            auto curr_idxs = k_index_.get_line_pos_at(key);
-            container = sorted_lists_intersection(container, curr_idxs);
+            others.emplace_back(estimate_plan_size(child), &child);
         }
     }
-    return true;
+
+    if (plan.type == QueryPlan::Type::kAnd) {
+        std::sort(keys.begin(), keys.end());
+        std::sort(others.begin(), others.end());
+        size_t next = 0;
+        if (!keys.empty()) {
+            intersect_keys(keys, container);
+        } else {
+            evaluate_plan(*others[next++].second, container);
+        }
+        // an OR is only evaluated if the lines it is expected to remove 
+        //   (taking it as independent) save more than it costs
+        const double num_lines = std::max<size_t>(1, k_index_.get_dataset_size());
+        std::vector<size_t> child_lines;
+        for (; next < others.size() && !container.empty(); next++) {
+            double size = others[next].first;
+            double saving = container.size() * (1.0 - size / num_lines) * verify_cost_ -
+                            size - intersection_cost(container.size(), size);
+            if (saving <= 0) continue;
+            evaluate_plan(*others[next].second, child_lines);
+            sorted_lists_intersection_in_place(container, child_lines);
+        }
+        return;
+    }
+
+    // OR
+    std::vector<std::string> key_strs;
+    key_strs.reserve(keys.size());
+    for (auto & [size, key] : keys) {
+        key_strs.push_back(std::move(key));
+    }
+    size_t next = 0;
+    if (!key_strs.empty()) {
+        k_index_.get_line_pos_union(key_strs, container);
+    } else {
+        evaluate_plan(*others[next++].second, container);
+    }
+    std::vector<size_t> child_lines, merged;
+    for (; next < others.size(); next++) {
+        evaluate_plan(*others[next].second, child_lines);
+        merged.clear();
+        merged.reserve(container.size() + child_lines.size());
+        std::set_union(container.begin(), container.end(),
+                       child_lines.begin(), child_lines.end(), std::back_inserter(merged));
+        container.swap(merged);
+    }
+}
+
+double SimpleQueryMatcher::intersection_cost(double size_a, double size_b) {
+    double small = std::min(size_a, size_b);
+    double large = std::max(size_a, size_b);
+    if (small == 0) return 0;
+    if (large >= kGallopRatio * small) {
+        return small * (1 + std::log2(large / small));
+    }
+    return small + large;
+}
+
+void SimpleQueryMatcher::intersect_keys(std::vector<std::pair<size_t, std::string>> & keys,
+                                        std::vector<size_t> & container) const {
+    // the shortest list is always worth it: it is no longer than a full scan
+    container = k_index_.get_line_pos_at(keys[0].second);
+    keys.erase(keys.begin());
+
+    std::vector<size_t> sample, kept, best_kept;
+    while (!keys.empty() && !container.empty()) {
+        // candidates spread evenly over the current ones; all of them if few
+        size_t num_sample = std::min(container.size(), kSelectivitySample);
+        sample.resize(num_sample);
+        for (size_t i = 0; i < num_sample; i++) {
+            sample[i] = container[i * container.size() / num_sample];
+        }
+
+        size_t best = keys.size();
+        double best_saving = 0;
+        for (size_t i = 0; i < keys.size(); i++) {
+            kept = sample;
+            k_index_.intersect_line_pos_at(keys[i].second, kept);
+            double num_removed = container.size() * (1.0 - double(kept.size()) / num_sample);
+            double saving = num_removed * verify_cost_ -
+                            intersection_cost(container.size(), keys[i].first);
+            if (saving > best_saving) {
+                best_saving = saving;
+                best = i;
+                best_kept.swap(kept);
+            }
+        }
+        if (best == keys.size()) {
+            break;
+        }
+        if (num_sample == container.size()) {
+            // the sample was the whole candidate set
+            container.swap(best_kept);
+        } else {
+            k_index_.intersect_line_pos_at(keys[best].second, container);
+        }
+        keys.erase(keys.begin() + best);
+    }
+}
+
+long SimpleQueryMatcher::count_matches(const RE2 & compiled_reg,
+                                       const std::vector<size_t> * idxs,
+                                       size_t begin, size_t end) const {
+    const auto & dataset = k_index_.get_dataset();
+    long count = 0;
+    if (idxs) {
+        for (size_t i = begin; i < end; i++) {
+            count += RE2::PartialMatch(dataset[(*idxs)[i]], compiled_reg);
+        }
+    } else {
+        for (size_t i = begin; i < end; i++) {
+            count += RE2::PartialMatch(dataset[i], compiled_reg);
+        }
+    }
+    return count;
 }
 
 long SimpleQueryMatcher::match_one_helper(
         const std::string & reg, 
         const std::shared_ptr<RE2> compiled_reg) {
-    auto dataset = k_index_.get_dataset();
-    long count = 0;
     std::vector<size_t> idx_list;
     if (get_indexed(reg, idx_list)) {
-        for (auto idx : idx_list) {
-            count += RE2::PartialMatch(dataset[idx], *compiled_reg);
-        }
-    } else {
-        for (const auto & l : dataset) {
-            count += RE2::PartialMatch(l, *compiled_reg);
-        }
+        return count_matches(*compiled_reg, &idx_list, 0, idx_list.size());
     }
+    return count_matches(*compiled_reg, nullptr, 0, k_index_.get_dataset_size());
+}
 
-    return count;
+std::vector<long> SimpleQueryMatcher::match_all_parallel() {
+    std::vector<const std::string *> regs;
+    std::vector<const RE2 *> compiled_regs;
+    regs.reserve(reg_evals_.size());
+    compiled_regs.reserve(reg_evals_.size());
+    for (const auto & [reg, compiled_reg] : reg_evals_) {
+        regs.push_back(&reg);
+        compiled_regs.push_back(compiled_reg.get());
+    }
+    const size_t num_regs = regs.size();
+    std::vector<std::vector<size_t>> idx_lists(num_regs);
+    std::vector<std::atomic<long>> counts(num_regs);
+
+    // one task per query looks up its candidates, then splits them into 
+    //   chunks so that a query falling back to a full scan is shared out
+    WorkStealingPool pool(thread_count_);
+    for (size_t q = 0; q < num_regs; q++) {
+        pool.submit([&, q](WorkStealingPool & p, size_t wid) {
+            const std::vector<size_t> * idxs = nullptr;
+            size_t num_lines = k_index_.get_dataset_size();
+            if (get_indexed(*regs[q], idx_lists[q])) {
+                idxs = &idx_lists[q];
+                num_lines = idxs->size();
+            }
+            for (size_t begin = 0; begin < num_lines; begin += kMatchChunkSize) {
+                size_t end = std::min(begin + kMatchChunkSize, num_lines);
+                p.submit([&, q, idxs, begin, end](WorkStealingPool &, size_t) {
+                    counts[q].fetch_add(count_matches(*compiled_regs[q], idxs, begin, end),
+                                        std::memory_order_relaxed);
+                }, wid);
+            }
+        }, q);
+    }
+    pool.run();
+
+    std::vector<long> result;
+    result.reserve(num_regs);
+    for (const auto & c : counts) {
+        result.push_back(c.load());
+    }
+    return result;
 }
 
 std::vector<long> SimpleQueryMatcher::match_all() {
@@ -48,10 +253,13 @@ std::vector<long> SimpleQueryMatcher::match_all() {
 
     auto start = std::chrono::high_resolution_clock::now();
     std::vector<long> counts;
-    counts.reserve(reg_evals_.size());
-
-    for (const auto & [reg, compiled_reg] : reg_evals_) {
-        counts.push_back(match_one_helper(reg, compiled_reg));
+    if (thread_count_ > 1) {
+        counts = match_all_parallel();
+    } else {
+        counts.reserve(reg_evals_.size());
+        for (const auto & [reg, compiled_reg] : reg_evals_) {
+            counts.push_back(match_one_helper(reg, compiled_reg));
+        }
     }
     auto elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(
         std::chrono::high_resolution_clock::now() - start).count();
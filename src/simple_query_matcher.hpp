@@ -2,10 +2,13 @@
 #define SIMPLE_QUERY_MATCHER_HPP_
 
 #include <memory>
+#include <unordered_map>
 #include <re2/re2.h>
 #include <cassert>
+#include <algorithm>
 
 #include "ngram_index.hpp"
+#include "utils/query_plan.hpp"
 
 class SimpleQueryMatcher {
  public:
@@ -14,13 +17,14 @@ class SimpleQueryMatcher {
     SimpleQueryMatcher(const NGramIndex & index, 
                  const std::vector<std::string> & regs,
                  bool compile=true) 
-                 : k_index_(index) {
+                 : k_index_(index), thread_count_(index.get_thread_count()) {
         if (compile) {
             compile_all_queries(regs);
         }
     }
 
-    SimpleQueryMatcher(const NGramIndex & index, bool compile=true) : k_index_(index) {
+    SimpleQueryMatcher(const NGramIndex & index, bool compile=true) 
+        : k_index_(index), thread_count_(index.get_thread_count()) {
         auto regs = k_index_.get_queries();
         assert(!regs.empty() &&
             "If the index has no regexes, pass in the regex set as second parameter");
@@ -35,6 +39,14 @@ class SimpleQueryMatcher {
 
     size_t get_num_after_filter(const std::string & reg) const;
 
+    // number of threads match_all runs the queries on; defaults to the index's
+    void set_thread_count(int thread_count) { thread_count_ = std::max(1, thread_count); }
+
+    /**Cost of verifying one candidate line with RE2, in posting list ids
+     * stepped over by an intersection; defaults to kVerifyCostPerLine plus
+     * kVerifyCostPerByte per byte of an average line**/
+    void set_verify_cost(double verify_cost) { verify_cost_ = verify_cost; }
+
     ~SimpleQueryMatcher() {}
 
  protected:
@@ -42,10 +54,62 @@ class SimpleQueryMatcher {
 
     std::unordered_map<std::string, std::shared_ptr<RE2>> reg_evals_;
 
+    int thread_count_ = 1;
+
+    // lines per task when match_all splits a query's candidates across threads
+    static constexpr size_t kMatchChunkSize = 1024;
+
+    // RE2 takes about 100 ns per line plus 2.5 ns per byte, an intersection
+    //   about 5 ns per id
+    static constexpr double kVerifyCostPerLine = 20;
+    static constexpr double kVerifyCostPerByte = 0.5;
+
+    // candidates probed against a posting list to estimate how many it keeps
+    static constexpr size_t kSelectivitySample = 64;
+
+    double verify_cost_ = kVerifyCostPerLine + kVerifyCostPerByte *
+        k_index_.get_dataset().num_bytes() / std::max<size_t>(1, k_index_.get_dataset_size());
+
+    /**Candidate lines of reg from the index, by its AND/OR plan of keys;
+     * return false if the plan gives no filter (all lines are candidates)**/
     virtual bool get_indexed(const std::string & reg, std::vector<size_t> & container) const;
 
+    /**Replace each literal of plan by the AND of the index keys it contains,
+     * or by kAll if it contains none, so that the leaves are keys**/
+    QueryPlan compile_plan(const QueryPlan & plan) const;
+
+    /**Lines satisfying (at least) a compiled plan that is not kAll: an AND
+     * intersects the posting lists of its keys worth it (intersect_keys) and
+     * then its ORs worth it, an OR unites its children**/
+    void evaluate_plan(const QueryPlan & plan, std::vector<size_t> & container) const;
+
+    // upper bound of the number of lines satisfying a compiled plan
+    size_t estimate_plan_size(const QueryPlan & plan) const;
+
+    /**Lines in the posting lists of keys (sorted by posting list size), 
+     * intersecting only the lists worth it: starting from the shortest one,
+     * repeatedly pick the key saving the most verification cost net of its
+     * intersection cost, and stop when none saves anything. How many 
+     * candidates a list keeps is estimated by probing a sample of them, so
+     * grams that occur together (e.g. of the same literal) are not 
+     * expected to filter more than they do**/
+    void intersect_keys(std::vector<std::pair<size_t, std::string>> & keys,
+                        std::vector<size_t> & container) const;
+
+    // ids stepped over to intersect sorted lists of these sizes, as done by
+    //   sorted_lists_intersection_in_place
+    static double intersection_cost(double size_a, double size_b);
+
     long match_one_helper(const std::string & reg, const std::shared_ptr<RE2> compiled_reg);
 
+    /**Count the matches of compiled_reg over the lines [begin, end) of the 
+     * dataset, or over the lines idxs[begin, end) if idxs is given**/
+    long count_matches(const RE2 & compiled_reg, const std::vector<size_t> * idxs,
+                       size_t begin, size_t end) const;
+
+    // match_all with (query, candidate range) tasks on a work-stealing pool
+    std::vector<long> match_all_parallel();
+
     void compile_all_queries(const std::vector<std::string> & regs, bool log=true) {
         auto start = std::chrono::high_resolution_clock::now();
         for (const auto & reg_str : regs) {
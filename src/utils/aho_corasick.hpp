@@ -0,0 +1,212 @@
+#ifndef UTILS_AHO_CORASICK_HPP_
+#define UTILS_AHO_CORASICK_HPP_
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+/**
+ * Aho-Corasick automaton over a fixed set of keys, compiled into flat arrays:
+ *   the children of each node are contiguous and sorted by label (CSR), the
+ *   root has a full 256-entry transition table. Finds every key occurring in
+ *   a text in one pass over the text, without allocating.
+ * Keys get ids in the order they are given to build().
+ */
+class KeyAutomaton {
+ public:
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    KeyAutomaton() { clear(); }
+    ~KeyAutomaton() {}
+
+    template<class InputIt>
+    void build(InputIt first, InputIt last) {
+        clear();
+        // plain trie first; children unsorted
+        std::vector<std::vector<std::pair<unsigned char, uint32_t>>> trie(1);
+        std::vector<uint32_t> trie_key_id(1, kNone);
+        for (; first != last; ++first) {
+            const std::string & key = *first;
+            uint32_t id = num_keys_++;
+            if (key.empty()) continue;
+            uint32_t node = 0;
+            for (unsigned char c : key) {
+                uint32_t next = kNone;
+                for (const auto & [label, child] : trie[node]) {
+                    if (label == c) { next = child; break; }
+                }
+                if (next == kNone) {
+                    next = trie.size();
+                    trie[node].emplace_back(c, next);
+                    trie.emplace_back();
+                    trie_key_id.push_back(kNone);
+                }
+                node = next;
+            }
+            trie_key_id[node] = id;
+        }
+
+        // renumber the nodes in BFS order, laying the edges out as CSR and
+        //   computing the failure links on the way (parents come first)
+        size_t num_nodes = trie.size();
+        edge_begin_.reserve(num_nodes + 1);
+        edge_label_.reserve(num_nodes - 1);
+        edge_target_.reserve(num_nodes - 1);
+        fail_.assign(num_nodes, 0);
+        dict_.assign(num_nodes, kNone);
+        depth_.assign(num_nodes, 0);
+        key_id_.assign(num_nodes, kNone);
+        std::vector<uint32_t> order{0};     // BFS position -> trie node
+        key_id_[0] = trie_key_id[0];
+        for (size_t u = 0; u < order.size(); u++) {
+            auto & children = trie[order[u]];
+            std::sort(children.begin(), children.end());
+            edge_begin_.push_back(edge_label_.size());
+            for (const auto & [label, child] : children) {
+                uint32_t v = order.size();
+                order.push_back(child);
+                edge_label_.push_back(label);
+                edge_target_.push_back(v);
+                depth_[v] = depth_[u] + 1;
+                key_id_[v] = trie_key_id[child];
+                if (u == 0) {
+                    root_next_[label] = v;
+                    continue;
+                }
+                uint32_t f = fail_[u];
+                uint32_t t = next_state(f, label);
+                while (t == kNone && f != 0) {
+                    f = fail_[f];
+                    t = next_state(f, label);
+                }
+                fail_[v] = t == kNone ? 0 : t;
+                dict_[v] = key_id_[fail_[v]] != kNone ? fail_[v] : dict_[fail_[v]];
+            }
+        }
+        edge_begin_.push_back(edge_label_.size());
+    }
+
+    void clear() {
+        num_keys_ = 0;
+        std::fill(std::begin(root_next_), std::end(root_next_), kNone);
+        edge_begin_.clear();
+        edge_label_.clear();
+        edge_target_.clear();
+        fail_.clear();
+        dict_.clear();
+        depth_.clear();
+        key_id_.clear();
+    }
+
+    bool empty() const { return num_keys_ == 0; }
+
+    size_t get_num_keys() const { return num_keys_; }
+
+    // call f(start, length, key_id) for every occurrence of every key in text;
+    //   occurrences are reported by end position, longest first
+    template<class F>
+    void for_each_match(std::string_view text, F && f) const {
+        if (edge_begin_.empty()) return;
+        uint32_t s = 0;
+        for (size_t j = 0; j < text.size(); j++) {
+            unsigned char c = text[j];
+            uint32_t t = next_state(s, c);
+            while (t == kNone && s != 0) {
+                s = fail_[s];
+                t = next_state(s, c);
+            }
+            s = t == kNone ? 0 : t;
+            for (uint32_t v = key_id_[s] != kNone ? s : dict_[s]; v != kNone; v = dict_[v]) {
+                f(j + 1 - depth_[v], size_t(depth_[v]), key_id_[v]);
+            }
+        }
+    }
+
+    // call f(key_id) once for every key occurring in text whose
+    //   last_seen[key_id] != line, setting it to line; last_seen is indexed
+    //   by key id and line must differ between texts (e.g. the record id).
+    //   The keys along a failure chain were all seen when its head was, so
+    //   the walk stops at the first seen one: a record costs its length plus
+    //   its number of distinct keys, even over substring-closed key sets
+    template<class F>
+    void for_each_new_key(std::string_view text, std::vector<size_t> & last_seen,
+                          size_t line, F && f) const {
+        if (edge_begin_.empty()) return;
+        uint32_t s = 0;
+        for (size_t j = 0; j < text.size(); j++) {
+            unsigned char c = text[j];
+            uint32_t t = next_state(s, c);
+            while (t == kNone && s != 0) {
+                s = fail_[s];
+                t = next_state(s, c);
+            }
+            s = t == kNone ? 0 : t;
+            for (uint32_t v = key_id_[s] != kNone ? s : dict_[s]; v != kNone; v = dict_[v]) {
+                if (last_seen[key_id_[v]] == line) break;
+                last_seen[key_id_[v]] = line;
+                f(key_id_[v]);
+            }
+        }
+    }
+
+    // call f(start, length, key_id) for the shortest key starting at each
+    //   position of text that starts any key, in order of start position
+    template<class F>
+    void for_each_shortest_match(std::string_view text, F && f) const {
+        thread_local std::vector<uint32_t> shortest;
+        shortest.assign(text.size(), kNone);
+        // the first end position reporting a start is its shortest key
+        for_each_match(text, [&](size_t start, size_t len, uint32_t) {
+            if (shortest[start] == kNone) shortest[start] = len;
+        });
+        for (size_t i = 0; i < text.size(); i++) {
+            if (shortest[i] == kNone) continue;
+            uint32_t s = 0;
+            for (size_t j = i; j < i + shortest[i]; j++) {
+                s = next_state(s, text[j]);
+            }
+            f(i, size_t(shortest[i]), key_id_[s]);
+        }
+    }
+
+    long long int get_bytes_used() const {
+        return sizeof(KeyAutomaton) +
+               edge_begin_.capacity() * sizeof(uint32_t) +
+               edge_label_.capacity() * sizeof(unsigned char) +
+               edge_target_.capacity() * sizeof(uint32_t) +
+               (fail_.capacity() + dict_.capacity() + depth_.capacity() +
+                key_id_.capacity()) * sizeof(uint32_t);
+    }
+
+ private:
+    size_t num_keys_ = 0;
+    uint32_t root_next_[256];
+    std::vector<uint32_t> edge_begin_;          // node -> first edge; size num_nodes + 1
+    std::vector<unsigned char> edge_label_;
+    std::vector<uint32_t> edge_target_;
+    std::vector<uint32_t> fail_;                // longest proper suffix that is a node
+    std::vector<uint32_t> dict_;                // next key node along the failure links
+    std::vector<uint32_t> depth_;
+    std::vector<uint32_t> key_id_;              // kNone if no key ends at the node
+
+    uint32_t next_state(uint32_t s, unsigned char c) const {
+        if (s == 0) return root_next_[c];
+        size_t b = edge_begin_[s], e = edge_begin_[s + 1];
+        if (e - b <= 8) {
+            for (; b < e; b++) {
+                if (edge_label_[b] == c) return edge_target_[b];
+            }
+            return kNone;
+        }
+        auto it = std::lower_bound(edge_label_.begin() + b, edge_label_.begin() + e, c);
+        if (it != edge_label_.begin() + e && *it == c) {
+            return edge_target_[it - edge_label_.begin()];
+        }
+        return kNone;
+    }
+};
+
+#endif // UTILS_AHO_CORASICK_HPP_
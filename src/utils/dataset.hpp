@@ -0,0 +1,125 @@
+#ifndef UTILS_DATASET_HPP_
+#define UTILS_DATASET_HPP_
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+
+/**
+ * Read-mostly collection of records stored column-wise: all bytes back to
+ *   back in one buffer plus an offsets array, so a record costs 8 bytes of
+ *   bookkeeping instead of a std::string and its own heap block, and scans
+ *   over consecutive records walk memory in order.
+ * Records are handed out as std::string_view into the buffer; appending may
+ *   move the buffer, so views are only stable once loading is done.
+ */
+class Dataset {
+ public:
+    class const_iterator {
+     public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = std::string_view;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = std::string_view;
+
+        const_iterator() {}
+        const_iterator(const Dataset * dataset, size_t i) : dataset_(dataset), i_(i) {}
+
+        std::string_view operator*() const { return (*dataset_)[i_]; }
+        std::string_view operator[](difference_type n) const { return (*dataset_)[i_ + n]; }
+
+        const_iterator & operator++() { i_++; return *this; }
+        const_iterator operator++(int) { auto it = *this; i_++; return it; }
+        const_iterator & operator--() { i_--; return *this; }
+        const_iterator operator--(int) { auto it = *this; i_--; return it; }
+        const_iterator & operator+=(difference_type n) { i_ += n; return *this; }
+        const_iterator & operator-=(difference_type n) { i_ -= n; return *this; }
+        const_iterator operator+(difference_type n) const { return {dataset_, i_ + n}; }
+        const_iterator operator-(difference_type n) const { return {dataset_, i_ - n}; }
+        difference_type operator-(const const_iterator & o) const {
+            return difference_type(i_) - difference_type(o.i_);
+        }
+
+        bool operator==(const const_iterator & o) const { return i_ == o.i_; }
+        bool operator!=(const const_iterator & o) const { return i_ != o.i_; }
+        bool operator<(const const_iterator & o) const { return i_ < o.i_; }
+        bool operator>(const const_iterator & o) const { return i_ > o.i_; }
+        bool operator<=(const const_iterator & o) const { return i_ <= o.i_; }
+        bool operator>=(const const_iterator & o) const { return i_ >= o.i_; }
+
+     private:
+        const Dataset * dataset_ = nullptr;
+        size_t i_ = 0;
+    };
+
+    Dataset() : offsets_{0} {}
+
+    explicit Dataset(const std::vector<std::string> & lines) : Dataset() {
+        size_t num_bytes = 0;
+        for (const auto & line : lines) num_bytes += line.size();
+        reserve(lines.size(), num_bytes);
+        for (const auto & line : lines) push_back(line);
+    }
+
+    std::string_view operator[](size_t i) const {
+        return std::string_view(bytes_.data() + offsets_[i], offsets_[i+1] - offsets_[i]);
+    }
+
+    std::string_view at(size_t i) const {
+        if (i >= size()) throw std::out_of_range("Dataset::at");
+        return (*this)[i];
+    }
+
+    std::string_view back() const { return (*this)[size() - 1]; }
+
+    size_t size() const { return offsets_.size() - 1; }
+
+    bool empty() const { return size() == 0; }
+
+    // total length of all records
+    size_t num_bytes() const { return bytes_.size(); }
+
+    const_iterator begin() const { return {this, 0}; }
+    const_iterator end() const { return {this, size()}; }
+
+    void push_back(std::string_view line) {
+        bytes_.append(line);
+        offsets_.push_back(bytes_.size());
+    }
+
+    void reserve(size_t num_lines, size_t num_bytes) {
+        offsets_.reserve(num_lines + 1);
+        bytes_.reserve(num_bytes);
+    }
+
+    // drop all records after the first n
+    void truncate(size_t n) {
+        if (n >= size()) return;
+        offsets_.resize(n + 1);
+        bytes_.resize(offsets_.back());
+    }
+
+    void clear() {
+        bytes_.clear();
+        offsets_.assign(1, 0);
+    }
+
+    void shrink_to_fit() {
+        bytes_.shrink_to_fit();
+        offsets_.shrink_to_fit();
+    }
+
+    long long int get_bytes_used() const {
+        return sizeof(Dataset) + bytes_.capacity() + offsets_.capacity() * sizeof(size_t);
+    }
+
+ private:
+    std::string bytes_;
+    std::vector<size_t> offsets_;   // record i is bytes_[offsets_[i], offsets_[i+1])
+};
+
+#endif // UTILS_DATASET_HPP_
@@ -0,0 +1,171 @@
+#ifndef UTILS_GRAM_TABLE_HPP_
+#define UTILS_GRAM_TABLE_HPP_
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+/**
+ * Polynomial hashes of all substrings of a line: after set_line, the hash of
+ *   any window is O(1), so grams of several lengths are hashed in one pass
+ *   with no substr copies. The buffers are reused across lines.
+ */
+class RollingHash {
+ public:
+    static constexpr uint64_t kBase = 0x100000001b3ULL;
+
+    explicit RollingHash(size_t max_len = 0) { reserve_len(max_len); }
+
+    void set_line(std::string_view line) {
+        prefix_.resize(line.size() + 1);
+        prefix_[0] = 0;
+        for (size_t i = 0; i < line.size(); i++) {
+            prefix_[i+1] = prefix_[i] * kBase + static_cast<unsigned char>(line[i]) + 1;
+        }
+    }
+
+    // hash of line[pos, pos + len); len <= max_len
+    uint64_t window(size_t pos, size_t len) const {
+        return prefix_[pos + len] - prefix_[pos] * pow_[len];
+    }
+
+    static uint64_t hash(std::string_view gram) {
+        uint64_t h = 0;
+        for (unsigned char c : gram) h = h * kBase + c + 1;
+        return h;
+    }
+
+    void reserve_len(size_t max_len) {
+        if (pow_.empty()) pow_.push_back(1);
+        while (pow_.size() <= max_len) pow_.push_back(pow_.back() * kBase);
+    }
+
+ private:
+    std::vector<uint64_t> prefix_;
+    std::vector<uint64_t> pow_;
+};
+
+/**
+ * Open addressing table of grams of one fixed length, keyed by their
+ *   RollingHash and compared byte-wise on hash hits. A gram is stored as a
+ *   pointer to one of its occurrences, so the text it points into must outlive
+ *   the table. Each entry carries a count and the id of the last line (epoch)
+ *   that counted it, which dedups grams within a line without a per-line set.
+ */
+class GramTable {
+ public:
+    static constexpr uint64_t kNoLine = UINT64_MAX;
+
+    struct Entry {
+        uint64_t hash;
+        const char * gram;      // nullptr for an empty slot
+        uint64_t count;
+        uint64_t last_line;
+    };
+
+    explicit GramTable(size_t gram_len, size_t expected = 16) : gram_len_(gram_len) {
+        size_t cap = 16;
+        while (cap < 2 * expected) cap <<= 1;
+        slots_.assign(cap, Entry{0, nullptr, 0, kNoLine});
+    }
+
+    size_t gram_len() const { return gram_len_; }
+
+    // partition of a gram hash, for splitting grams among num_parts tables;
+    //   independent of the slot a table probes first
+    static size_t partition(uint64_t h, size_t num_parts) {
+        return (mix(h) >> 32) % num_parts;
+    }
+
+    static uint64_t mix(uint64_t h) {
+        // splitmix64 finalizer; the low bits of the polynomial hash are weak
+        h ^= h >> 30;
+        h *= 0xbf58476d1ce4e5b9ULL;
+        h ^= h >> 27;
+        h *= 0x94d049bb133111ebULL;
+        h ^= h >> 31;
+        return h;
+    }
+
+    size_t size() const { return size_; }
+
+    // entry of the gram at gram with hash h, inserted with count 0 if absent
+    Entry & find_or_insert(const char * gram, uint64_t h) {
+        if (2 * (size_ + 1) > slots_.size()) grow();
+        size_t i = probe(gram, h);
+        if (!slots_[i].gram) {
+            slots_[i] = Entry{h, gram, 0, kNoLine};
+            size_++;
+        }
+        return slots_[i];
+    }
+
+    const Entry * find(const char * gram, uint64_t h) const {
+        const Entry & e = slots_[probe(gram, h)];
+        return e.gram ? &e : nullptr;
+    }
+
+    bool contains(const char * gram, uint64_t h) const { return find(gram, h) != nullptr; }
+
+    // count the gram once per line; line ids must not decrease between calls
+    void count_once(const char * gram, uint64_t h, uint64_t line) {
+        Entry & e = find_or_insert(gram, h);
+        if (e.last_line != line) {
+            e.last_line = line;
+            e.count++;
+        }
+    }
+
+    // add count to the gram, e.g. when merging tables
+    void add(const char * gram, uint64_t h, uint64_t count) {
+        find_or_insert(gram, h).count += count;
+    }
+
+    // call f(const Entry &) for every gram in the table
+    template<class F>
+    void for_each_entry(F && f) const {
+        for (const auto & e : slots_) {
+            if (e.gram) f(e);
+        }
+    }
+
+    // call f(std::string_view gram, uint64_t count) for every gram in the table
+    template<class F>
+    void for_each(F && f) const {
+        for (const auto & e : slots_) {
+            if (e.gram) f(std::string_view(e.gram, gram_len_), e.count);
+        }
+    }
+
+ private:
+    const size_t gram_len_;
+    size_t size_ = 0;
+    std::vector<Entry> slots_;
+
+    size_t probe(const char * gram, uint64_t h) const {
+        size_t mask = slots_.size() - 1;
+        size_t i = mix(h) & mask;
+        while (slots_[i].gram &&
+               (slots_[i].hash != h || std::memcmp(slots_[i].gram, gram, gram_len_) != 0)) {
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+
+    void grow() {
+        std::vector<Entry> old(2 * slots_.size(), Entry{0, nullptr, 0, kNoLine});
+        old.swap(slots_);
+        size_t mask = slots_.size() - 1;
+        for (const auto & e : old) {
+            if (!e.gram) continue;
+            size_t i = mix(e.hash) & mask;
+            while (slots_[i].gram) i = (i + 1) & mask;
+            slots_[i] = e;
+        }
+    }
+};
+
+#endif // UTILS_GRAM_TABLE_HPP_
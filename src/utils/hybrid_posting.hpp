@@ -0,0 +1,453 @@
+#ifndef UTILS_HYBRID_POSTING_HPP_
+#define UTILS_HYBRID_POSTING_HPP_
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <bit>
+
+/**
+ * Roaring-style posting list: line ids are split into chunks of 2^16 by their
+ *   high bits, and the low 16 bits of the ids in each chunk are kept in the
+ *   smallest of three containers:
+ *   - array:  sorted uint16_t values (2 bytes per id, sparse chunks)
+ *   - bitmap: 2^16 bits (8 KB, chunks with more than 4096 ids)
+ *   - run:    number of runs - 1, then (start, length - 1) pairs of uint16_t
+ *             (consecutive line ids)
+ * Set operations work chunk by chunk with a kernel for each pair of
+ *   container types; a dense gram costs ~1 bit per line instead of 64.
+ */
+class HybridPostingList {
+ public:
+    static constexpr size_t kChunkBits = 16;
+    static constexpr size_t kChunkSize = size_t(1) << kChunkBits;
+    static constexpr size_t kBitmapWords = kChunkSize / 64;
+    // an array of more values is larger than a bitmap
+    static constexpr size_t kMaxArraySize = 4096;
+
+    enum ContainerType : uint8_t { kArray, kBitmap, kRun };
+
+    HybridPostingList() {}
+    explicit HybridPostingList(const std::vector<size_t> & ids) { encode(ids.data(), ids.size()); }
+    HybridPostingList(const size_t * ids, size_t n) { encode(ids, n); }
+    ~HybridPostingList() {}
+
+    size_t size() const { return size_; }
+
+    bool empty() const { return size_ == 0; }
+
+    size_t num_containers() const { return keys_.size(); }
+
+    size_t num_containers(ContainerType type) const {
+        return std::count(types_.begin(), types_.end(), type);
+    }
+
+    void decode(std::vector<size_t> & out) const {
+        out.clear();
+        out.reserve(size_);
+        for (size_t c = 0; c < keys_.size(); c++) {
+            size_t high = size_t(keys_[c]) << kChunkBits;
+            for_each_low(c, [&](uint16_t low) { out.push_back(high | low); });
+        }
+    }
+
+    // keep in container (sorted) only the ids that are also in this list;
+    //   O(1) per id against a bitmap chunk
+    void intersect(std::vector<size_t> & container) const {
+        size_t out = 0;
+        size_t c = 0;       // current chunk
+        size_t pos = 0;     // position in the current array / run container
+        for (size_t i = 0; i < container.size(); i++) {
+            size_t v = container[i];
+            uint32_t key = v >> kChunkBits;
+            if (c < keys_.size() && keys_[c] < key) {
+                c = std::lower_bound(keys_.begin() + c, keys_.end(), key) - keys_.begin();
+                pos = 0;
+            }
+            if (c == keys_.size()) break;
+            if (keys_[c] != key) continue;
+            uint16_t low = v & (kChunkSize - 1);
+            bool found = false;
+            switch (types_[c]) {
+                case kBitmap: {
+                    const uint64_t * words = bitmaps_.data() + offsets_[c];
+                    found = (words[low / 64] >> (low % 64)) & 1;
+                    break;
+                }
+                case kArray: {
+                    const uint16_t * vals = values_.data() + offsets_[c];
+                    size_t n = cardinality(c);
+                    pos = std::lower_bound(vals + pos, vals + n, low) - vals;
+                    found = pos < n && vals[pos] == low;
+                    break;
+                }
+                case kRun: {
+                    const uint16_t * runs = run_pairs(c);
+                    size_t num_runs = run_count(c);
+                    while (pos < num_runs && runs[2*pos] + runs[2*pos+1] < low) pos++;
+                    found = pos < num_runs && runs[2*pos] <= low;
+                    break;
+                }
+            }
+            if (found) container[out++] = v;
+        }
+        container.resize(out);
+    }
+
+    // ids in both this and other
+    HybridPostingList intersect(const HybridPostingList & other) const {
+        HybridPostingList result;
+        std::vector<uint16_t> lows;
+        std::vector<uint64_t> words_a(kBitmapWords), words_b(kBitmapWords);
+        size_t a = 0, b = 0;
+        while (a < keys_.size() && b < other.keys_.size()) {
+            if (keys_[a] < other.keys_[b]) { a++; continue; }
+            if (other.keys_[b] < keys_[a]) { b++; continue; }
+            uint32_t key = keys_[a];
+            if (types_[a] == kArray && other.types_[b] == kArray) {
+                // merge of two sorted arrays
+                const uint16_t * x = values_.data() + offsets_[a];
+                const uint16_t * y = other.values_.data() + other.offsets_[b];
+                lows.clear();
+                std::set_intersection(x, x + cardinality(a), y, y + other.cardinality(b),
+                                      std::back_inserter(lows));
+                result.append_lows(key, lows.data(), lows.size());
+            } else if (types_[a] == kArray || other.types_[b] == kArray) {
+                // probe the array against the other container as a bitmap
+                const auto & arr = types_[a] == kArray ? *this : other;
+                const auto & rest = types_[a] == kArray ? other : *this;
+                size_t ca = types_[a] == kArray ? a : b;
+                size_t cb = types_[a] == kArray ? b : a;
+                const uint64_t * bits = rest.bitmap_of(cb, words_b.data());
+                lows.clear();
+                arr.for_each_low(ca, [&](uint16_t low) {
+                    if ((bits[low / 64] >> (low % 64)) & 1) lows.push_back(low);
+                });
+                result.append_lows(key, lows.data(), lows.size());
+            } else {
+                const uint64_t * bits = other.bitmap_of(b, words_b.data());
+                to_bitmap(a, words_a.data());
+                for (size_t w = 0; w < kBitmapWords; w++) words_a[w] &= bits[w];
+                result.append_bitmap(key, words_a.data());
+            }
+            a++;
+            b++;
+        }
+        result.shrink_to_fit();
+        return result;
+    }
+
+    // ids in this or other
+    HybridPostingList unite(const HybridPostingList & other) const {
+        HybridPostingList result;
+        std::vector<uint16_t> lows;
+        std::vector<uint64_t> words_a(kBitmapWords), words_b(kBitmapWords);
+        size_t a = 0, b = 0;
+        while (a < keys_.size() || b < other.keys_.size()) {
+            if (b == other.keys_.size() || (a < keys_.size() && keys_[a] < other.keys_[b])) {
+                result.append_copy(*this, a++);
+                continue;
+            }
+            if (a == keys_.size() || other.keys_[b] < keys_[a]) {
+                result.append_copy(other, b++);
+                continue;
+            }
+            uint32_t key = keys_[a];
+            if (types_[a] == kArray && other.types_[b] == kArray &&
+                cardinality(a) + other.cardinality(b) <= kMaxArraySize) {
+                const uint16_t * x = values_.data() + offsets_[a];
+                const uint16_t * y = other.values_.data() + other.offsets_[b];
+                lows.clear();
+                std::set_union(x, x + cardinality(a), y, y + other.cardinality(b),
+                               std::back_inserter(lows));
+                result.append_lows(key, lows.data(), lows.size());
+            } else {
+                const uint64_t * bits = other.bitmap_of(b, words_b.data());
+                to_bitmap(a, words_a.data());
+                for (size_t w = 0; w < kBitmapWords; w++) words_a[w] |= bits[w];
+                result.append_bitmap(key, words_a.data());
+            }
+            a++;
+            b++;
+        }
+        result.shrink_to_fit();
+        return result;
+    }
+
+    // set the bits of the ids in bits[0, num_words), a flat bitset over ids;
+    //   ids past the end are ignored
+    void set_bits(uint64_t * bits, size_t num_words) const {
+        for (size_t c = 0; c < keys_.size(); c++) {
+            size_t first = (size_t(keys_[c]) << kChunkBits) / 64;
+            if (first >= num_words) break;
+            size_t n = std::min(kBitmapWords, num_words - first);
+            if (types_[c] == kBitmap) {
+                const uint64_t * words = bitmaps_.data() + offsets_[c];
+                for (size_t w = 0; w < n; w++) bits[first + w] |= words[w];
+                continue;
+            }
+            for_each_low(c, [&](uint16_t low) {
+                if (low / 64 < n) bits[first + low / 64] |= uint64_t(1) << (low % 64);
+            });
+        }
+    }
+
+    // number of ids of this list set in bits[0, num_words), without
+    //   materializing the intersection; word-wise AND + popcount against a
+    //   bitmap chunk
+    size_t count_in(const uint64_t * bits, size_t num_words) const {
+        size_t count = 0;
+        for (size_t c = 0; c < keys_.size(); c++) {
+            size_t first = (size_t(keys_[c]) << kChunkBits) / 64;
+            if (first >= num_words) break;
+            size_t n = std::min(kBitmapWords, num_words - first);
+            const uint64_t * chunk_bits = bits + first;
+            switch (types_[c]) {
+                case kBitmap: {
+                    const uint64_t * words = bitmaps_.data() + offsets_[c];
+                    for (size_t w = 0; w < n; w++) count += std::popcount(words[w] & chunk_bits[w]);
+                    break;
+                }
+                case kArray: {
+                    const uint16_t * vals = values_.data() + offsets_[c];
+                    for (size_t i = 0, m = cardinality(c); i < m; i++) {
+                        if (vals[i] / 64 >= n) break;
+                        count += (chunk_bits[vals[i] / 64] >> (vals[i] % 64)) & 1;
+                    }
+                    break;
+                }
+                case kRun: {
+                    const uint16_t * runs = run_pairs(c);
+                    for (size_t r = 0, m = run_count(c); r < m; r++) {
+                        size_t start = runs[2*r], end = size_t(runs[2*r]) + runs[2*r+1];
+                        for (size_t w = start / 64; w <= end / 64 && w < n; w++) {
+                            count += std::popcount(chunk_bits[w] & word_mask(start, end, w));
+                        }
+                    }
+                    break;
+                }
+            }
+        }
+        return count;
+    }
+
+    long long int get_bytes_used() const {
+        return sizeof(HybridPostingList) +
+               keys_.capacity() * sizeof(uint32_t) +
+               card_minus_one_.capacity() * sizeof(uint16_t) +
+               types_.capacity() * sizeof(uint8_t) +
+               offsets_.capacity() * sizeof(size_t) +
+               values_.capacity() * sizeof(uint16_t) +
+               bitmaps_.capacity() * sizeof(uint64_t);
+    }
+
+ private:
+    size_t size_ = 0;
+    std::vector<uint32_t> keys_;            // high bits of the ids of each chunk, ascending
+    std::vector<uint16_t> card_minus_one_;  // number of ids in each chunk - 1
+    std::vector<uint8_t> types_;
+    std::vector<size_t> offsets_;           // into values_ (array, run) or bitmaps_ (bitmap)
+    std::vector<uint16_t> values_;
+    std::vector<uint64_t> bitmaps_;
+
+    size_t cardinality(size_t c) const { return size_t(card_minus_one_[c]) + 1; }
+
+    // number of (start, length - 1) pairs of run container c
+    size_t run_count(size_t c) const { return size_t(values_[offsets_[c]]) + 1; }
+
+    const uint16_t * run_pairs(size_t c) const { return values_.data() + offsets_[c] + 1; }
+
+    void encode(const size_t * ids, size_t n) {
+        std::vector<uint16_t> lows;
+        for (size_t s = 0; s < n; ) {
+            uint32_t key = ids[s] >> kChunkBits;
+            lows.clear();
+            for (; s < n && (ids[s] >> kChunkBits) == key; s++) {
+                lows.push_back(ids[s] & (kChunkSize - 1));
+            }
+            append_lows(key, lows.data(), lows.size());
+        }
+        shrink_to_fit();
+    }
+
+    void shrink_to_fit() {
+        keys_.shrink_to_fit();
+        card_minus_one_.shrink_to_fit();
+        types_.shrink_to_fit();
+        offsets_.shrink_to_fit();
+        values_.shrink_to_fit();
+        bitmaps_.shrink_to_fit();
+    }
+
+    void push_chunk(uint32_t key, size_t card, ContainerType type, size_t offset) {
+        keys_.push_back(key);
+        card_minus_one_.push_back(card - 1);
+        types_.push_back(type);
+        offsets_.push_back(offset);
+        size_ += card;
+    }
+
+    // the cheapest container: runs if they take less space than both
+    //   alternatives, else an array up to kMaxArraySize values, else a bitmap
+    static ContainerType best_type(size_t card, size_t num_runs) {
+        size_t array_bytes = card <= kMaxArraySize ? 2 * card : SIZE_MAX;
+        size_t bitmap_bytes = kBitmapWords * sizeof(uint64_t);
+        if (4 * num_runs < std::min(array_bytes, bitmap_bytes)) return kRun;
+        return card <= kMaxArraySize ? kArray : kBitmap;
+    }
+
+    // add a chunk holding the sorted low bits lows[0, n)
+    void append_lows(uint32_t key, const uint16_t * lows, size_t n) {
+        if (n == 0) return;
+        size_t num_runs = 1;
+        for (size_t i = 1; i < n; i++) {
+            num_runs += lows[i] != lows[i-1] + 1;
+        }
+        switch (best_type(n, num_runs)) {
+            case kArray:
+                push_chunk(key, n, kArray, values_.size());
+                values_.insert(values_.end(), lows, lows + n);
+                break;
+            case kRun:
+                push_chunk(key, n, kRun, values_.size());
+                values_.push_back(num_runs - 1);
+                for (size_t i = 0; i < n; ) {
+                    size_t j = i + 1;
+                    while (j < n && lows[j] == lows[j-1] + 1) j++;
+                    values_.push_back(lows[i]);
+                    values_.push_back(j - i - 1);
+                    i = j;
+                }
+                break;
+            case kBitmap: {
+                push_chunk(key, n, kBitmap, bitmaps_.size());
+                bitmaps_.resize(bitmaps_.size() + kBitmapWords, 0);
+                uint64_t * words = bitmaps_.data() + offsets_.back();
+                for (size_t i = 0; i < n; i++) {
+                    words[lows[i] / 64] |= uint64_t(1) << (lows[i] % 64);
+                }
+                break;
+            }
+        }
+    }
+
+    // add a chunk holding the ids set in words[0, kBitmapWords)
+    void append_bitmap(uint32_t key, const uint64_t * words) {
+        size_t card = 0;
+        size_t num_runs = 0;
+        uint64_t carry = 0;     // top bit of the previous word
+        for (size_t w = 0; w < kBitmapWords; w++) {
+            card += std::popcount(words[w]);
+            // bits that start a run: set, with the bit below them clear
+            num_runs += std::popcount(words[w] & ~((words[w] << 1) | carry));
+            carry = words[w] >> 63;
+        }
+        if (card == 0) return;
+        ContainerType type = best_type(card, num_runs);
+        if (type == kBitmap) {
+            push_chunk(key, card, kBitmap, bitmaps_.size());
+            bitmaps_.insert(bitmaps_.end(), words, words + kBitmapWords);
+            return;
+        }
+        std::vector<uint16_t> lows;
+        lows.reserve(card);
+        for (size_t w = 0; w < kBitmapWords; w++) {
+            for (uint64_t bits = words[w]; bits; bits &= bits - 1) {
+                lows.push_back(w * 64 + std::countr_zero(bits));
+            }
+        }
+        append_lows(key, lows.data(), lows.size());
+    }
+
+    // add chunk c of other as it is
+    void append_copy(const HybridPostingList & other, size_t c) {
+        switch (other.types_[c]) {
+            case kBitmap: {
+                const uint64_t * words = other.bitmaps_.data() + other.offsets_[c];
+                push_chunk(other.keys_[c], other.cardinality(c), kBitmap, bitmaps_.size());
+                bitmaps_.insert(bitmaps_.end(), words, words + kBitmapWords);
+                break;
+            }
+            case kArray:
+            case kRun: {
+                const uint16_t * vals = other.values_.data() + other.offsets_[c];
+                size_t n = other.types_[c] == kArray ? other.cardinality(c) 
+                                                     : 1 + 2 * other.run_count(c);
+                push_chunk(other.keys_[c], other.cardinality(c), ContainerType(other.types_[c]),
+                           values_.size());
+                values_.insert(values_.end(), vals, vals + n);
+                break;
+            }
+        }
+    }
+
+    // call f(uint16_t low) for the ids of chunk c, in ascending order
+    template<class F>
+    void for_each_low(size_t c, F && f) const {
+        switch (types_[c]) {
+            case kArray: {
+                const uint16_t * vals = values_.data() + offsets_[c];
+                for (size_t i = 0, n = cardinality(c); i < n; i++) f(vals[i]);
+                break;
+            }
+            case kRun: {
+                const uint16_t * runs = run_pairs(c);
+                for (size_t r = 0, n = run_count(c); r < n; r++) {
+                    for (uint32_t low = runs[2*r]; low <= uint32_t(runs[2*r]) + runs[2*r+1]; low++) {
+                        f(uint16_t(low));
+                    }
+                }
+                break;
+            }
+            case kBitmap: {
+                const uint64_t * words = bitmaps_.data() + offsets_[c];
+                for (size_t w = 0; w < kBitmapWords; w++) {
+                    for (uint64_t bits = words[w]; bits; bits &= bits - 1) {
+                        f(uint16_t(w * 64 + std::countr_zero(bits)));
+                    }
+                }
+                break;
+            }
+        }
+    }
+
+    // the bitmap of chunk c: in place for a bitmap container, else written to buf
+    const uint64_t * bitmap_of(size_t c, uint64_t * buf) const {
+        if (types_[c] == kBitmap) return bitmaps_.data() + offsets_[c];
+        to_bitmap(c, buf);
+        return buf;
+    }
+
+    // write chunk c as a bitmap into words[0, kBitmapWords)
+    void to_bitmap(size_t c, uint64_t * words) const {
+        if (types_[c] == kBitmap) {
+            const uint64_t * src = bitmaps_.data() + offsets_[c];
+            std::copy(src, src + kBitmapWords, words);
+            return;
+        }
+        std::fill(words, words + kBitmapWords, 0);
+        if (types_[c] == kArray) {
+            for_each_low(c, [&](uint16_t low) { words[low / 64] |= uint64_t(1) << (low % 64); });
+            return;
+        }
+        // fill each run [start, end] word by word
+        const uint16_t * runs = run_pairs(c);
+        for (size_t r = 0, n = run_count(c); r < n; r++) {
+            size_t start = runs[2*r], end = size_t(runs[2*r]) + runs[2*r+1];
+            for (size_t w = start / 64; w <= end / 64; w++) {
+                words[w] |= word_mask(start, end, w);
+            }
+        }
+    }
+
+    // bits of word w that fall in the low bits range [start, end]
+    static uint64_t word_mask(size_t start, size_t end, size_t w) {
+        size_t lo = std::max(start, w * 64) - w * 64;
+        size_t hi = std::min(end, w * 64 + 63) - w * 64;
+        return (hi == 63 ? ~uint64_t(0) : (uint64_t(1) << (hi + 1)) - 1) &
+               ~((uint64_t(1) << lo) - 1);
+    }
+};
+
+#endif // UTILS_HYBRID_POSTING_HPP_
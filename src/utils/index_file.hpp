@@ -0,0 +1,49 @@
+#ifndef UTILS_INDEX_FILE_HPP_
+#define UTILS_INDEX_FILE_HPP_
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+#include "dataset.hpp"
+
+/**
+ * On-disk layout of a saved inverted index (all integers native endian):
+ *   IndexFileHeader
+ *   uint64_t key_offsets[num_keys + 1]      offsets into the key blob
+ *   uint64_t posting_offsets[num_keys + 1]  offsets (in ids) into the posting blob
+ *   char     keys[key_bytes]                keys in ascending order, padded to 8 bytes
+ *   size_t   ids[num_ids]                   posting lists, back to back
+ * Everything is 8-byte aligned, so a mapped file is used in place.
+ */
+inline constexpr char kIndexFileMagic[8] = {'N', 'G', 'R', 'A', 'M', 'I', 'D', 'X'};
+inline constexpr uint32_t kIndexFileVersion = 1;
+
+struct IndexFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t id_bytes;          // sizeof(size_t) of the writer
+    uint64_t dataset_size;
+    uint64_t dataset_checksum;
+    uint64_t num_keys;
+    uint64_t key_bytes;         // unpadded size of the key blob
+    uint64_t num_ids;
+};
+
+inline size_t pad_to_8(size_t n) { return (n + 7) & ~size_t(7); }
+
+// FNV-1a over all lines (with their boundaries), to tell if a saved
+//   index was built over the dataset at hand
+inline uint64_t dataset_checksum(const Dataset & dataset) {
+    uint64_t h = 14695981039346656037ULL;
+    for (const auto & line : dataset) {
+        for (unsigned char c : line) {
+            h = (h ^ c) * 1099511628211ULL;
+        }
+        h = (h ^ '\n') * 1099511628211ULL;
+    }
+    return h;
+}
+
+#endif // UTILS_INDEX_FILE_HPP_
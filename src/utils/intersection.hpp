@@ -0,0 +1,121 @@
+#ifndef UTILS_INTERSECTION_HPP_
+#define UTILS_INTERSECTION_HPP_
+
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+/**
+ * Kernels for intersecting sorted lists of unique ids.
+ *   All of them write the result to out, which may alias the first list
+ *   (and, for galloping, also the second list): each output slot is written
+ *   only after every input slot at or before it has been read.
+ */
+
+// galloping is used once one list is this many times longer than the other
+inline constexpr size_t kGallopRatio = 32;
+
+// For every id of the short list a, exponential search for it in the long list b
+template<class T>
+static size_t galloping_intersection(const T * a, size_t na,
+        const T * b, size_t nb, T * out) {
+    size_t k = 0;
+    size_t lo = 0;
+    for (size_t i = 0; i < na && lo < nb; i++) {
+        const T v = a[i];
+        size_t step = 1;
+        while (lo + step < nb && b[lo + step] < v) {
+            step <<= 1;
+        }
+        size_t hi = std::min(lo + step + 1, nb);
+        lo = std::lower_bound(b + lo + (step >> 1), b + hi, v) - b;
+        if (lo < nb && b[lo] == v) {
+            out[k++] = v;
+            lo++;
+        }
+    }
+    return k;
+}
+
+// Merge based intersection for lists of similar lengths; compare each id of a
+//   against a whole block of b at once when the target supports it
+template<class T>
+static size_t block_intersection(const T * a, size_t na,
+        const T * b, size_t nb, T * out) {
+    size_t i = 0, j = 0, k = 0;
+#if defined(__AVX512F__)
+    if constexpr (sizeof(T) == 8) {
+        while (i < na && j + 8 <= nb) {
+            if (b[j + 7] < a[i]) {
+                j += 8;
+                continue;
+            }
+            __m512i vb = _mm512_loadu_si512(reinterpret_cast<const void *>(b + j));
+            __m512i va = _mm512_set1_epi64(static_cast<long long>(a[i]));
+            if (_mm512_cmpeq_epi64_mask(va, vb)) {
+                out[k++] = a[i];
+            }
+            i++;
+        }
+    }
+#elif defined(__AVX2__)
+    if constexpr (sizeof(T) == 8) {
+        while (i < na && j + 4 <= nb) {
+            if (b[j + 3] < a[i]) {
+                j += 4;
+                continue;
+            }
+            __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + j));
+            __m256i va = _mm256_set1_epi64x(static_cast<long long>(a[i]));
+            if (_mm256_movemask_epi8(_mm256_cmpeq_epi64(va, vb))) {
+                out[k++] = a[i];
+            }
+            i++;
+        }
+    }
+#endif
+    while (i < na && j < nb) {
+        if (a[i] < b[j]) {
+            i++;
+        } else if (a[i] > b[j]) {
+            j++;
+        } else {
+            out[k++] = a[i];
+            i++;
+            j++;
+        }
+    }
+    return k;
+}
+
+// Keep in container only the ids that are also in list[0, list_size); no allocation
+template<class T>
+static void sorted_lists_intersection_in_place(std::vector<T> & container,
+        const T * list, size_t list_size) {
+    size_t n = 0;
+    if (!container.empty() && list_size > 0) {
+        if (list_size >= kGallopRatio * container.size()) {
+            n = galloping_intersection(container.data(), container.size(),
+                                       list, list_size, container.data());
+        } else if (container.size() >= kGallopRatio * list_size) {
+            n = galloping_intersection(list, list_size,
+                                       container.data(), container.size(), container.data());
+        } else {
+            n = block_intersection(container.data(), container.size(),
+                                   list, list_size, container.data());
+        }
+    }
+    container.resize(n);
+}
+
+template<class T>
+static void sorted_lists_intersection_in_place(std::vector<T> & container,
+        const std::vector<T> & list) {
+    sorted_lists_intersection_in_place(container, list.data(), list.size());
+}
+
+#endif // UTILS_INTERSECTION_HPP_
@@ -0,0 +1,63 @@
+#ifndef UTILS_LINE_READER_HPP_
+#define UTILS_LINE_READER_HPP_
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <cstring>
+
+/**
+ * Helpers to cut a file mapped in memory into records without copying it:
+ *   boundaries are found with memchr, which glibc vectorizes, and records are
+ *   handed out as views into the text.
+ */
+
+// call f(std::string_view line) for every line of text, without its '\n',
+//   until f returns false; like getline, a last line with no '\n' is
+//   reported, and a final '\n' does not start an empty line
+template<class F>
+void for_each_line(std::string_view text, F && f) {
+    const char * p = text.data();
+    const char * end = p + text.size();
+    while (p < end) {
+        auto nl = static_cast<const char *>(std::memchr(p, '\n', end - p));
+        const char * line_end = nl ? nl : end;
+        if (!f(std::string_view(p, line_end - p))) return;
+        p = line_end + 1;
+    }
+}
+
+// text with every '\r' removed; text itself if it has none, else a view of scratch
+inline std::string_view strip_cr(std::string_view text, std::string & scratch) {
+    if (text.empty()) return text;
+    auto cr = static_cast<const char *>(std::memchr(text.data(), '\r', text.size()));
+    if (!cr) return text;
+    scratch.assign(text.data(), cr);
+    for (const char * p = cr + 1; p < text.data() + text.size(); p++) {
+        if (*p != '\r') scratch.push_back(*p);
+    }
+    return scratch;
+}
+
+// field n (from 0) of a delim-separated line, as the (n+1)-th
+//   getline(stream, field, delim) over the line would return it;
+//   false if that getline would fail
+inline bool nth_field(std::string_view line, size_t n, char delim, std::string_view & field) {
+    const char * p = line.data();
+    const char * end = p + line.size();
+    auto next_delim = [&]() {
+        return p < end ? static_cast<const char *>(std::memchr(p, delim, end - p)) : nullptr;
+    };
+    for (size_t i = 0; i < n; i++) {
+        auto d = next_delim();
+        if (!d) return false;
+        p = d + 1;
+    }
+    auto d = next_delim();
+    // getline fails at the end of the stream only if it extracted nothing
+    if (!d && p == end) return false;
+    field = std::string_view(p, (d ? d : end) - p);
+    return true;
+}
+
+#endif // UTILS_LINE_READER_HPP_
@@ -0,0 +1,59 @@
+#ifndef UTILS_MAPPED_FILE_HPP_
+#define UTILS_MAPPED_FILE_HPP_
+
+#include <cstddef>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * Read-only memory mapping of a whole file; unmapped on close / destruction.
+ */
+class MappedFile {
+ public:
+    MappedFile() {}
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+    ~MappedFile() { close(); }
+
+    // map the file at path; false if it cannot be opened or mapped
+    bool open(const std::filesystem::path & path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void * addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        // the mapping stays valid after the descriptor is closed
+        ::close(fd);
+        if (addr == MAP_FAILED) return false;
+        addr_ = addr;
+        size_ = st.st_size;
+        return true;
+    }
+
+    void close() {
+        if (addr_) {
+            munmap(addr_, size_);
+            addr_ = nullptr;
+            size_ = 0;
+        }
+    }
+
+    const char * data() const { return static_cast<const char *>(addr_); }
+
+    size_t size() const { return size_; }
+
+    bool is_open() const { return addr_ != nullptr; }
+
+ private:
+    void * addr_ = nullptr;
+    size_t size_ = 0;
+};
+
+#endif // UTILS_MAPPED_FILE_HPP_
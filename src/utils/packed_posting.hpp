@@ -0,0 +1,146 @@
+#ifndef UTILS_PACKED_POSTING_HPP_
+#define UTILS_PACKED_POSTING_HPP_
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <bit>
+
+/**
+ * Compressed posting list: sorted line ids are cut into blocks of kBlockSize;
+ *   each block keeps its first id uncompressed (used as a skip entry), and the
+ *   gaps between consecutive ids are bit-packed with the smallest width that
+ *   fits the largest gap of the block (binary packing / BP128 layout).
+ * Intersection only decodes the blocks that may hold a probed id.
+ */
+class PackedPostingList {
+ public:
+    static constexpr size_t kBlockSize = 128;
+
+    PackedPostingList() {}
+    explicit PackedPostingList(const std::vector<size_t> & ids) { encode(ids); }
+    ~PackedPostingList() {}
+
+    size_t size() const { return size_; }
+
+    bool empty() const { return size_ == 0; }
+
+    void decode(std::vector<size_t> & out) const {
+        out.resize(size_);
+        for (size_t b = 0; b < block_first_.size(); b++) {
+            decode_block(b, out.data() + b * kBlockSize);
+        }
+    }
+
+    // keep in container (sorted) only the ids that are also in this list
+    void intersect(std::vector<size_t> & container) const {
+        size_t block_buf[kBlockSize];
+        size_t num_blocks = block_first_.size();
+        size_t curr_block = num_blocks;
+        size_t curr_block_size = 0;
+        size_t pos = 0;
+        size_t out = 0;
+        for (size_t i = 0; i < container.size(); i++) {
+            size_t v = container[i];
+            // last block whose first id <= v; container is sorted, so
+            //   never look behind the block decoded last
+            auto search_begin = block_first_.cbegin() + (curr_block == num_blocks ? 0 : curr_block);
+            auto it = std::upper_bound(search_begin, block_first_.cend(), v);
+            if (it == block_first_.cbegin()) continue;
+            size_t b = (it - block_first_.cbegin()) - 1;
+            if (b != curr_block) {
+                curr_block = b;
+                curr_block_size = decode_block(b, block_buf);
+                pos = 0;
+            }
+            while (pos < curr_block_size && block_buf[pos] < v) pos++;
+            if (pos < curr_block_size && block_buf[pos] == v) {
+                container[out++] = v;
+            }
+        }
+        container.resize(out);
+    }
+
+    long long int get_bytes_used() const {
+        return sizeof(PackedPostingList) +
+               block_first_.capacity() * sizeof(size_t) +
+               block_offset_.capacity() * sizeof(size_t) +
+               block_width_.capacity() * sizeof(uint8_t) +
+               words_.capacity() * sizeof(uint64_t);
+    }
+
+ private:
+    size_t size_ = 0;
+    std::vector<size_t> block_first_;   // first id of each block
+    std::vector<size_t> block_offset_;  // bit offset of the packed gaps of each block
+    std::vector<uint8_t> block_width_;  // bits per gap in each block
+    std::vector<uint64_t> words_;
+
+    void encode(const std::vector<size_t> & ids) {
+        size_ = ids.size();
+        size_t num_blocks = (size_ + kBlockSize - 1) / kBlockSize;
+        block_first_.reserve(num_blocks);
+        block_offset_.reserve(num_blocks);
+        block_width_.reserve(num_blocks);
+
+        size_t bit_pos = 0;
+        for (size_t s = 0; s < size_; s += kBlockSize) {
+            size_t d = std::min(s + kBlockSize, size_);
+            uint64_t max_gap = 0;
+            for (size_t i = s + 1; i < d; i++) {
+                max_gap = std::max(max_gap, uint64_t(ids[i] - ids[i-1]));
+            }
+            uint8_t width = std::bit_width(max_gap);
+            block_first_.push_back(ids[s]);
+            block_offset_.push_back(bit_pos);
+            block_width_.push_back(width);
+            for (size_t i = s + 1; i < d; i++) {
+                write_bits(bit_pos, width, ids[i] - ids[i-1]);
+                bit_pos += width;
+            }
+        }
+        words_.shrink_to_fit();
+    }
+
+    void write_bits(size_t bit_pos, uint8_t width, uint64_t val) {
+        if (width == 0) return;
+        size_t w = bit_pos / 64;
+        size_t shift = bit_pos % 64;
+        if (words_.size() < w + 2) words_.resize(w + 2, 0);
+        words_[w] |= val << shift;
+        if (shift + width > 64) {
+            words_[w+1] |= val >> (64 - shift);
+        }
+    }
+
+    uint64_t read_bits(size_t bit_pos, uint8_t width) const {
+        size_t w = bit_pos / 64;
+        size_t shift = bit_pos % 64;
+        uint64_t val = words_[w] >> shift;
+        if (shift + width > 64) {
+            val |= words_[w+1] << (64 - shift);
+        }
+        return width == 64 ? val : val & ((uint64_t(1) << width) - 1);
+    }
+
+    // decode block b into out; return number of ids in the block
+    size_t decode_block(size_t b, size_t * out) const {
+        size_t n = std::min(kBlockSize, size_ - b * kBlockSize);
+        uint8_t width = block_width_[b];
+        size_t bit_pos = block_offset_[b];
+        size_t curr = block_first_[b];
+        out[0] = curr;
+        if (width == 0) {
+            std::fill(out + 1, out + n, curr);
+            return n;
+        }
+        for (size_t i = 1; i < n; i++, bit_pos += width) {
+            curr += read_bits(bit_pos, width);
+            out[i] = curr;
+        }
+        return n;
+    }
+};
+
+#endif // UTILS_PACKED_POSTING_HPP_
@@ -0,0 +1,815 @@
+#ifndef UTILS_QUERY_PLAN_HPP_
+#define UTILS_QUERY_PLAN_HPP_
+
+#include <vector>
+#include <set>
+#include <string>
+#include <iostream>
+#include <utility>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cctype>
+
+/**
+ * Boolean plan of the literals a line has to contain to match a regex: a
+ *   line satisfying the regex satisfies its plan, so the plan answered with
+ *   posting lists (AND as intersection, OR as union) gives candidate lines.
+ *   kAll is satisfied by every line, i.e. that part of the regex gives no
+ *   filter (an optional group, a character class, ...).
+ * Plans are built through make(), which keeps them simplified: an AND has no
+ *   kAll child, an OR has none either (it would be kAll itself), children
+ *   of the same type are flattened, children implied by another one are
+ *   dropped and a node with a single child is replaced by that child.
+ */
+struct QueryPlan {
+    enum class Type { kAll, kLiteral, kAnd, kOr };
+
+    Type type = Type::kAll;
+    std::string literal;                // kLiteral only
+    std::vector<QueryPlan> children;    // kAnd and kOr only
+
+    static QueryPlan all() { return QueryPlan(); }
+
+    static QueryPlan of_literal(std::string literal) {
+        QueryPlan plan;
+        plan.type = Type::kLiteral;
+        plan.literal = std::move(literal);
+        return plan;
+    }
+
+    static QueryPlan make(Type type, std::vector<QueryPlan> children) {
+        QueryPlan plan;
+        plan.type = type;
+        for (auto & child : children) {
+            if (child.is_all()) {
+                if (type == Type::kOr) return all();
+                continue;
+            }
+            if (child.type == type) {
+                for (auto & grandchild : child.children) {
+                    plan.add_child(std::move(grandchild));
+                }
+            } else {
+                plan.add_child(std::move(child));
+            }
+        }
+        if (plan.children.empty()) return all();
+        if (plan.children.size() == 1) {
+            QueryPlan only = std::move(plan.children[0]);
+            return only;
+        }
+        return plan;
+    }
+
+    bool is_all() const { return type == Type::kAll; }
+
+    bool operator==(const QueryPlan & other) const = default;
+
+    // every line satisfying a satisfies b; false when it cannot tell
+    static bool implies(const QueryPlan & a, const QueryPlan & b) {
+        auto implied_by_a = [&](const QueryPlan & c) { return implies(a, c); };
+        auto implies_b = [&](const QueryPlan & c) { return implies(c, b); };
+        if (b.is_all()) return true;
+        if (a.type == Type::kOr) return std::all_of(a.children.begin(), a.children.end(), implies_b);
+        if (b.type == Type::kAnd) return std::all_of(b.children.begin(), b.children.end(), implied_by_a);
+        if (a.type == Type::kAnd) return std::any_of(a.children.begin(), a.children.end(), implies_b);
+        if (b.type == Type::kOr) return std::any_of(b.children.begin(), b.children.end(), implied_by_a);
+        return a.type == Type::kLiteral && b.type == Type::kLiteral &&
+               a.literal.find(b.literal) != std::string::npos;
+    }
+
+    // add child to an AND or OR unless another child makes it redundant,
+    //   dropping the children it makes redundant
+    void add_child(QueryPlan child) {
+        auto redundant = [this](const QueryPlan & c, const QueryPlan & other) {
+            return type == Type::kAnd ? implies(other, c) : implies(c, other);
+        };
+        for (const auto & other : children) {
+            if (redundant(child, other)) return;
+        }
+        std::erase_if(children, [&](const QueryPlan & other) { return redundant(other, child); });
+        children.push_back(std::move(child));
+    }
+
+    // the literals of the plan, left to right
+    std::vector<std::string> literals() const {
+        std::vector<std::string> result;
+        add_literals(result);
+        return result;
+    }
+
+    void add_literals(std::vector<std::string> & result) const {
+        if (type == Type::kLiteral) {
+            result.push_back(literal);
+        }
+        for (const auto & child : children) {
+            child.add_literals(result);
+        }
+    }
+
+    // the literals every line satisfying the plan contains, left to right:
+    //   those of an AND, and for an OR the longest common prefix of the
+    //   first required literals of its branches and the longest common
+    //   suffix of their last ones, e.g. "baz" for OR("foobaz", "barbaz")
+    std::vector<std::string> required_literals() const {
+        std::vector<std::string> result;
+        add_required_literals(result);
+        return result;
+    }
+
+    void add_required_literals(std::vector<std::string> & result) const {
+        switch (type) {
+            case Type::kAll:
+                return;
+            case Type::kLiteral:
+                result.push_back(literal);
+                return;
+            case Type::kAnd:
+                for (const auto & child : children) {
+                    child.add_required_literals(result);
+                }
+                return;
+            case Type::kOr:
+                break;
+        }
+        std::string prefix, suffix;
+        for (size_t i = 0; i < children.size(); i++) {
+            auto branch = children[i].required_literals();
+            if (branch.empty()) return;
+            if (i == 0) {
+                prefix = branch.front();
+                suffix = branch.back();
+                continue;
+            }
+            const std::string & first = branch.front();
+            const std::string & last = branch.back();
+            size_t len = 0;
+            while (len < prefix.size() && len < first.size() && prefix[len] == first[len]) len++;
+            prefix.resize(len);
+            len = 0;
+            while (len < suffix.size() && len < last.size() &&
+                   suffix[suffix.size() - 1 - len] == last[last.size() - 1 - len]) len++;
+            suffix.erase(0, suffix.size() - len);
+        }
+        if (!prefix.empty()) result.push_back(prefix);
+        if (!suffix.empty() && suffix != prefix) result.push_back(suffix);
+    }
+
+    // e.g. AND(OR("foo", "bar"), "baz")
+    std::string to_string() const {
+        switch (type) {
+            case Type::kAll: return "ALL";
+            case Type::kLiteral: return "\"" + literal + "\"";
+            default: break;
+        }
+        std::string result = type == Type::kAnd ? "AND(" : "OR(";
+        for (size_t i = 0; i < children.size(); i++) {
+            if (i > 0) result += ", ";
+            result += children[i].to_string();
+        }
+        return result + ")";
+    }
+};
+
+/**
+ * Prefilter of a regex in RE2 syntax, as a QueryPlan. A recursive descent
+ *   computes for each sub-expression what is known of the strings it
+ *   matches (the analysis of Russ Cox's trigram index):
+ *   - can_empty: it may match the empty string;
+ *   - exact: the set of all the strings it matches, while small;
+ *   - prefix / suffix: otherwise, sets that every matched string starts /
+ *     ends with ("" when nothing is known);
+ *   - match: a plan that every matched string satisfies.
+ *   Concatenation crosses the sets (keeping e.g. "ab" and "bc" for ab+c),
+ *   alternation unites them, and sets larger than kMaxSetSize are moved
+ *   into match as an OR. Small character classes ([a-c], \x41, letters
+ *   under (?i)) are sets of one-char strings; any other class, ., \d and
+ *   friends match one unknown char; text in \Q...\E is literal. A syntax
+ *   error makes the plan kAll and is reported on std::cerr.
+ */
+class QueryPlanParser {
+ public:
+    // larger string sets are moved into the match plan
+    static constexpr size_t kMaxSetSize = 16;
+    // larger character classes match one unknown char
+    static constexpr size_t kMaxClassSize = 8;
+    // x{n,m} is analyzed as at most this many copies of x
+    static constexpr size_t kMaxRepeat = 4;
+
+    explicit QueryPlanParser(const std::string & reg_str) : k_reg_(reg_str) {}
+
+    QueryPlan parse() {
+        pos_ = 0;
+        failed_ = false;
+        fold_case_ = false;
+        quoted_ = false;
+        Info info = parse_alternation();
+        if (!failed_ && pos_ < k_reg_.size()) {
+            fail("Unmatched parathesis: missing left");
+        }
+        if (failed_) {
+            return QueryPlan::all();
+        }
+        return full_match(info);
+    }
+
+ private:
+    using StringSet = std::set<std::string>;
+
+    struct Info {
+        bool can_empty = false;
+        bool is_exact = false;
+        StringSet exact;
+        StringSet prefix{""};
+        StringSet suffix{""};
+        QueryPlan match;
+    };
+
+    const std::string & k_reg_;
+    size_t pos_ = 0;
+    bool failed_ = false;
+    bool fold_case_ = false;    // (?i) in effect
+    bool quoted_ = false;       // inside \Q...\E
+
+    void fail(const std::string & msg) {
+        if (!failed_) {
+            std::cerr << msg << " at pos " << pos_ << " of " << k_reg_ << std::endl;
+        }
+        failed_ = true;
+        pos_ = k_reg_.size();
+    }
+
+    bool at_end() const { return pos_ >= k_reg_.size(); }
+
+    /*---------------------------- string set algebra ----------------------------*/
+
+    static StringSet cross(const StringSet & l, const StringSet & r) {
+        StringSet result;
+        for (const auto & a : l) {
+            for (const auto & b : r) {
+                result.insert(a + b);
+            }
+        }
+        return result;
+    }
+
+    // OR of the strings; kAll if one of them is empty (or there are none)
+    static QueryPlan or_strings(const StringSet & strs) {
+        std::vector<QueryPlan> children;
+        for (const auto & str : strs) {
+            if (str.empty()) return QueryPlan::all();
+            children.push_back(QueryPlan::of_literal(str));
+        }
+        return QueryPlan::make(QueryPlan::Type::kOr, std::move(children));
+    }
+
+    static QueryPlan and_plans(QueryPlan l, QueryPlan r) {
+        std::vector<QueryPlan> children;
+        children.push_back(std::move(l));
+        children.push_back(std::move(r));
+        return QueryPlan::make(QueryPlan::Type::kAnd, std::move(children));
+    }
+
+    static const StringSet & prefix_of(const Info & x) { return x.is_exact ? x.exact : x.prefix; }
+    static const StringSet & suffix_of(const Info & x) { return x.is_exact ? x.exact : x.suffix; }
+
+    // everything known of x as one plan
+    static QueryPlan full_match(const Info & x) {
+        if (x.is_exact) {
+            return and_plans(x.match, or_strings(x.exact));
+        }
+        return and_plans(and_plans(x.match, or_strings(x.prefix)), or_strings(x.suffix));
+    }
+
+    static Info empty_string() {
+        Info x;
+        x.can_empty = true;
+        x.is_exact = true;
+        x.exact = {""};
+        return x;
+    }
+
+    static Info any_char() {
+        return Info();
+    }
+
+    static Info any_string() {
+        Info x;
+        x.can_empty = true;
+        return x;
+    }
+
+    // one of the ASCII chars, with their other cases under (?i)
+    Info of_chars(const std::set<char> & chars) const {
+        Info x;
+        x.is_exact = true;
+        for (char c : chars) {
+            x.exact.insert(std::string(1, c));
+            if (fold_case_) add_other_case(c, x.exact);
+        }
+        if (x.exact.empty() || x.exact.size() > kMaxClassSize) {
+            return any_char();
+        }
+        return x;
+    }
+
+    Info of_char(char c) const {
+        return of_chars({c});
+    }
+
+    // RE2 folds k and s with the Kelvin sign U+212A and the long s U+017F too
+    static void add_other_case(char c, StringSet & strs) {
+        char lower = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        if (lower < 'a' || lower > 'z') return;
+        strs.insert(std::string(1, lower));
+        strs.insert(std::string(1, static_cast<char>(lower - 'a' + 'A')));
+        if (lower == 'k') strs.insert("\xE2\x84\xAA");
+        if (lower == 's') strs.insert("\xC5\xBF");
+    }
+
+    // a multi-byte UTF-8 char, which is one atom; its case folding
+    //   is not known here
+    Info of_utf8(const std::string & seq) const {
+        if (fold_case_) return any_char();
+        Info x;
+        x.is_exact = true;
+        x.exact = {seq};
+        return x;
+    }
+
+    static bool is_utf8_byte(char c) {
+        return static_cast<unsigned char>(c) >= 0x80;
+    }
+
+    // the UTF-8 sequence whose first byte is at pos_ - 1
+    std::string read_utf8() {
+        size_t begin = pos_ - 1;
+        while (!at_end() && (static_cast<unsigned char>(k_reg_[pos_]) & 0xC0) == 0x80) {
+            pos_++;
+        }
+        return k_reg_.substr(begin, pos_ - begin);
+    }
+
+    // move a too large exact set of x into its match
+    static void bound_exact(Info & x) {
+        if (x.is_exact && x.exact.size() > kMaxSetSize) {
+            x.match = and_plans(std::move(x.match), or_strings(x.exact));
+            x.prefix = x.exact;
+            x.suffix = x.exact;
+            x.is_exact = false;
+            x.exact.clear();
+        }
+        bound_affix(x.prefix, x.match);
+        bound_affix(x.suffix, x.match);
+    }
+
+    static void bound_affix(StringSet & affix, QueryPlan & match) {
+        if (affix.size() > kMaxSetSize) {
+            match = and_plans(std::move(match), or_strings(affix));
+            affix = {""};
+        }
+    }
+
+    // strings of x followed by strings of y
+    static Info concat(const Info & x, const Info & y) {
+        Info xy;
+        xy.can_empty = x.can_empty && y.can_empty;
+        xy.match = and_plans(x.match, y.match);
+        if (x.is_exact && y.is_exact && x.exact.size() * y.exact.size() <= kMaxSetSize) {
+            xy.is_exact = true;
+            xy.exact = cross(x.exact, y.exact);
+            return xy;
+        }
+        // the suffix of x and the prefix of y meet either in the prefix or
+        //   the suffix of xy, when one side is exact, or across the boundary
+        const StringSet & x_suffix = suffix_of(x);
+        const StringSet & y_prefix = prefix_of(y);
+        if (!x.is_exact && !y.is_exact) {
+            if (x_suffix.size() * y_prefix.size() <= kMaxSetSize) {
+                xy.match = and_plans(std::move(xy.match), or_strings(cross(x_suffix, y_prefix)));
+            } else {
+                xy.match = and_plans(std::move(xy.match), or_strings(x_suffix));
+                xy.match = and_plans(std::move(xy.match), or_strings(y_prefix));
+            }
+        }
+        if (!x.is_exact) {
+            xy.prefix = x.prefix;
+        } else if (x.exact.size() * y_prefix.size() <= kMaxSetSize) {
+            xy.prefix = cross(x.exact, y_prefix);
+        } else {
+            xy.prefix = x.exact;
+            xy.match = and_plans(std::move(xy.match), or_strings(y_prefix));
+        }
+        if (!y.is_exact) {
+            xy.suffix = y.suffix;
+        } else if (x_suffix.size() * y.exact.size() <= kMaxSetSize) {
+            xy.suffix = cross(x_suffix, y.exact);
+        } else {
+            xy.suffix = y.exact;
+            xy.match = and_plans(std::move(xy.match), or_strings(x_suffix));
+        }
+        return xy;
+    }
+
+    // strings of x or of y
+    static Info alternate(const Info & x, const Info & y) {
+        Info xy;
+        xy.can_empty = x.can_empty || y.can_empty;
+        if (x.is_exact && y.is_exact) {
+            xy.is_exact = true;
+            xy.exact = x.exact;
+            xy.exact.insert(y.exact.begin(), y.exact.end());
+            bound_exact(xy);
+            return xy;
+        }
+        std::vector<QueryPlan> branches;
+        branches.push_back(full_match(x));
+        branches.push_back(full_match(y));
+        xy.match = QueryPlan::make(QueryPlan::Type::kOr, std::move(branches));
+        xy.prefix = prefix_of(x);
+        xy.prefix.insert(prefix_of(y).begin(), prefix_of(y).end());
+        xy.suffix = suffix_of(x);
+        xy.suffix.insert(suffix_of(y).begin(), suffix_of(y).end());
+        if (xy.prefix.size() > kMaxSetSize) xy.prefix = {""};
+        if (xy.suffix.size() > kMaxSetSize) xy.suffix = {""};
+        return xy;
+    }
+
+    // one or more strings of x
+    static Info plus(const Info & x) {
+        if (!x.is_exact) return x;
+        Info xs;
+        xs.can_empty = x.can_empty;
+        xs.match = and_plans(x.match, or_strings(x.exact));
+        xs.prefix = x.exact;
+        xs.suffix = x.exact;
+        return xs;
+    }
+
+    // x{min_repeat, max_repeat}; max_repeat SIZE_MAX when unbounded
+    static Info repeat(const Info & x, size_t min_repeat, size_t max_repeat) {
+        if (max_repeat == 0) return empty_string();
+        if (min_repeat == 0) {
+            if (max_repeat == SIZE_MAX) return any_string();
+            return alternate(empty_string(), repeat(x, 1, max_repeat));
+        }
+        Info xs = x;
+        if (min_repeat == max_repeat && min_repeat <= kMaxRepeat) {
+            for (size_t i = 1; i < min_repeat; i++) {
+                xs = concat(xs, x);
+                bound_exact(xs);
+            }
+            return xs;
+        }
+        // x{n,m} is within x^(k-1) x+ for k <= n
+        xs = plus(x);
+        for (size_t i = 1; i < std::min(min_repeat, kMaxRepeat); i++) {
+            xs = concat(x, xs);
+            bound_exact(xs);
+        }
+        return xs;
+    }
+
+    /*---------------------------------- parser ----------------------------------*/
+
+    Info parse_alternation() {
+        Info info = parse_concatenation();
+        while (!at_end() && k_reg_[pos_] == '|') {
+            pos_++;
+            info = alternate(info, parse_concatenation());
+        }
+        return info;
+    }
+
+    Info parse_concatenation() {
+        Info info = empty_string();
+        while (!at_end() && (quoted_ || (k_reg_[pos_] != '|' && k_reg_[pos_] != ')'))) {
+            bool is_atom = true;
+            Info atom = parse_atom(is_atom);
+            if (failed_) break;
+            if (!is_atom) continue;
+            size_t min_repeat = 1, max_repeat = 1;
+            if (!quoted_ && parse_repetition(min_repeat, max_repeat)) {
+                atom = repeat(atom, min_repeat, max_repeat);
+            }
+            if (failed_) break;
+            info = concat(info, atom);
+            bound_exact(info);
+        }
+        return info;
+    }
+
+    // is_atom is false after a flag group (?i) that matches nothing
+    Info parse_atom(bool & is_atom) {
+        if (quoted_) return parse_quoted(is_atom);
+        char c = k_reg_[pos_++];
+        switch (c) {
+            case '(':
+                return parse_group(is_atom);
+            case '[':
+                return parse_class();
+            case '.':
+                return any_char();
+            case '^': case '$':
+                return empty_string();
+            case '*': case '+': case '?':
+                fail("Missing argument to repetition operator");
+                return Info();
+            case '\\': {
+                if (!at_end() && k_reg_[pos_] == 'Q') {
+                    pos_++;
+                    quoted_ = true;
+                    return parse_quoted(is_atom);
+                }
+                std::set<char> chars;
+                if (parse_escape(chars)) return of_chars(chars);
+                return chars.empty() && is_empty_width(k_reg_[pos_ - 1]) ? empty_string()
+                                                                        : any_char();
+            }
+            default:
+                if (is_utf8_byte(c)) return of_utf8(read_utf8());
+                return of_char(c);
+        }
+    }
+
+    // inside \Q...\E every char up to \E is literal; the \E is consumed
+    //   with the last char so that a quantifier after it applies to that char
+    Info parse_quoted(bool & is_atom) {
+        if (at_end() || k_reg_.compare(pos_, 2, "\\E") == 0) {
+            pos_ = std::min(pos_ + 2, k_reg_.size());
+            quoted_ = false;
+            is_atom = false;
+            return Info();
+        }
+        char c = k_reg_[pos_++];
+        Info info = is_utf8_byte(c) ? of_utf8(read_utf8()) : of_char(c);
+        if (k_reg_.compare(pos_, 2, "\\E") == 0) {
+            pos_ += 2;
+            quoted_ = false;
+        }
+        return info;
+    }
+
+    static bool is_empty_width(char c) {
+        return c == 'b' || c == 'B' || c == 'A' || c == 'z';
+    }
+
+    // after '('
+    Info parse_group(bool & is_atom) {
+        bool outer_fold_case = fold_case_;
+        if (!at_end() && k_reg_[pos_] == '?') {
+            pos_++;
+            if (!at_end() && (k_reg_[pos_] == 'P' || k_reg_[pos_] == '<')) {
+                // named group (?P<name>...) or (?<name>...)
+                size_t close = k_reg_.find('>', pos_);
+                if (close == std::string::npos) {
+                    fail("Invalid named capture group");
+                    return Info();
+                }
+                pos_ = close + 1;
+            } else {
+                // flags (?flags) up to the end of the enclosing group, or (?flags:...)
+                bool negated = false;
+                bool fold_case = fold_case_;
+                while (!at_end() && k_reg_[pos_] != ')' && k_reg_[pos_] != ':') {
+                    char flag = k_reg_[pos_++];
+                    if (flag == '-') {
+                        negated = true;
+                    } else if (flag == 'i') {
+                        fold_case = !negated;
+                    }
+                }
+                if (at_end()) {
+                    fail("Missing closing )");
+                    return Info();
+                }
+                if (k_reg_[pos_++] == ')') {
+                    fold_case_ = fold_case;
+                    is_atom = false;
+                    return Info();
+                }
+                fold_case_ = fold_case;
+            }
+        }
+        Info info = parse_alternation();
+        fold_case_ = outer_fold_case;
+        if (at_end() || k_reg_[pos_] != ')') {
+            fail("Missing closing )");
+            return Info();
+        }
+        pos_++;
+        return info;
+    }
+
+    // after '['
+    Info parse_class() {
+        bool negated = false;
+        bool unknown = false;   // has a part that is not worth expanding
+        std::set<char> chars;
+        if (!at_end() && k_reg_[pos_] == '^') {
+            negated = true;
+            pos_++;
+        }
+        bool first = true;
+        while (!at_end() && (first || k_reg_[pos_] != ']')) {
+            first = false;
+            if (k_reg_.compare(pos_, 2, "[:") == 0 &&
+                k_reg_.find(":]", pos_ + 2) != std::string::npos) {
+                pos_ = k_reg_.find(":]", pos_ + 2) + 2;
+                unknown = true;
+                continue;
+            }
+            char lo = 0;
+            if (!parse_class_char(lo, unknown)) continue;
+            char hi = lo;
+            if (pos_ + 1 < k_reg_.size() && k_reg_[pos_] == '-' && k_reg_[pos_ + 1] != ']') {
+                pos_++;
+                if (!parse_class_char(hi, unknown)) continue;
+            }
+            if (static_cast<unsigned char>(hi) < static_cast<unsigned char>(lo)) {
+                fail("Bad character class range");
+                return Info();
+            }
+            if (static_cast<size_t>(static_cast<unsigned char>(hi)) -
+                static_cast<unsigned char>(lo) >= kMaxClassSize) {
+                unknown = true;
+                continue;
+            }
+            for (int ch = static_cast<unsigned char>(lo); ch <= static_cast<unsigned char>(hi); ch++) {
+                chars.insert(static_cast<char>(ch));
+            }
+        }
+        if (at_end()) {
+            fail("Missing closing ]");
+            return Info();
+        }
+        pos_++;
+        if (negated || unknown) return any_char();
+        return of_chars(chars);
+    }
+
+    // one char of a class into c; false (with unknown set) for \d and friends
+    //   and multi-byte UTF-8 chars
+    bool parse_class_char(char & c, bool & unknown) {
+        c = k_reg_[pos_++];
+        if (is_utf8_byte(c)) {
+            read_utf8();
+            unknown = true;
+            return false;
+        }
+        if (c != '\\') return true;
+        std::set<char> chars;
+        if (parse_escape(chars) && chars.size() == 1) {
+            c = *chars.begin();
+            return true;
+        }
+        unknown = true;
+        return false;
+    }
+
+    // after '\'; the chars the escape stands for, or false if it is a class,
+    //   an empty-width assertion or a code not decoded here
+    bool parse_escape(std::set<char> & chars) {
+        if (at_end()) {
+            fail("Trailing \\");
+            return false;
+        }
+        char c = k_reg_[pos_++];
+        switch (c) {
+            case 'n': chars.insert('\n'); return true;
+            case 't': chars.insert('\t'); return true;
+            case 'r': chars.insert('\r'); return true;
+            case 'f': chars.insert('\f'); return true;
+            case 'v': chars.insert('\v'); return true;
+            case 'a': chars.insert('\a'); return true;
+            case 'x': {
+                // \xHH or \x{H...}; multi-byte code points are not decoded
+                size_t code = 0;
+                size_t num_digits = 0;
+                bool braced = !at_end() && k_reg_[pos_] == '{';
+                if (braced) pos_++;
+                while (!at_end() && std::isxdigit(static_cast<unsigned char>(k_reg_[pos_])) &&
+                       (braced || num_digits < 2)) {
+                    char h = k_reg_[pos_++];
+                    code = code * 16 + (std::isdigit(static_cast<unsigned char>(h))
+                                        ? h - '0' : std::tolower(h) - 'a' + 10);
+                    num_digits++;
+                }
+                if (braced) {
+                    if (at_end() || k_reg_[pos_] != '}') {
+                        fail("Invalid escape sequence");
+                        return false;
+                    }
+                    pos_++;
+                }
+                if (num_digits == 0) {
+                    fail("Invalid escape sequence");
+                    return false;
+                }
+                if (code >= 0x80) return false;
+                chars.insert(static_cast<char>(code));
+                return true;
+            }
+            case '0': case '1': case '2': case '3':
+            case '4': case '5': case '6': case '7': {
+                // octal code of up to 3 digits; a single non-zero digit
+                //   would be a backreference, which RE2 rejects
+                if (c != '0' && (at_end() || k_reg_[pos_] < '0' || k_reg_[pos_] > '7')) {
+                    fail("Invalid escape sequence");
+                    return false;
+                }
+                size_t code = c - '0';
+                for (size_t num_digits = 1; num_digits < 3 && !at_end() &&
+                     k_reg_[pos_] >= '0' && k_reg_[pos_] <= '7'; num_digits++) {
+                    code = code * 8 + (k_reg_[pos_++] - '0');
+                }
+                if (code >= 0x80) return false;
+                chars.insert(static_cast<char>(code));
+                return true;
+            }
+            case 'p': case 'P':
+                // \pN or \p{Name}
+                if (!at_end() && k_reg_[pos_] == '{') {
+                    size_t close = k_reg_.find('}', pos_);
+                    pos_ = close == std::string::npos ? k_reg_.size() : close + 1;
+                } else if (!at_end()) {
+                    pos_++;
+                }
+                return false;
+            default:
+                break;
+        }
+        if (std::isalnum(static_cast<unsigned char>(c))) {
+            // classes (\d, \w, ...) and assertions (\b, \A, ...)
+            return false;
+        }
+        if (is_utf8_byte(c)) {
+            // an escaped multi-byte char; taken as unknown
+            read_utf8();
+            return false;
+        }
+        // escaped punctuation stands for itself
+        chars.insert(c);
+        return true;
+    }
+
+    // quantifier following an atom, if any
+    bool parse_repetition(size_t & min_repeat, size_t & max_repeat) {
+        if (at_end()) return false;
+        char c = k_reg_[pos_];
+        if (c == '*') {
+            min_repeat = 0;
+            max_repeat = SIZE_MAX;
+            pos_++;
+        } else if (c == '?') {
+            min_repeat = 0;
+            max_repeat = 1;
+            pos_++;
+        } else if (c == '+') {
+            min_repeat = 1;
+            max_repeat = SIZE_MAX;
+            pos_++;
+        } else if (c == '{') {
+            // {n}, {n,} or {n,m}; anything else is a literal '{'
+            size_t p = pos_ + 1;
+            size_t n = 0, m = 0;
+            size_t num_digits = 0;
+            while (p < k_reg_.size() && std::isdigit(static_cast<unsigned char>(k_reg_[p]))) {
+                n = n * 10 + (k_reg_[p++] - '0');
+                num_digits++;
+            }
+            if (num_digits == 0) return false;
+            m = n;
+            if (p < k_reg_.size() && k_reg_[p] == ',') {
+                p++;
+                if (p < k_reg_.size() && std::isdigit(static_cast<unsigned char>(k_reg_[p]))) {
+                    m = 0;
+                    while (p < k_reg_.size() && std::isdigit(static_cast<unsigned char>(k_reg_[p]))) {
+                        m = m * 10 + (k_reg_[p++] - '0');
+                    }
+                } else {
+                    m = SIZE_MAX;
+                }
+            }
+            if (p >= k_reg_.size() || k_reg_[p] != '}') return false;
+            min_repeat = n;
+            max_repeat = m;
+            pos_ = p + 1;
+        } else {
+            return false;
+        }
+        // non-greedy
+        if (!at_end() && k_reg_[pos_] == '?') pos_++;
+        if (!at_end() && (k_reg_[pos_] == '*' || k_reg_[pos_] == '+' || k_reg_[pos_] == '?')) {
+            fail("Bad repetition operator");
+        }
+        return true;
+    }
+};
+
+static QueryPlan parse_query_plan(const std::string & reg_str) {
+    return QueryPlanParser(reg_str).parse();
+}
+
+#endif // UTILS_QUERY_PLAN_HPP_
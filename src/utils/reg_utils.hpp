@@ -2,16 +2,14 @@
 #define UTILS_REG_UTILS_HPP_
 
 #include <vector>
-#include <stack>
 #include <string>
 #include <unordered_set>
 #include <algorithm>
 
+#include "query_plan.hpp"
+
 //The true special/meta chars: '{', '}', '[', ']', '(', ')', '^', '$', '.', '*', '+', '?', '|'
 static const std::unordered_set<char> k_special_chars{'^', '$', '.', '|'};
-static const std::unordered_set<char> k_rep_chars{'*', '+', '?'};
-static const std::unordered_set<char> k_parath_l_chars{'{', '[', '('};
-static const std::unordered_set<char> k_parath_r_chars{'}', ']', ')'};
 static const std::unordered_set<char> k_special_classes{'w', 'W', 'a', 'b', 'B', 'd', 'D', 'l', 'p',
                                                  's', 'S', 'u', 'x', 'z'};
 
@@ -51,110 +49,16 @@ static bool check_special(const std::string & reg_str) {
     return false;
 }
 
+// the literals of the query plan of reg_str, e.g. {"barbaz", "foobaz"} for
+//   (foo|bar)baz; empty if it has none or cannot be parsed
 static std::vector<std::string> extract_literals(const std::string & reg_str) {
-    std::vector<std::string> result;
-
-    std::string curr_result = "";
-
-    std::stack<char> para_stack;
-
-    bool escaped = false;
-
-    int pattern_end_idx = -2;
-
-    for (size_t i = 0; i < reg_str.size(); i++) {
-        char c = reg_str.at(i);
-        char curr_char = '\n';
-        if (c == '\\') {
-            if (escaped) {
-                curr_char = c;
-                escaped = false;
-            } else {
-                escaped = true;
-                continue;
-            }
-        } else if (k_special_classes.contains(c)) {
-            if (!escaped) {
-                curr_char = c;
-            } else {
-                escaped = false;
-                continue;
-            }
-        } else if (k_special_chars.contains(c)) {
-            if (escaped) {
-                curr_char = c;
-                escaped = false;
-            } else {
-                continue;
-            }
-        } else if (k_parath_l_chars.contains(c)) {
-            if (escaped) {
-                curr_char = c;
-                escaped = false;
-            } else {
-                if (para_stack.empty() && curr_result.size() > 0) {
-                    result.push_back(curr_result);
-                    curr_result = "";
-                }
-                para_stack.push(c);
-                continue;
-            }
-        } else if (k_parath_r_chars.contains(c)) {
-            if (escaped) {
-                curr_char = c;
-                escaped = false;
-            } else {
-                if (para_stack.empty()) {
-                    std::cerr << "Unmatched parathesis: missing left for ";
-                    std::cerr << c << " at pos " << i << std::endl;
-                    return std::vector<std::string>();
-                } else if ((c == ')' && para_stack.top() == '(') || 
-                           (c == ']' && para_stack.top() == '[') || 
-                           (c == '}' && para_stack.top() == '{')) {
-                    para_stack.pop();
-                    if (para_stack.empty()) {
-                        pattern_end_idx = i;
-                    }
-                    continue;
-                } else {
-                    std::cerr << "Unmatched parathesis: current " << c << ", previous " << para_stack.top() << std::endl;
-                    std::cerr << "Unmatched parathesis: different left " << std::endl;
-                    return std::vector<std::string>();
-                }
-            }
-        } else if (k_rep_chars.contains(c)) {
-            if (i == pattern_end_idx + 1 || (curr_result.empty() && i > 0)) {
-                continue;
-            } else {
-                std::cerr << "Misplaced repetition char" << std::endl;
-                return std::vector<std::string>();
-            }
-        } else {
-            if (c == 'n' && escaped) {
-                curr_char = '\n';
-            } else if (c == 't' && escaped) {
-                curr_char = '\t';
-            } else {
-                // assumes pattern components in parathesis
-                curr_char = c;
-            }
-        }
-        escaped = false;
+    return parse_query_plan(reg_str).literals();
+}
 
-        if (para_stack.empty()) {
-            curr_result += curr_char;
-        }
-#ifndef NDEBUG
-        std::cout << curr_result << std::endl;
-#endif  
-    }
-    if (!curr_result.empty()) {
-        result.push_back(curr_result);
-    }
-#ifndef NDEBUG
-    std::cout << "---- end reading " << reg_str << " into " << result.size() << " lits ------" << std::endl;
-#endif 
-    return result;
+// the literals every line matching reg_str contains, e.g. {"baz"} for
+//   (foo|bar)baz; what index builders and find_all_keys take as a conjunction
+static std::vector<std::string> extract_required_literals(const std::string & reg_str) {
+    return parse_query_plan(reg_str).required_literals();
 }
 
 #endif // UTILS_REG_UTILS_HPP_
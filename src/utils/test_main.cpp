@@ -0,0 +1,361 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <iterator>
+#include <cstdint>
+#include <string>
+
+#include "packed_posting.hpp"
+#include "hybrid_posting.hpp"
+#include "query_plan.hpp"
+
+#include <re2/re2.h>
+
+#include <cassert>
+
+// sorted distinct ids: each of [0, universe) kept with probability density
+std::vector<size_t> random_ids(size_t universe, double density, unsigned seed) {
+    std::mt19937_64 gen(seed);
+    std::bernoulli_distribution keep(density);
+    std::vector<size_t> ids;
+    for (size_t i = 0; i < universe; i++) {
+        if (keep(gen)) ids.push_back(i);
+    }
+    return ids;
+}
+
+std::vector<size_t> reference_intersection(const std::vector<size_t> & a,
+                                           const std::vector<size_t> & b) {
+    std::vector<size_t> result;
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+    return result;
+}
+
+std::vector<size_t> reference_union(const std::vector<size_t> & a,
+                                    const std::vector<size_t> & b) {
+    std::vector<size_t> result;
+    std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+    return result;
+}
+
+// lists covering the edge cases of the posting list encodings
+std::vector<std::vector<size_t>> edge_case_lists() {
+    std::vector<std::vector<size_t>> lists;
+    lists.push_back({});
+    lists.push_back({0});
+    lists.push_back({123456789});
+    // dense runs, around the block and chunk sizes
+    for (size_t n : {127, 128, 129, 4096, 4097, 65535, 65536, 65537, 200000}) {
+        std::vector<size_t> run(n);
+        for (size_t i = 0; i < n; i++) run[i] = i;
+        lists.push_back(run);
+    }
+    // ids around the 2^16 chunk boundaries
+    lists.push_back({65535, 65536, 65537, 131071, 131072, 196607});
+    // large gaps, up to the largest id
+    lists.push_back({1, size_t(1) << 20, size_t(1) << 40, (size_t(1) << 40) + 1,
+                     SIZE_MAX - 1, SIZE_MAX});
+    lists.push_back(random_ids(300000, 0.01, 1));
+    lists.push_back(random_ids(300000, 0.3, 2));
+    lists.push_back(random_ids(300000, 0.95, 3));
+    return lists;
+}
+
+void packed_round_trip() {
+    for (const auto & ids : edge_case_lists()) {
+        PackedPostingList packed(ids);
+        assert(packed.size() == ids.size() && "Packed size is the number of ids");
+        assert(packed.empty() == ids.empty() && "Packed empty iff no ids");
+        std::vector<size_t> decoded;
+        packed.decode(decoded);
+        assert(decoded == ids && "Packed decodes to its ids");
+    }
+}
+
+void packed_intersect() {
+    auto lists = edge_case_lists();
+    for (const auto & a : lists) {
+        PackedPostingList packed(a);
+        for (const auto & b : lists) {
+            std::vector<size_t> container = b;
+            packed.intersect(container);
+            assert(container == reference_intersection(a, b) &&
+                   "Packed intersection is the set intersection");
+        }
+    }
+}
+
+void packed_bytes() {
+    std::vector<size_t> dense(100000);
+    for (size_t i = 0; i < dense.size(); i++) dense[i] = 3 * i;
+    PackedPostingList packed(dense);
+    assert(packed.get_bytes_used() <
+           static_cast<long long int>(dense.size() * sizeof(size_t) / 8) &&
+           "Small gaps take a few bits per id");
+}
+
+// the hybrid chunk keys are 32 bits, so its ids are below 2^48
+std::vector<std::vector<size_t>> hybrid_edge_case_lists() {
+    const size_t max_id = size_t(1) << 48;
+    std::vector<std::vector<size_t>> lists;
+    for (auto & ids : edge_case_lists()) {
+        if (ids.empty() || ids.back() < max_id) lists.push_back(std::move(ids));
+    }
+    lists.push_back({1, size_t(1) << 20, size_t(1) << 40, (size_t(1) << 40) + 1,
+                     max_id - 2, max_id - 1});
+    return lists;
+}
+
+void check_decodes(const HybridPostingList & list, const std::vector<size_t> & ids) {
+    std::vector<size_t> decoded;
+    list.decode(decoded);
+    assert(decoded == ids && "Hybrid decodes to its ids");
+    assert(list.size() == ids.size() && "Hybrid size is the number of ids");
+}
+
+void hybrid_round_trip() {
+    for (const auto & ids : hybrid_edge_case_lists()) {
+        HybridPostingList hybrid(ids);
+        assert(hybrid.empty() == ids.empty() && "Hybrid empty iff no ids");
+        check_decodes(hybrid, ids);
+    }
+}
+
+void hybrid_containers() {
+    using H = HybridPostingList;
+    std::vector<size_t> run(200000);
+    for (size_t i = 0; i < run.size(); i++) run[i] = i;
+    H runs(run);
+    assert(runs.num_containers() == 4 && runs.num_containers(H::kRun) == 4 &&
+           "Consecutive ids go to run containers, one per 2^16 ids");
+
+    H sparse(random_ids(300000, 0.01, 4));
+    assert(sparse.num_containers(H::kArray) == sparse.num_containers() &&
+           "Sparse chunks go to array containers");
+
+    H dense(random_ids(300000, 0.3, 5));
+    assert(dense.num_containers(H::kBitmap) == dense.num_containers() &&
+           "Dense chunks with many runs go to bitmap containers");
+
+    // 4096 ids fit an array, one more switches the chunk to a bitmap
+    std::vector<size_t> every_other;
+    for (size_t i = 0; i < 2 * H::kMaxArraySize; i += 2) every_other.push_back(i);
+    assert(H(every_other).num_containers(H::kArray) == 1 && "4096 ids in an array");
+    every_other.push_back(2 * H::kMaxArraySize);
+    assert(H(every_other).num_containers(H::kBitmap) == 1 && "4097 ids in a bitmap");
+}
+
+void hybrid_set_operations() {
+    auto lists = hybrid_edge_case_lists();
+    for (const auto & a : lists) {
+        HybridPostingList hybrid_a(a);
+        for (const auto & b : lists) {
+            HybridPostingList hybrid_b(b);
+            auto expected = reference_intersection(a, b);
+
+            std::vector<size_t> container = b;
+            hybrid_a.intersect(container);
+            assert(container == expected && "Hybrid intersection with ids");
+
+            check_decodes(hybrid_a.intersect(hybrid_b), expected);
+            check_decodes(hybrid_a.unite(hybrid_b), reference_union(a, b));
+        }
+    }
+}
+
+void hybrid_bitset() {
+    const size_t universe = 300000;
+    const size_t num_words = (universe + 63) / 64;
+    auto lists = hybrid_edge_case_lists();
+    for (const auto & a : lists) {
+        HybridPostingList hybrid_a(a);
+        std::vector<uint64_t> bits(num_words, 0);
+        hybrid_a.set_bits(bits.data(), num_words);
+        for (size_t i = 0; i < universe; i++) {
+            bool expected = std::binary_search(a.begin(), a.end(), i);
+            assert(bool((bits[i / 64] >> (i % 64)) & 1) == expected && 
+                   "set_bits sets the ids below the end, only them");
+        }
+        for (const auto & b : lists) {
+            size_t expected = 0;
+            for (size_t id : b) expected += id < universe && ((bits[id / 64] >> (id % 64)) & 1);
+            assert(HybridPostingList(b).count_in(bits.data(), num_words) == expected && 
+                   "count_in counts the ids set in the bitset");
+        }
+    }
+}
+
+void plan_required_literals() {
+    using Strings = std::vector<std::string>;
+    // the literals shared by the branches of an OR are still required
+    assert(parse_query_plan("(foo|bar)baz").required_literals() == Strings({"baz"}) &&
+           "Common suffix of the branches is required");
+    assert(parse_query_plan("Subject: (RE|FW): meeting").required_literals() ==
+           Strings({"Subject: ", ": meeting"}) &&
+           "Common prefix and suffix of the branches are required");
+    assert(parse_query_plan("a[bc]d").required_literals() == Strings({"a", "d"}) &&
+           "Chars around a class are required");
+    assert(parse_query_plan("(foo|bar).*baz(1|2)").required_literals() == Strings({"baz"}) &&
+           "Common prefix of the second OR is required");
+    // no substring is shared by every case of hello, so nothing is required
+    assert(parse_query_plan("(?i)hello").required_literals().empty() &&
+           "Case variants share no literal");
+    assert(parse_query_plan("(abc)?x|y").required_literals().empty() &&
+           "Branches sharing nothing require nothing");
+}
+
+
+// whether a line containing the literals of the plan as substrings satisfies it
+bool satisfies(const QueryPlan & plan, const std::string & line) {
+    switch (plan.type) {
+        case QueryPlan::Type::kAll:
+            return true;
+        case QueryPlan::Type::kLiteral:
+            return line.find(plan.literal) != std::string::npos;
+        case QueryPlan::Type::kAnd:
+            return std::all_of(plan.children.begin(), plan.children.end(),
+                               [&](const QueryPlan & child) { return satisfies(child, line); });
+        case QueryPlan::Type::kOr:
+            return std::any_of(plan.children.begin(), plan.children.end(),
+                               [&](const QueryPlan & child) { return satisfies(child, line); });
+    }
+    return false;
+}
+
+const std::string kKelvin = "\xE2\x84\xAA";    // K, folds to k
+const std::string kLongS = "\xC5\xBF";         // long s, folds to s
+const std::string kEAcute = "\xC3\xA9";
+const std::string kAUmlaut = "\xC3\xA4";
+
+std::vector<std::string> plan_sample_lines() {
+    return {"foobaz", "barbaz qux", "baz alone", "William Clinton", "Bill Clinton", "Will",
+            "abd acd", "xacdx", "ad", "12x", "x", "zbc", "abc", "bc",
+            "sk", "SK", "s" + kKelvin, kLongS + "k", kLongS + kKelvin, "KS", kKelvin + kLongS, "k s",
+            "xy", "x" + kEAcute + "y", "x" + kEAcute + kEAcute + "y", "xey",
+            kAUmlaut + kAUmlaut + "b", "b", kAUmlaut + kAUmlaut + kAUmlaut + "b",
+            "aSb", "asb", "a.b*", "aXbb", "abbc", "ababc", "ac", "abbbbc",
+            "foo at start", "not foo", "ends with bar", "bar not", "a baz b", "abazb",
+            "ab", "ab ab", "abab", "ababab", ""};
+}
+
+// every sample line matched by reg satisfies its plan and contains its
+//   required literals, and the literals of the plan are the given ones
+void check_plan(const std::string & reg, const std::vector<std::string> & literals,
+                const std::vector<std::string> & required) {
+    RE2 re(reg, RE2::Quiet);
+    assert(re.ok() && "Test regex compiles");
+    QueryPlan plan = parse_query_plan(reg);
+    size_t num_matched = 0;
+    for (const auto & line : plan_sample_lines()) {
+        if (!RE2::PartialMatch(line, re)) continue;
+        num_matched++;
+        assert(satisfies(plan, line) && "Matched line satisfies the plan");
+        for (const auto & literal : plan.required_literals()) {
+            assert(line.find(literal) != std::string::npos &&
+                   "Matched line contains the required literals");
+        }
+    }
+    assert(num_matched > 0 && "Test regex matches a sample line");
+    assert(plan.literals() == literals && "Plan literals");
+    assert(plan.required_literals() == required && "Plan required literals");
+}
+
+void plan_alternation() {
+    check_plan("(foo|bar)baz", {"barbaz", "foobaz"}, {"baz"});
+    check_plan("William|Clinton", {"Clinton", "William"}, {});
+    check_plan("Will(iam)?", {"Will"}, {"Will"});
+}
+
+void plan_classes() {
+    check_plan("a[bc]d", {"abd", "acd"}, {"a", "d"});
+    check_plan("[0-9]+x", {"x"}, {"x"});
+    check_plan("[^a]bc", {"bc"}, {"bc"});
+    // too large to expand
+    check_plan("[a-z]bc", {"bc"}, {"bc"});
+}
+
+void plan_fold_case() {
+    // k and s also match the Kelvin sign and the long s
+    std::vector<std::string> variants = {"SK", "Sk", "S" + kKelvin, "sK", "sk", "s" + kKelvin,
+                        kLongS + "K", kLongS + "k", kLongS + kKelvin};
+    check_plan("(?i)sk", variants, {});
+    QueryPlan plan = parse_query_plan("(?i)sk");
+    for (const auto & line : {"s" + kKelvin, kLongS + "k", kLongS + kKelvin}) {
+        assert(RE2::PartialMatch(line, RE2("(?i)sk")) && satisfies(plan, line) &&
+               "Kelvin sign and long s satisfy the plan");
+    }
+    check_plan("(?i)k(?-i)S", {"KS", "kS", kKelvin + "S"}, {"S"});
+}
+
+void plan_utf8() {
+    // a quantifier applies to the whole multi-byte char
+    check_plan("x" + kEAcute + "?y", {"xy", "x" + kEAcute + "y"}, {"x", "y"});
+    check_plan(kAUmlaut + "{0,2}b", {"b"}, {"b"});
+    check_plan(kAUmlaut + "{2}b", {kAUmlaut + kAUmlaut + "b"}, {kAUmlaut + kAUmlaut + "b"});
+}
+
+void plan_escapes() {
+    check_plan("a\\123b", {"aSb"}, {"aSb"});
+    check_plan("\\141bc", {"abc"}, {"abc"});
+    check_plan("a\\x2eb", {"a.b"}, {"a.b"});
+    // \Q...\E quotes regex syntax; a quantifier after \E applies to its last char
+    check_plan("\\Qa.b*\\E", {"a.b*"}, {"a.b*"});
+    check_plan("\\Qab\\E+c", {"ab", "bc"}, {"ab", "bc"});
+    check_plan("x\\Qa|c)\\E|ab", {"ab", "xa|c)"}, {});
+}
+
+void plan_anchors() {
+    check_plan("^foo", {"foo"}, {"foo"});
+    check_plan("bar$", {"bar"}, {"bar"});
+    check_plan("\\bbaz\\b", {"baz"}, {"baz"});
+    check_plan("\\Aab\\z", {"ab"}, {"ab"});
+}
+
+void plan_repetition() {
+    check_plan("ab{2}c", {"abbc"}, {"abbc"});
+    check_plan("ab{1,3}c", {"ab", "bc"}, {"ab", "bc"});
+    check_plan("ab*c", {"a", "c"}, {"a", "c"});
+    check_plan("ab+c", {"ab", "bc"}, {"ab", "bc"});
+    check_plan("ab?c", {"abc", "ac"}, {"a", "c"});
+    check_plan("(ab){2,}", {"abab"}, {"abab"});
+}
+
+int main() {
+    std::cout << "BEGIN POSTING LIST TESTS -------------------------------------------" << std::endl;
+    std::cout << "\t PACKED ROUND TRIP-------------------------------------------" << std::endl;
+    packed_round_trip();
+    std::cout << "\t PACKED INTERSECT-------------------------------------------" << std::endl;
+    packed_intersect();
+    std::cout << "\t PACKED BYTES-------------------------------------------" << std::endl;
+    packed_bytes();
+    std::cout << "\t HYBRID ROUND TRIP-------------------------------------------" << std::endl;
+    hybrid_round_trip();
+    std::cout << "\t HYBRID CONTAINERS-------------------------------------------" << std::endl;
+    hybrid_containers();
+    std::cout << "\t HYBRID SET OPERATIONS-------------------------------------------" << std::endl;
+    hybrid_set_operations();
+    std::cout << "\t HYBRID BITSET-------------------------------------------" << std::endl;
+    hybrid_bitset();
+    std::cout << "END POSTING LIST TESTS -------------------------------------------" << std::endl;
+    std::cout << "BEGIN QUERY PLAN TESTS -------------------------------------------" << std::endl;
+    std::cout << "\t PLAN REQUIRED LITERALS-------------------------------------------" << std::endl;
+    plan_required_literals();
+    std::cout << "\t PLAN ALTERNATION-------------------------------------------" << std::endl;
+    plan_alternation();
+    std::cout << "\t PLAN CLASSES-------------------------------------------" << std::endl;
+    plan_classes();
+    std::cout << "\t PLAN FOLD CASE-------------------------------------------" << std::endl;
+    plan_fold_case();
+    std::cout << "\t PLAN UTF8-------------------------------------------" << std::endl;
+    plan_utf8();
+    std::cout << "\t PLAN ESCAPES-------------------------------------------" << std::endl;
+    plan_escapes();
+    std::cout << "\t PLAN ANCHORS-------------------------------------------" << std::endl;
+    plan_anchors();
+    std::cout << "\t PLAN REPETITION-------------------------------------------" << std::endl;
+    plan_repetition();
+    std::cout << "END QUERY PLAN TESTS -------------------------------------------" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,98 @@
+#ifndef UTILS_WORK_STEALING_POOL_HPP_
+#define UTILS_WORK_STEALING_POOL_HPP_
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <algorithm>
+
+/**
+ * Run-to-completion pool: every worker owns a deque of tasks, pops its own
+ *   tasks from the back and steals from the front of the other deques when
+ *   its own runs dry. Tasks may submit further tasks (to the deque of the
+ *   worker running them); run() returns once no task is left anywhere.
+ */
+class WorkStealingPool {
+ public:
+    // a task gets the pool and the id of the worker running it
+    using Task = std::function<void(WorkStealingPool &, size_t)>;
+
+    explicit WorkStealingPool(size_t num_threads)
+        : num_threads_(std::max(size_t(1), num_threads)) {
+        for (size_t i = 0; i < num_threads_; i++) {
+            queues_.push_back(std::make_unique<Queue>());
+        }
+    }
+
+    size_t get_num_threads() const { return num_threads_; }
+
+    // submit to the deque of worker wid; outside run(), any wid spreads the seeds
+    void submit(Task task, size_t wid) {
+        pending_.fetch_add(1, std::memory_order_relaxed);
+        auto & q = *queues_[wid % num_threads_];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        q.tasks.push_back(std::move(task));
+    }
+
+    // run all submitted (and spawned) tasks on num_threads_ threads
+    void run() {
+        std::vector<std::thread> threads;
+        for (size_t t = 1; t < num_threads_; t++) {
+            threads.emplace_back(&WorkStealingPool::work, this, t);
+        }
+        work(0);
+        for (auto & th : threads) th.join();
+    }
+
+ private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    const size_t num_threads_;
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::atomic<size_t> pending_{0};
+
+    bool pop_own(size_t wid, Task & task) {
+        auto & q = *queues_[wid];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.tasks.empty()) return false;
+        task = std::move(q.tasks.back());
+        q.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(size_t wid, Task & task) {
+        for (size_t i = 1; i < num_threads_; i++) {
+            auto & q = *queues_[(wid + i) % num_threads_];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (q.tasks.empty()) continue;
+            task = std::move(q.tasks.front());
+            q.tasks.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    void work(size_t wid) {
+        Task task;
+        // a running task keeps pending_ above zero, so nothing is submitted
+        //   once it drops to zero
+        while (pending_.load(std::memory_order_acquire) > 0) {
+            if (pop_own(wid, task) || steal(wid, task)) {
+                task(*this, wid);
+                task = nullptr;
+                pending_.fetch_sub(1, std::memory_order_acq_rel);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+};
+
+#endif // UTILS_WORK_STEALING_POOL_HPP_